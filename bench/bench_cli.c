@@ -0,0 +1,212 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#include "../m3_cli.h"
+
+/* micro-benchmark for m3_cli_query: latency of one query against the size of the answer
+   a forked child plays the CLI, it answers "answer <n>" with <n> bytes (written in chunks) followed by the prompt
+   every size is measured with m3_cli_query (allocated answer) and m3_cli_query_view (view into the session buffer),
+   the heap allocations per query are counted by wrapping malloc, calloc and realloc (-Wl,--wrap) */
+
+#define PROMPT      "bench> "
+#define CHUNK       4096
+
+void safefree(void **pp);
+
+/* heap allocations done by this process */
+static unsigned long allocations;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+void *__wrap_malloc(size_t size)
+{
+    allocations++;
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t nmemb, size_t size)
+{
+    allocations++;
+    return __real_calloc(nmemb, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+    allocations++;
+    return __real_realloc(ptr, size);
+}
+
+/* write everything or fail */
+static int write_all(int fd, const char *data, size_t len)
+{
+    ssize_t x;
+
+    while (len > 0) {
+        x = write(fd, data, len);
+        if (x <= 0) {
+            return -1;
+        }
+        data += x;
+        len -= x;
+    }
+
+    return 0;
+}
+
+/* the fake CLI: answer every line until the client disconnects */
+static void fake_cli(int listen_fd)
+{
+    char line[256], text[CHUNK];
+    size_t len = 0, n, i;
+    ssize_t x;
+    char *nl;
+    int fd;
+
+    /* the answer is made of lines of 80 characters */
+    for (i = 0; i < CHUNK; i++) {
+        text[i] = (i % 80 == 79) ? '\n' : 'x';
+    }
+
+    fd = accept(listen_fd, NULL, NULL);
+    if (fd < 0 || write_all(fd, PROMPT, strlen(PROMPT)) != 0) {
+        exit(1);
+    }
+
+    for (;;) {
+        x = read(fd, line + len, sizeof(line) - len - 1);
+        if (x <= 0) {
+            exit(0);
+        }
+        len += x;
+        line[len] = '\0';
+
+        while ((nl = strchr(line, '\n')) != NULL) {
+            *nl = '\0';
+            if (strncmp(line, "answer ", 7) == 0) {
+                for (n = strtoul(line + 7, NULL, 10); n > 0; n -= i) {
+                    i = (n > CHUNK) ? CHUNK : n;
+                    write_all(fd, text, i);
+                }
+            }
+            write_all(fd, PROMPT, strlen(PROMPT));
+            len -= nl + 1 - line;
+            memmove(line, nl + 1, len + 1);
+        }
+    }
+}
+
+/* monotonic time in microseconds */
+static double now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+int main(int argc, char **argv)
+{
+    size_t sizes[] = { 1 << 10, 4 << 10, 16 << 10, 64 << 10, 256 << 10, 1 << 20, 4 << 20 };
+    char path[] = "/tmp/bench-cli-XXXXXX";
+    char socket_path[64], cmd[64];
+    struct sockaddr_un addr;
+    struct s_m3_cli *cli;
+    char *answer = NULL;
+    const char *answer_view;
+    size_t len;
+    double start, elapsed;
+    int listen_fd, i, iterations, view;
+    bool ok;
+    unsigned int s;
+    pid_t pid;
+
+    if (mkdtemp(path) == NULL) {
+        printf("Failed to create a temporary directory (%d): %s\n", errno, strerror(errno));
+        return -1;
+    }
+    snprintf(socket_path, sizeof(socket_path), "%s/cli.socket", path);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, socket_path, sizeof(addr.sun_path) - 1);
+    listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd < 0 || bind(listen_fd, (struct sockaddr *) &addr, sizeof(addr)) != 0 || listen(listen_fd, 1) != 0) {
+        printf("Failed to create the socket %s (%d): %s\n", socket_path, errno, strerror(errno));
+        return -1;
+    }
+
+    pid = fork();
+    if (pid == 0) {
+        fake_cli(listen_fd);
+    }
+    close(listen_fd);
+
+    cli = m3_cli_initialise(socket_path, 300);
+    if (cli == NULL) {
+        printf("Failed to initialise CLI (%d): %s\n", errno, strerror(errno));
+        kill(pid, SIGTERM);
+        return -1;
+    }
+
+    printf("%12s %10s %6s %14s %12s %14s\n", "answer size", "queries", "api", "latency [us]", "MB/s", "allocs/query");
+    for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        /* scale the iterations so that every size moves roughly the same amount of data */
+        iterations = (argc > 1) ? atoi(argv[1]) : 64 * 1024 * 1024 / sizes[s];
+        if (iterations > 2000) {
+            iterations = 2000;
+        }
+        snprintf(cmd, sizeof(cmd), "answer %zu", sizes[s]);
+
+        for (view = 0; view < 2; view++) {
+            /* warm up: the receive buffer of the session grows to the answer size */
+            if (m3_cli_query_view(cli, cmd, &answer_view, &len, 10000) == false) {
+                printf("Query for %zu bytes failed (%d): %s\n", sizes[s], errno, strerror(errno));
+                m3_cli_shutdown(&cli);
+                kill(pid, SIGTERM);
+                return -1;
+            }
+
+            allocations = 0;
+            start = now_us();
+            for (i = 0; i < iterations; i++) {
+                if (view == 1) {
+                    ok = m3_cli_query_view(cli, cmd, &answer_view, &len, 10000);
+                }
+                else {
+                    ok = m3_cli_query(cli, cmd, &answer, 10000);
+                    len = (ok == true) ? strlen(answer) : 0;
+                    safefree((void **) &answer);
+                }
+                if (ok == false || len != sizes[s]) {
+                    printf("Query for %zu bytes failed (%d): %s\n", sizes[s], errno, strerror(errno));
+                    m3_cli_shutdown(&cli);
+                    kill(pid, SIGTERM);
+                    return -1;
+                }
+            }
+            elapsed = now_us() - start;
+
+            printf("%12zu %10d %6s %14.1f %12.1f %14.2f\n", sizes[s], iterations, view ? "view" : "query",
+                   elapsed / iterations, (double) sizes[s] * iterations / elapsed, (double) allocations / iterations);
+        }
+    }
+
+    m3_cli_shutdown(&cli);
+    waitpid(pid, NULL, 0);
+    unlink(socket_path);
+    rmdir(path);
+
+    return 0;
+}
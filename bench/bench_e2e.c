@@ -0,0 +1,241 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "libmcip.h"
+#include "../m3_cli.h"
+#include "../histogram.h"
+
+/* end-to-end benchmark of the CLI path against the fake CLI (bench/fake-cli)
+   every scenario starts a fake CLI with other options and measures
+     - m3_cli_query over one session (latency of every query)
+     - the cli-cmd applet (one process per command, including connect and handshake)
+   and prints the throughput and the latency percentiles
+
+   usage: bench-e2e [<fake-cli> [<cli-cmd> [<queries>]]] */
+
+struct s_scenario {
+    const char *name;           /* name printed in the report */
+    const char *options[4];     /* options of the fake CLI */
+    const char *command;        /* command that is queried */
+};
+
+static const struct s_scenario scenarios[] = {
+    { "plain",          { NULL },                               "status.ethernet1.port[1].link" },
+    { "fragmented",     { "--chunk", "3", NULL },               "status.ethernet1.port[1].link" },
+    { "latency 1ms",    { "--latency", "1", NULL },             "status.ethernet1.port[1].link" },
+    { "set",            { NULL },                               "administration.hostnames.location=bench" },
+    { "answer 64 KiB",  { NULL },                               "answer 65536" },
+    { "answer 4 MiB",   { NULL },                               "answer 4194304" },
+};
+
+void safefree(void **pp);
+
+/* current time (CLOCK_MONOTONIC) in us */
+static int64_t now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* start the fake CLI and wait until it accepts connections */
+static pid_t start_fake_cli(const char *fake_cli, const char *socket_path, const char * const *options)
+{
+    const char *argv[16];
+    int argc = 0, i, fd;
+    pid_t pid;
+
+    argv[argc++] = fake_cli;
+    argv[argc++] = "--socket";
+    argv[argc++] = socket_path;
+    for (i = 0; options[i] != NULL; i++) {
+        argv[argc++] = options[i];
+    }
+    argv[argc] = NULL;
+
+    unlink(socket_path);
+    pid = fork();
+    if (pid == 0) {
+        execv(fake_cli, (char **) argv);
+        _exit(127);
+    }
+    if (pid < 0) {
+        return -1;
+    }
+
+    for (i = 0; i < 200; i++) {
+        fd = mcip_open_uds_socket(socket_path);
+        if (fd >= 0) {
+            close(fd);
+            return pid;
+        }
+        usleep(10000);
+    }
+
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+    return -1;
+}
+
+/* run cli-cmd once, its output is discarded */
+static bool run_cli_cmd(const char *cli_cmd, const char *command)
+{
+    int status, fd;
+    pid_t pid;
+
+    pid = fork();
+    if (pid == 0) {
+        fd = open("/dev/null", O_WRONLY);
+        if (fd >= 0) {
+            dup2(fd, STDOUT_FILENO);
+        }
+        execl(cli_cmd, "cli-cmd", command, (char *) NULL);
+        _exit(127);
+    }
+    if (pid < 0 || waitpid(pid, &status, 0) != pid) {
+        return false;
+    }
+
+    return (WIFEXITED(status) && WEXITSTATUS(status) == 0);
+}
+
+/* print one line of the report */
+static void report(const char *scenario, const char *driver, const struct s_histogram *histogram, int64_t elapsed_us)
+{
+    printf("%-16s %-14s %8llu %10.0f %10llu %10llu %10llu %10llu\n", scenario, driver,
+           (unsigned long long) histogram->count,
+           elapsed_us > 0 ? histogram->count * 1e6 / elapsed_us : 0.0,
+           (unsigned long long) histogram_percentile(histogram, 50),
+           (unsigned long long) histogram_percentile(histogram, 90),
+           (unsigned long long) histogram_percentile(histogram, 99),
+           (unsigned long long) histogram->max);
+    fflush(stdout);
+    return;
+}
+
+/* measure m3_cli_query over one session */
+static bool bench_query(const struct s_scenario *scenario, const char *socket_path, int queries)
+{
+    struct s_histogram *histogram;
+    struct s_m3_cli *cli;
+    char *answer = NULL;
+    int64_t start, t;
+    int i;
+
+    cli = m3_cli_initialise(socket_path, 1000);
+    if (cli == NULL) {
+        printf("Failed to initialise CLI (%d): %s\n", errno, strerror(errno));
+        return false;
+    }
+
+    /* the large answers move the same amount of data as 64 KiB answers */
+    if (strncmp(scenario->command, "answer ", 7) == 0 && atoi(scenario->command + 7) > 65536) {
+        queries = queries * 65536 / atoi(scenario->command + 7) + 1;
+    }
+
+    histogram = calloc(1, sizeof(struct s_histogram));
+    start = now_us();
+    for (i = 0; i < queries; i++) {
+        t = now_us();
+        if (m3_cli_query(cli, (char *) scenario->command, &answer, 10000) == false) {
+            printf("Query failed (%d): %s\n", errno, strerror(errno));
+            safefree((void **) &histogram);
+            m3_cli_shutdown(&cli);
+            return false;
+        }
+        histogram_record(histogram, now_us() - t);
+        safefree((void **) &answer);
+    }
+    report(scenario->name, "m3_cli_query", histogram, now_us() - start);
+
+    safefree((void **) &histogram);
+    m3_cli_shutdown(&cli);
+
+    return true;
+}
+
+/* measure the cli-cmd applet, every command is a new process and a new session */
+static bool bench_cli_cmd(const struct s_scenario *scenario, const char *cli_cmd, int runs)
+{
+    struct s_histogram *histogram;
+    int64_t start, t;
+    int i;
+
+    histogram = calloc(1, sizeof(struct s_histogram));
+    start = now_us();
+    for (i = 0; i < runs; i++) {
+        t = now_us();
+        if (run_cli_cmd(cli_cmd, scenario->command) == false) {
+            printf("%s failed\n", cli_cmd);
+            safefree((void **) &histogram);
+            return false;
+        }
+        histogram_record(histogram, now_us() - t);
+    }
+    report(scenario->name, "cli-cmd", histogram, now_us() - start);
+
+    safefree((void **) &histogram);
+
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    const char *fake_cli = (argc > 1) ? argv[1] : "./bench/fake-cli";
+    const char *cli_cmd = (argc > 2) ? argv[2] : "./bench/cli-cmd";
+    int queries = (argc > 3) ? atoi(argv[3]) : 2000;
+    char path[] = "/tmp/bench-e2e-XXXXXX";
+    char socket_path[64];
+    bool ok = true;
+    unsigned int s;
+    pid_t pid;
+
+    if (mkdtemp(path) == NULL) {
+        printf("Failed to create a temporary directory (%d): %s\n", errno, strerror(errno));
+        return -1;
+    }
+    snprintf(socket_path, sizeof(socket_path), "%s/cli.socket", path);
+
+    /* cli-cmd talks to the fake CLI instead of the router */
+    setenv("M3_CLI_SOCKET", socket_path, 1);
+    unsetenv("M3_CLI_CACHE");
+    unsetenv("M3_CLI_STATS");
+    if (access(cli_cmd, X_OK) != 0) {
+        printf("%s is not available, only m3_cli_query is measured\n", cli_cmd);
+        cli_cmd = NULL;
+    }
+
+    printf("%-16s %-14s %8s %10s %10s %10s %10s %10s\n", "scenario", "driver", "count", "ops/s",
+           "p50 [us]", "p90 [us]", "p99 [us]", "max [us]");
+    for (s = 0; ok == true && s < sizeof(scenarios) / sizeof(scenarios[0]); s++) {
+        pid = start_fake_cli(fake_cli, socket_path, scenarios[s].options);
+        if (pid < 0) {
+            printf("Failed to start %s\n", fake_cli);
+            ok = false;
+            break;
+        }
+
+        ok = bench_query(&scenarios[s], socket_path, queries);
+        if (ok == true && cli_cmd != NULL) {
+            ok = bench_cli_cmd(&scenarios[s], cli_cmd, (queries / 20 > 0) ? queries / 20 : 1);
+        }
+
+        kill(pid, SIGTERM);
+        waitpid(pid, NULL, 0);
+    }
+
+    unlink(socket_path);
+    rmdir(path);
+
+    return (ok == true) ? 0 : -1;
+}
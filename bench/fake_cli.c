@@ -0,0 +1,412 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+#include <stdbool.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+/* stand-in for the CLI of the router on a local Unix Domain Socket, so the CLI code can be exercised on any Linux box
+   every client is served by its own thread, the values are shared between all clients
+
+   commands:
+     <key>=<value>          set a value, the answer is empty
+     <key>                  get a value: a scripted answer, a value that has been set, a generated value for keys
+                            starting with "status." or "<key> is unknown"
+     ...submit[=x]          keys containing "submit" or "activate" answer "OK" instead of being stored
+     answer <n>             answer with <n> bytes (lines of 80 characters)
+     sleep <ms>             answer after <ms> milliseconds */
+
+#define FAKE_CLI_LINE_MAX   65536
+#define FAKE_CLI_VALUES     4096
+
+struct s_value {
+    char *key;
+    char *value;
+};
+
+/* configuration */
+static char *prompt = "router> ";
+static int latency_ms = 0;
+static size_t chunk = 0;
+static int chunk_delay_us = 0;
+
+/* values set by the clients and read from the script */
+static struct s_value values[FAKE_CLI_VALUES];
+static int value_count = 0;
+static pthread_mutex_t values_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void safefree(void **pp)
+{
+    if (pp != NULL) {
+        free(*pp);
+        *pp = NULL;
+    }
+    return;
+}
+
+/* print help, then exit */
+static void usage(char *tool)
+{
+    printf("\nUsage: %s [OPTIONS]\n"                                                              \
+            "Fake CLI of the router for benchmarks.\n"                                            \
+            "\n"                                                                                  \
+            "  -h, --help            Display this help and exit.\n"                               \
+            "  -s, --socket \"path\"   Listen on this socket (default /tmp/fake-cli.socket).\n"    \
+            "  -p, --prompt \"text\"   Prompt to send (default \"router> \").\n"                  \
+            "  -l, --latency value   Delay of every answer in ms.\n"                              \
+            "  -c, --chunk value     Send the answers in chunks of <value> bytes.\n"              \
+            "  -d, --chunk-delay us  Pause between two chunks in us.\n"                         \
+            "  -f, --script \"file\"   Scripted answers, one \"<command>\\t<answer>\" per line,\n" \
+            "                        \"\\n\" in the answer is a line break.\n"                     \
+            "\n", tool);
+    exit(0);
+}
+
+/* sleep for some microseconds */
+static void sleep_us(long us)
+{
+    struct timespec ts;
+
+    ts.tv_sec = us / 1000000;
+    ts.tv_nsec = (us % 1000000) * 1000;
+    while (nanosleep(&ts, &ts) == -1 && errno == EINTR);
+    return;
+}
+
+/* find a value, must be called with the lock held */
+static struct s_value *find_value(const char *key)
+{
+    int i;
+
+    for (i = 0; i < value_count; i++) {
+        if (strcmp(values[i].key, key) == 0) {
+            return &values[i];
+        }
+    }
+    return NULL;
+}
+
+/* set a value */
+static bool set_value(const char *key, const char *value)
+{
+    struct s_value *v;
+    bool ok = true;
+
+    pthread_mutex_lock(&values_lock);
+    v = find_value(key);
+    if (v != NULL) {
+        safefree((void **) &v->value);
+        v->value = strdup(value);
+    }
+    else if (value_count < FAKE_CLI_VALUES) {
+        values[value_count].key = strdup(key);
+        values[value_count].value = strdup(value);
+        value_count++;
+    }
+    else {
+        ok = false;
+    }
+    pthread_mutex_unlock(&values_lock);
+
+    return ok;
+}
+
+/* get a copy of a value, NULL if it is not known */
+static char *get_value(const char *key)
+{
+    struct s_value *v;
+    char *value = NULL;
+
+    pthread_mutex_lock(&values_lock);
+    v = find_value(key);
+    if (v != NULL) {
+        value = strdup(v->value);
+    }
+    pthread_mutex_unlock(&values_lock);
+
+    return value;
+}
+
+/* read the scripted answers */
+static bool read_script(const char *path)
+{
+    FILE *f;
+    char *line = NULL, *tab, *p;
+    size_t size = 0;
+    ssize_t len;
+
+    f = fopen(path, "r");
+    if (f == NULL) {
+        return false;
+    }
+
+    while ((len = getline(&line, &size, f)) != -1) {
+        while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) {
+            line[--len] = '\0';
+        }
+        tab = strchr(line, '\t');
+        if (len == 0 || line[0] == '#' || tab == NULL) {
+            continue;
+        }
+        *tab++ = '\0';
+
+        /* "\n" is a line break of a multi line answer */
+        while ((p = strstr(tab, "\\n")) != NULL) {
+            p[0] = '\n';
+            memmove(p + 1, p + 2, strlen(p + 2) + 1);
+        }
+        set_value(line, tab);
+    }
+
+    safefree((void **) &line);
+    fclose(f);
+
+    return true;
+}
+
+/* write everything, in chunks if configured */
+static bool write_all(int fd, const char *data, size_t len)
+{
+    size_t n;
+    ssize_t x;
+
+    while (len > 0) {
+        n = (chunk > 0 && chunk < len) ? chunk : len;
+        x = send(fd, data, n, MSG_NOSIGNAL);
+        if (x <= 0) {
+            return false;
+        }
+        data += x;
+        len -= x;
+        if (chunk > 0 && chunk_delay_us > 0 && len > 0) {
+            sleep_us(chunk_delay_us);
+        }
+    }
+
+    return true;
+}
+
+/* send an answer of <n> generated bytes followed by the prompt */
+static bool answer_generated(int fd, size_t n)
+{
+    char text[4096];
+    size_t i;
+
+    for (i = 0; i < sizeof(text); i++) {
+        text[i] = (i % 80 == 79) ? '\n' : 'x';
+    }
+    for (; n > 0; n -= i) {
+        i = (n > sizeof(text)) ? sizeof(text) : n;
+        if (write_all(fd, text, i) == false) {
+            return false;
+        }
+    }
+
+    return write_all(fd, "\r\n", 2) && write_all(fd, prompt, strlen(prompt));
+}
+
+/* answer one command */
+static bool answer_command(int fd, char *line)
+{
+    char *answer = NULL, *eq, *out;
+    bool ok;
+
+    if (latency_ms > 0) {
+        sleep_us((long) latency_ms * 1000);
+    }
+
+    /* an empty line only gets the prompt */
+    if (line[0] == '\0') {
+        return write_all(fd, prompt, strlen(prompt));
+    }
+
+    if (strncmp(line, "answer ", 7) == 0) {
+        return answer_generated(fd, strtoul(line + 7, NULL, 10));
+    }
+    if (strncmp(line, "sleep ", 6) == 0) {
+        sleep_us(atol(line + 6) * 1000);
+        return write_all(fd, prompt, strlen(prompt));
+    }
+
+    eq = strchr(line, '=');
+    if (strstr(line, "submit") != NULL || strstr(line, "activate") != NULL) {
+        answer = strdup("OK");
+    }
+    else if (eq != NULL) {
+        *eq = '\0';
+        if (set_value(line, eq + 1) == false) {
+            answer = strdup("too many values");
+        }
+    }
+    else {
+        answer = get_value(line);
+        if (answer == NULL && strncmp(line, "status.", 7) == 0) {
+            asprintf(&answer, "value-of-%s", line);
+        }
+        else if (answer == NULL) {
+            asprintf(&answer, "%s is unknown", line);
+        }
+    }
+
+    if (answer == NULL) {
+        return write_all(fd, prompt, strlen(prompt));
+    }
+    if (asprintf(&out, "%s\r\n%s", answer, prompt) == -1) {
+        safefree((void **) &answer);
+        return false;
+    }
+    ok = write_all(fd, out, strlen(out));
+    safefree((void **) &out);
+    safefree((void **) &answer);
+
+    return ok;
+}
+
+/* serve one client until it disconnects */
+static void *serve_client(void *arg)
+{
+    int fd = (int) (intptr_t) arg;
+    char *line, *nl;
+    size_t len = 0;
+    ssize_t x;
+
+    line = malloc(FAKE_CLI_LINE_MAX + 1);
+    if (line == NULL || write_all(fd, prompt, strlen(prompt)) == false) {
+        safefree((void **) &line);
+        close(fd);
+        return NULL;
+    }
+
+    for (;;) {
+        x = read(fd, line + len, FAKE_CLI_LINE_MAX - len);
+        if (x <= 0) {
+            break;
+        }
+        len += x;
+        line[len] = '\0';
+
+        while ((nl = memchr(line, '\n', len)) != NULL) {
+            *nl = '\0';
+            if (nl > line && nl[-1] == '\r') {
+                nl[-1] = '\0';
+            }
+            if (answer_command(fd, line) == false) {
+                len = 0;
+                goto out;
+            }
+            len -= nl + 1 - line;
+            memmove(line, nl + 1, len + 1);
+        }
+
+        /* a line that is too long is dropped */
+        if (len == FAKE_CLI_LINE_MAX) {
+            len = 0;
+        }
+    }
+
+out:
+    safefree((void **) &line);
+    close(fd);
+
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    char *socket_path = "/tmp/fake-cli.socket";
+    struct sockaddr_un addr;
+    pthread_t thread;
+    int listen_fd, fd, c;
+    static char strOpts[] = "hs:p:l:c:d:f:";
+    static struct option Opts[] = {
+        { "help",           no_argument,        0, 'h' },
+        { "socket",         required_argument,  0, 's' },
+        { "prompt",         required_argument,  0, 'p' },
+        { "latency",        required_argument,  0, 'l' },
+        { "chunk",          required_argument,  0, 'c' },
+        { "chunk-delay",    required_argument,  0, 'd' },
+        { "script",         required_argument,  0, 'f' },
+        { 0,                0,                  0,  0  }
+    };
+
+    while ((c = getopt_long(argc, argv, strOpts, Opts, NULL)) != -1) {
+        switch (c) {
+            case 's': {
+                socket_path = optarg;
+                break;
+            }
+            case 'p': {
+                prompt = optarg;
+                break;
+            }
+            case 'l': {
+                latency_ms = atoi(optarg);
+                break;
+            }
+            case 'c': {
+                chunk = strtoul(optarg, NULL, 10);
+                break;
+            }
+            case 'd': {
+                chunk_delay_us = atoi(optarg);
+                break;
+            }
+            case 'f': {
+                if (read_script(optarg) == false) {
+                    printf("Failed to read the script %s (%d): %s\n", optarg, errno, strerror(errno));
+                    return -1;
+                }
+                break;
+            }
+            default:
+            case 'h': {
+                usage(argv[0]);
+                break;
+            }
+        }
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+        printf("The socket path %s is too long\n", socket_path);
+        return -1;
+    }
+    strcpy(addr.sun_path, socket_path);
+
+    unlink(socket_path);
+    listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0 || bind(listen_fd, (struct sockaddr *) &addr, sizeof(addr)) != 0 || listen(listen_fd, 64) != 0) {
+        printf("Failed to listen on %s (%d): %s\n", socket_path, errno, strerror(errno));
+        return -1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    for (;;) {
+        fd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            break;
+        }
+        if (pthread_create(&thread, NULL, serve_client, (void *) (intptr_t) fd) != 0) {
+            close(fd);
+            continue;
+        }
+        pthread_detach(thread);
+    }
+
+    close(listen_fd);
+    unlink(socket_path);
+
+    return -1;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+/* minimal stand-in for libmcip, so that m3_cli.c and the CLI applets of mcip-tool can be built and benchmarked
+   on any Linux box without the MCIP library of the M3 firmware, all MCIP functions fail with ENOSYS */
+
+#include <stdint.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+/* open a connection to a Unix Domain Socket, returns the fd or -1 */
+static inline int mcip_open_uds_socket(const char *path)
+{
+    struct sockaddr_un addr;
+    int fd;
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+    if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+#define MCIP_CMD_WRITE  1
+
+struct oid_list {
+    uint16_t oid;
+    struct oid_list *next;
+};
+
+static inline void mcip_oid_append(struct oid_list **oids, uint16_t oid)
+{
+    return;
+}
+
+static inline void mcip_oids_destroy(struct oid_list *oids)
+{
+    return;
+}
+
+static inline int mcip_uds_register(const char *path, struct oid_list *oids)
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+static inline void mcip_uds_deregister(int *sock)
+{
+    return;
+}
+
+static inline int mcip_send(int sock, int cmd, int len, char *data)
+{
+    errno = ENOSYS;
+    return -1;
+}
@@ -0,0 +1,460 @@
+#define _GNU_SOURCE
+
+#include "event_filter.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+
+enum event_filter_token {
+    EVENT_FILTER_END,                   /* end of the expression */
+    EVENT_FILTER_WORD,                  /* field, keyword or value */
+    EVENT_FILTER_STRING,                /* quoted value */
+    EVENT_FILTER_PUNCT,                 /* ( ) { } , */
+    EVENT_FILTER_OPERATOR               /* == != < <= > >= */
+};
+
+/* state of the compiler */
+struct s_event_filter_parser {
+    struct s_event_filter *filter;
+    const char *expression;
+    const char *pos;                    /* behind the current token */
+    enum event_filter_token token;
+    const char *start;                  /* current token */
+    size_t len;
+};
+
+/* read the next token */
+static bool event_filter_next(struct s_event_filter_parser *parser)
+{
+    const char *p = parser->pos;
+
+    while (*p == ' ' || *p == '\t') {
+        p++;
+    }
+    parser->start = p;
+    parser->len = 0;
+
+    if (*p == '\0') {
+        parser->token = EVENT_FILTER_END;
+    }
+    else if (strchr("(){},", *p) != NULL) {
+        parser->token = EVENT_FILTER_PUNCT;
+        parser->len = 1;
+    }
+    else if (strchr("=!<>", *p) != NULL) {
+        parser->token = EVENT_FILTER_OPERATOR;
+        parser->len = (p[1] == '=') ? 2 : 1;
+        if (parser->len == 1 && (*p == '=' || *p == '!')) {
+            errno = EINVAL;
+            return false;
+        }
+    }
+    else if (*p == '"') {
+        /* the token is the text between the quotes */
+        parser->token = EVENT_FILTER_STRING;
+        parser->start = ++p;
+        while (*p != '"' && *p != '\0') {
+            p++;
+        }
+        if (*p == '\0') {
+            errno = EINVAL;
+            return false;
+        }
+        parser->len = p - parser->start;
+        parser->pos = p + 1;
+        return true;
+    }
+    else {
+        parser->token = EVENT_FILTER_WORD;
+        while (*p != '\0' && *p != ' ' && *p != '\t' && strchr("(){},=!<>\"", *p) == NULL) {
+            p++;
+        }
+        parser->len = p - parser->start;
+        parser->pos = p;
+        return true;
+    }
+
+    parser->pos = p + parser->len;
+    return true;
+}
+
+/* check if the current token is the word or punctuation */
+static bool event_filter_is(struct s_event_filter_parser *parser, const char *word)
+{
+    if (parser->token != EVENT_FILTER_WORD && parser->token != EVENT_FILTER_PUNCT && parser->token != EVENT_FILTER_OPERATOR) {
+        return false;
+    }
+    return (parser->len == strlen(word) && strncasecmp(parser->start, word, parser->len) == 0);
+}
+
+/* append an operation */
+static bool event_filter_emit(struct s_event_filter_parser *parser, uint8_t code, uint8_t field, uint8_t operator, uint8_t value, uint8_t value_count)
+{
+    struct s_event_filter *filter = parser->filter;
+    struct s_event_filter_op *op;
+
+    if (filter->op_count == EVENT_FILTER_OPS) {
+        errno = E2BIG;
+        return false;
+    }
+    op = &filter->ops[filter->op_count++];
+    op->code = code;
+    op->field = field;
+    op->operator = operator;
+    op->value = value;
+    op->value_count = value_count;
+
+    return true;
+}
+
+/* append the current token as value of the field */
+static bool event_filter_value(struct s_event_filter_parser *parser, enum event_filter_field field)
+{
+    struct s_event_filter *filter = parser->filter;
+    struct s_event_filter_value *value;
+    char number[24];
+    char *end;
+
+    if (parser->token != EVENT_FILTER_WORD && parser->token != EVENT_FILTER_STRING) {
+        errno = EINVAL;
+        return false;
+    }
+    if (filter->value_count == EVENT_FILTER_VALUES) {
+        errno = E2BIG;
+        return false;
+    }
+    value = &filter->values[filter->value_count];
+    memset(value, 0, sizeof(struct s_event_filter_value));
+
+    switch (field) {
+        case EVENT_FILTER_TYPE: {
+            if (event_filter_is(parser, "input") == true) {
+                value->number = MCIP_EVENT_INPUT;
+            }
+            else if (event_filter_is(parser, "pulse") == true) {
+                value->number = MCIP_EVENT_PULSE;
+            }
+            else if (event_filter_is(parser, "other") == true) {
+                value->number = MCIP_EVENT_OTHER;
+            }
+            else {
+                errno = EINVAL;
+                return false;
+            }
+            break;
+        }
+
+        case EVENT_FILTER_OID:
+        case EVENT_FILTER_PULSES: {
+            if (parser->len == 0 || parser->len >= sizeof(number)) {
+                errno = EINVAL;
+                return false;
+            }
+            memcpy(number, parser->start, parser->len);
+            number[parser->len] = '\0';
+            value->number = strtol(number, &end, 10);
+            if (*end != '\0') {
+                errno = EINVAL;
+                return false;
+            }
+            break;
+        }
+
+        default: {
+            /* the strings are terminated for the comparisons */
+            if (filter->pool_len + parser->len + 1 > EVENT_FILTER_POOL) {
+                errno = E2BIG;
+                return false;
+            }
+            memcpy(filter->pool + filter->pool_len, parser->start, parser->len);
+            filter->pool[filter->pool_len + parser->len] = '\0';
+            value->string = filter->pool_len;
+            value->len = parser->len;
+            filter->pool_len += parser->len + 1;
+            break;
+        }
+    }
+    filter->value_count++;
+
+    return event_filter_next(parser);
+}
+
+/* compile a comparison: <field> <operator> <value> */
+static bool event_filter_comparison(struct s_event_filter_parser *parser)
+{
+    static const char *fields[] = { "type", "oid", "input", "state", "pulses", "text" };
+    static const char *operators[] = { "==", "!=", "<", "<=", ">", ">=", "in", "contains" };
+    int field, operator;
+    int first = parser->filter->value_count;
+
+    for (field = 0; field < 6 && event_filter_is(parser, fields[field]) == false; field++);
+    if (field == 6 || event_filter_next(parser) == false) {
+        errno = EINVAL;
+        return false;
+    }
+    for (operator = 0; operator < 8 && event_filter_is(parser, operators[operator]) == false; operator++);
+    if (operator == 8) {
+        errno = EINVAL;
+        return false;
+    }
+
+    /* only numbers can be ordered, only strings can contain something */
+    if ((operator >= EVENT_FILTER_LT && operator <= EVENT_FILTER_GE && field != EVENT_FILTER_OID && field != EVENT_FILTER_PULSES) ||
+        (operator == EVENT_FILTER_CONTAINS && field != EVENT_FILTER_INPUT && field != EVENT_FILTER_STATE && field != EVENT_FILTER_TEXT)) {
+        errno = EINVAL;
+        return false;
+    }
+    if (event_filter_next(parser) == false) {
+        return false;
+    }
+
+    if (operator == EVENT_FILTER_IN) {
+        if (event_filter_is(parser, "{") == false || event_filter_next(parser) == false) {
+            errno = EINVAL;
+            return false;
+        }
+        do {
+            if (event_filter_value(parser, field) == false) {
+                return false;
+            }
+        } while (event_filter_is(parser, ",") == true && event_filter_next(parser) == true);
+        if (event_filter_is(parser, "}") == false || event_filter_next(parser) == false) {
+            errno = EINVAL;
+            return false;
+        }
+    }
+    else if (event_filter_value(parser, field) == false) {
+        return false;
+    }
+
+    return event_filter_emit(parser, EVENT_FILTER_CMP, field, operator, first, parser->filter->value_count - first);
+}
+
+static bool event_filter_or(struct s_event_filter_parser *parser);
+
+/* compile "not" <factor>, "(" <expression> ")" or a comparison */
+static bool event_filter_factor(struct s_event_filter_parser *parser)
+{
+    if (event_filter_is(parser, "not") == true) {
+        if (event_filter_next(parser) == false || event_filter_factor(parser) == false) {
+            return false;
+        }
+        return event_filter_emit(parser, EVENT_FILTER_NOT, 0, 0, 0, 0);
+    }
+
+    if (event_filter_is(parser, "(") == true) {
+        if (event_filter_next(parser) == false || event_filter_or(parser) == false) {
+            return false;
+        }
+        if (event_filter_is(parser, ")") == false) {
+            errno = EINVAL;
+            return false;
+        }
+        return event_filter_next(parser);
+    }
+
+    return event_filter_comparison(parser);
+}
+
+/* compile <factor> "and" <factor> ... */
+static bool event_filter_and(struct s_event_filter_parser *parser)
+{
+    if (event_filter_factor(parser) == false) {
+        return false;
+    }
+    while (event_filter_is(parser, "and") == true) {
+        if (event_filter_next(parser) == false || event_filter_factor(parser) == false) {
+            return false;
+        }
+        if (event_filter_emit(parser, EVENT_FILTER_AND, 0, 0, 0, 0) == false) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/* compile <and> "or" <and> ... */
+static bool event_filter_or(struct s_event_filter_parser *parser)
+{
+    if (event_filter_and(parser) == false) {
+        return false;
+    }
+    while (event_filter_is(parser, "or") == true) {
+        if (event_filter_next(parser) == false || event_filter_and(parser) == false) {
+            return false;
+        }
+        if (event_filter_emit(parser, EVENT_FILTER_OR, 0, 0, 0, 0) == false) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/* compile an expression */
+bool event_filter_compile(struct s_event_filter *filter, const char *expression)
+{
+    struct s_event_filter_parser parser;
+
+    memset(filter, 0, sizeof(struct s_event_filter));
+    memset(&parser, 0, sizeof(struct s_event_filter_parser));
+    parser.filter = filter;
+    parser.expression = expression;
+    parser.pos = expression;
+
+    if (event_filter_next(&parser) == false || event_filter_or(&parser) == false) {
+        filter->error = parser.start - expression;
+        filter->op_count = 0;
+        return false;
+    }
+    if (parser.token != EVENT_FILTER_END) {
+        filter->error = parser.start - expression;
+        filter->op_count = 0;
+        errno = EINVAL;
+        return false;
+    }
+
+    return true;
+}
+
+/* check if a string field equals a value */
+static bool event_filter_equal(const struct s_event_filter *filter, int field, const char *string, size_t len, const struct s_event_filter_value *value)
+{
+    if (field == EVENT_FILTER_TEXT) {
+        return (len == value->len && memcmp(string, filter->pool + value->string, len) == 0);
+    }
+    return (strcasecmp(string, filter->pool + value->string) == 0);
+}
+
+/* evaluate a comparison */
+static bool event_filter_compare(const struct s_event_filter *filter, const struct s_event_filter_op *op, const struct s_mcip_event *event)
+{
+    const struct s_event_filter_value *value = &filter->values[op->value];
+    const char *string = NULL;
+    size_t len = 0;
+    long number = 0;
+    int i;
+
+    switch (op->field) {
+        case EVENT_FILTER_TYPE: {
+            number = event->type;
+            break;
+        }
+
+        case EVENT_FILTER_OID: {
+            number = event->oid;
+            break;
+        }
+
+        case EVENT_FILTER_PULSES: {
+            if (event->pulses < 0) {
+                return false;
+            }
+            number = event->pulses;
+            break;
+        }
+
+        case EVENT_FILTER_INPUT:
+        case EVENT_FILTER_STATE: {
+            string = (op->field == EVENT_FILTER_INPUT) ? event->input : event->state;
+            if (string[0] == '\0') {
+                return false;
+            }
+            break;
+        }
+
+        case EVENT_FILTER_TEXT: {
+            string = event->text;
+            len = event->text_len;
+            break;
+        }
+    }
+
+    if (string == NULL) {
+        switch (op->operator) {
+            case EVENT_FILTER_EQ:
+                return (number == value->number);
+            case EVENT_FILTER_NE:
+                return (number != value->number);
+            case EVENT_FILTER_LT:
+                return (number < value->number);
+            case EVENT_FILTER_LE:
+                return (number <= value->number);
+            case EVENT_FILTER_GT:
+                return (number > value->number);
+            case EVENT_FILTER_GE:
+                return (number >= value->number);
+            default:
+                for (i = 0; i < op->value_count; i++) {
+                    if (number == value[i].number) {
+                        return true;
+                    }
+                }
+                return false;
+        }
+    }
+
+    switch (op->operator) {
+        case EVENT_FILTER_EQ:
+            return event_filter_equal(filter, op->field, string, len, value);
+        case EVENT_FILTER_NE:
+            return !event_filter_equal(filter, op->field, string, len, value);
+        case EVENT_FILTER_CONTAINS:
+            if (op->field == EVENT_FILTER_TEXT) {
+                return (memmem(string, len, filter->pool + value->string, value->len) != NULL);
+            }
+            return (strcasestr(string, filter->pool + value->string) != NULL);
+        default:
+            for (i = 0; i < op->value_count; i++) {
+                if (event_filter_equal(filter, op->field, string, len, &value[i]) == true) {
+                    return true;
+                }
+            }
+            return false;
+    }
+}
+
+/* check if an event matches the filter, the results are kept as a stack of bits */
+bool event_filter_match(const struct s_event_filter *filter, const struct s_mcip_event *event)
+{
+    uint32_t stack = 0;
+    uint32_t top;
+    int i;
+
+    if (filter->op_count == 0) {
+        return true;
+    }
+
+    for (i = 0; i < filter->op_count; i++) {
+        switch (filter->ops[i].code) {
+            case EVENT_FILTER_CMP: {
+                stack = (stack << 1) | (event_filter_compare(filter, &filter->ops[i], event) ? 1 : 0);
+                break;
+            }
+
+            case EVENT_FILTER_AND: {
+                top = stack & 1;
+                stack >>= 1;
+                stack = (stack & ~1u) | (stack & top);
+                break;
+            }
+
+            case EVENT_FILTER_OR: {
+                top = stack & 1;
+                stack >>= 1;
+                stack |= top;
+                break;
+            }
+
+            case EVENT_FILTER_NOT: {
+                stack ^= 1;
+                break;
+            }
+        }
+    }
+
+    return (stack & 1);
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include "mcip_event.h"
+
+#define EVENT_FILTER_OPS        32      /* maximum number of operations of a compiled filter */
+#define EVENT_FILTER_VALUES     32      /* maximum number of values of all comparisons */
+#define EVENT_FILTER_POOL       512     /* space for the strings of the values */
+
+/* filter of the received events, compiled once from an expression like
+        input in {2.1,2.3} and state == LOW
+        type == pulse and (pulses >= 10 or input == 2.4)
+        not text contains "test"
+    an expression is made of comparisons combined with "and", "or", "not" and parentheses
+    a comparison is <field> <operator> <value> with the fields
+        type        input, pulse or other
+        oid         OID the telegram has been sent to
+        input       input of an input or pulse event (e.g. 2.1)
+        state       state of an input change event (e.g. LOW)
+        pulses      number of pulses of a pulse event
+        text        text of the telegram
+    and the operators
+        == !=               all fields (type, input and state are compared case insensitive)
+        < <= > >=           oid and pulses
+        in {a,b,...}        all fields, true if the field equals one of the values
+        contains            input, state and text
+    values containing spaces or operators are quoted with ""
+    a comparison of a field the event does not have (e.g. pulses of an input change event) is false
+    the expression is compiled into a table of operations in postfix order, evaluating it needs neither memory nor
+    parsing */
+
+enum event_filter_code {
+    EVENT_FILTER_CMP,                   /* compare a field, push the result */
+    EVENT_FILTER_AND,                   /* pop two results, push both */
+    EVENT_FILTER_OR,                    /* pop two results, push any */
+    EVENT_FILTER_NOT                    /* invert the top result */
+};
+
+enum event_filter_field {
+    EVENT_FILTER_TYPE,
+    EVENT_FILTER_OID,
+    EVENT_FILTER_INPUT,
+    EVENT_FILTER_STATE,
+    EVENT_FILTER_PULSES,
+    EVENT_FILTER_TEXT
+};
+
+enum event_filter_operator {
+    EVENT_FILTER_EQ,
+    EVENT_FILTER_NE,
+    EVENT_FILTER_LT,
+    EVENT_FILTER_LE,
+    EVENT_FILTER_GT,
+    EVENT_FILTER_GE,
+    EVENT_FILTER_IN,
+    EVENT_FILTER_CONTAINS
+};
+
+/* value of a comparison */
+struct s_event_filter_value {
+    long number;                        /* value of numeric fields and of type */
+    uint16_t string;                    /* offset of the string in the pool */
+    uint16_t len;                       /* length of the string */
+};
+
+/* one operation of a compiled filter */
+struct s_event_filter_op {
+    uint8_t code;                       /* enum event_filter_code */
+    uint8_t field;                      /* enum event_filter_field */
+    uint8_t operator;                   /* enum event_filter_operator */
+    uint8_t value;                      /* first value of the comparison */
+    uint8_t value_count;                /* number of values, more than one for "in" */
+};
+
+struct s_event_filter {
+    struct s_event_filter_op ops[EVENT_FILTER_OPS];
+    int op_count;                       /* every event matches if there are no operations */
+    struct s_event_filter_value values[EVENT_FILTER_VALUES];
+    int value_count;
+    char pool[EVENT_FILTER_POOL];
+    int pool_len;
+    int error;                          /* offset in the expression where compiling failed */
+};
+
+/* compile an expression
+    on error, false is returned and errno set appropriately (EINVAL for an invalid expression, E2BIG if it is too
+    long), the offset of the error in the expression is in error */
+bool event_filter_compile(struct s_event_filter *filter, const char *expression);
+
+/* check if an event matches the filter */
+bool event_filter_match(const struct s_event_filter *filter, const struct s_mcip_event *event);
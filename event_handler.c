@@ -0,0 +1,466 @@
+#define _GNU_SOURCE
+
+#include "event_handler.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+void safefree(void **pp);
+
+static bool event_handler_spawn(struct s_event_handler *handler);
+
+/* initialise a handler */
+bool event_handler_init(struct s_event_handler *handler, char *command, const char *format)
+{
+    memset(handler, 0, sizeof(struct s_event_handler));
+    handler->command = command;
+    handler->pid = -1;
+    handler->in = -1;
+    handler->out = -1;
+    handler->timer = -1;
+    handler->pause = EVENT_HANDLER_RESTART;
+
+    if (event_sink_init(&handler->format, -1, format, NULL) == false) {
+        return false;
+    }
+    /* every line is an event */
+    handler->format.header = true;
+
+    handler->buffer = malloc(EVENT_SINK_BUFFER);
+    if (handler->buffer == NULL) {
+        event_sink_free(&handler->format);
+        errno = ENOMEM;
+        return false;
+    }
+    handler->size = EVENT_SINK_BUFFER;
+
+    /* a handler that has gone must not kill us when we write to it */
+    signal(SIGPIPE, SIG_IGN);
+
+    return true;
+}
+
+/* acknowledge the oldest event */
+static void event_handler_ack(struct s_event_handler *handler)
+{
+    uint32_t len;
+
+    /* ignore lines for events that have not been written */
+    if (handler->frame_count == 0) {
+        return;
+    }
+    len = handler->frames[handler->frame_head];
+    if (handler->start + len > handler->sent) {
+        return;
+    }
+
+    handler->start += len;
+    handler->frame_head = (handler->frame_head + 1) % EVENT_HANDLER_FRAMES;
+    handler->frame_count--;
+    if (handler->frame_count == 0) {
+        handler->start = 0;
+        handler->sent = 0;
+        handler->len = 0;
+    }
+
+    /* the handler works, the next crash is restarted right away */
+    handler->pause = EVENT_HANDLER_RESTART;
+    return;
+}
+
+/* read the acknowledgements of the handler, returns false if its stdout has been closed */
+static bool event_handler_acks(struct s_event_handler *handler)
+{
+    char acks[4096];
+    ssize_t x, i;
+
+    x = read(handler->out, acks, sizeof(acks));
+    if (x == -1 && (errno == EAGAIN || errno == EINTR)) {
+        return true;
+    }
+    if (x <= 0) {
+        return false;
+    }
+    for (i = 0; i < x; i++) {
+        if (acks[i] == '\n') {
+            event_handler_ack(handler);
+        }
+    }
+
+    return true;
+}
+
+/* write the events not written yet, returns false if the stdin of the handler has been closed */
+static bool event_handler_write(struct s_event_handler *handler)
+{
+    ssize_t x;
+
+    while (handler->sent < handler->len) {
+        x = write(handler->in, handler->buffer + handler->sent, handler->len - handler->sent);
+        if (x == -1 && errno == EINTR) {
+            continue;
+        }
+        if (x == -1 && errno == EAGAIN) {
+            /* the handler is busy, write the rest when it reads again */
+            if (handler->writable == false && handler->loop != NULL) {
+                handler->writable = event_loop_modify(handler->loop, handler->in, EPOLLOUT);
+            }
+            return true;
+        }
+        if (x <= 0) {
+            return false;
+        }
+        handler->sent += x;
+    }
+
+    if (handler->writable == true) {
+        event_loop_modify(handler->loop, handler->in, 0);
+        handler->writable = false;
+    }
+
+    return true;
+}
+
+/* the handler has exited, tell why */
+static void event_handler_exited(struct s_event_handler *handler, int status)
+{
+    if (WIFSIGNALED(status)) {
+        printf("The event handler has been killed by signal %d\n", WTERMSIG(status));
+    }
+    else if (WIFEXITED(status) && WEXITSTATUS(status) != 0) {
+        printf("The event handler has exited with %d\n", WEXITSTATUS(status));
+    }
+    handler->pid = -1;
+    return;
+}
+
+/* reap the handler without waiting for it, returns false if it is still running */
+static bool event_handler_collect(struct s_event_handler *handler)
+{
+    int status = 0;
+    pid_t pid;
+
+    pid = waitpid(handler->pid, &status, WNOHANG);
+    if (pid == 0 || (pid == -1 && errno == EINTR)) {
+        return false;
+    }
+    if (pid == -1) {
+        /* it has been reaped elsewhere */
+        handler->pid = -1;
+        return true;
+    }
+    event_handler_exited(handler, status);
+    return true;
+}
+
+/* wait for the handler to exit, it is killed if it does not exit within EVENT_HANDLER_STOP ms
+    this blocks, it is only used when the handler is freed */
+static void event_handler_reap(struct s_event_handler *handler)
+{
+    int status = 0;
+    int waited;
+
+    for (waited = 0; waitpid(handler->pid, &status, WNOHANG) == 0; waited += 10) {
+        if (waited >= EVENT_HANDLER_STOP) {
+            kill(handler->pid, SIGKILL);
+            waitpid(handler->pid, &status, 0);
+            break;
+        }
+        usleep(10000);
+    }
+    event_handler_exited(handler, status);
+    return;
+}
+
+/* stop watching the pipes of the handler and close them */
+static void event_handler_close(struct s_event_handler *handler)
+{
+    if (handler->in != -1) {
+        event_loop_remove(handler->loop, handler->in);
+        close(handler->in);
+        handler->in = -1;
+    }
+    if (handler->out != -1) {
+        event_loop_remove(handler->loop, handler->out);
+        close(handler->out);
+        handler->out = -1;
+    }
+    handler->writable = false;
+    return;
+}
+
+/* the handler has gone, start it again after a pause
+    this runs on the loop, so it does not wait for the handler: one that still runs is killed and reaped by the timer */
+static void event_handler_restart(struct s_event_handler *handler)
+{
+    event_handler_close(handler);
+    if (handler->pid != -1 && event_handler_collect(handler) == false) {
+        kill(handler->pid, SIGKILL);
+    }
+    handler->restarts++;
+
+    printf("Restarting the event handler in %d ms, %d events are buffered\n", handler->pause, handler->frame_count);
+    if (handler->timer == -1 || event_loop_timer_set(handler->loop, handler->timer, handler->pause, 0) == false) {
+        printf("Failed to restart the event handler (%d): %s\n", errno, strerror(errno));
+        event_loop_stop(handler->loop);
+    }
+    handler->pause = (handler->pause * 2 > EVENT_HANDLER_RESTART_MAX) ? EVENT_HANDLER_RESTART_MAX : handler->pause * 2;
+
+    return;
+}
+
+/* the stdout of the handler has acknowledgements */
+static void event_handler_readable(struct s_event_loop *loop, int fd, uint32_t events, void *ctx)
+{
+    struct s_event_handler *handler = ctx;
+
+    if (event_handler_acks(handler) == false) {
+        event_handler_restart(handler);
+    }
+    return;
+}
+
+/* the stdin of the handler takes more events or has been closed */
+static void event_handler_writable(struct s_event_loop *loop, int fd, uint32_t events, void *ctx)
+{
+    struct s_event_handler *handler = ctx;
+
+    if ((events & EPOLLERR) || event_handler_write(handler) == false) {
+        event_handler_restart(handler);
+    }
+    return;
+}
+
+/* the pause before a restart has passed */
+static void event_handler_timer(struct s_event_loop *loop, int fd, uint32_t expirations, void *ctx)
+{
+    struct s_event_handler *handler = ctx;
+
+    /* the handler before has been killed, it is started again once it has been reaped */
+    if (handler->pid != -1 && event_handler_collect(handler) == false) {
+        if (event_loop_timer_set(handler->loop, handler->timer, EVENT_HANDLER_RESTART, 0) == false) {
+            printf("Failed to restart the event handler (%d): %s\n", errno, strerror(errno));
+            event_loop_stop(handler->loop);
+        }
+        return;
+    }
+
+    if (event_handler_spawn(handler) == false) {
+        printf("Failed to start the event handler (%d): %s\n", errno, strerror(errno));
+        event_handler_restart(handler);
+    }
+    return;
+}
+
+/* start the command with pipes as stdin and stdout and write the events not acknowledged yet */
+static bool event_handler_spawn(struct s_event_handler *handler)
+{
+    int in[2], out[2];
+    sigset_t set;
+    pid_t pid;
+
+    if (pipe2(in, O_CLOEXEC) == -1) {
+        return false;
+    }
+    if (pipe2(out, O_CLOEXEC) == -1) {
+        close(in[0]);
+        close(in[1]);
+        return false;
+    }
+
+    fflush(stdout);
+    pid = fork();
+    if (pid == -1) {
+        close(in[0]);
+        close(in[1]);
+        close(out[0]);
+        close(out[1]);
+        return false;
+    }
+
+    if (pid == 0) {
+        /* the signals read by the loop are blocked and SIGPIPE is ignored, the handler must get them as usual */
+        sigemptyset(&set);
+        sigprocmask(SIG_SETMASK, &set, NULL);
+        signal(SIGPIPE, SIG_DFL);
+        if (dup2(in[0], STDIN_FILENO) == -1 || dup2(out[1], STDOUT_FILENO) == -1) {
+            _exit(127);
+        }
+        execl("/bin/sh", "sh", "-c", handler->command, (char *) NULL);
+        _exit(127);
+    }
+
+    close(in[0]);
+    close(out[1]);
+    handler->pid = pid;
+    handler->in = in[1];
+    handler->out = out[0];
+    fcntl(handler->in, F_SETFL, O_NONBLOCK);
+    fcntl(handler->out, F_SETFL, O_NONBLOCK);
+
+    /* stdin is only watched for EPOLLOUT while events are waiting, EPOLLERR tells that the handler has gone */
+    if (event_loop_add(handler->loop, handler->out, EPOLLIN, event_handler_readable, handler) == false ||
+        event_loop_add(handler->loop, handler->in, 0, event_handler_writable, handler) == false) {
+        /* it is reaped by the restart or when the handler is freed */
+        event_handler_close(handler);
+        kill(handler->pid, SIGKILL);
+        return false;
+    }
+
+    /* the events that have not been acknowledged are processed again */
+    handler->sent = handler->start;
+    if (event_handler_write(handler) == false) {
+        event_handler_restart(handler);
+    }
+
+    return true;
+}
+
+/* start the handler */
+bool event_handler_start(struct s_event_handler *handler, struct s_event_loop *loop)
+{
+    handler->loop = loop;
+    handler->timer = event_loop_timer(loop, 0, 0, event_handler_timer, handler);
+    if (handler->timer == -1) {
+        return false;
+    }
+
+    return event_handler_spawn(handler);
+}
+
+/* pass an event to the handler */
+bool event_handler_send(struct s_event_handler *handler, const struct s_mcip_event *event)
+{
+    size_t len, size;
+    char *buffer;
+
+    if (event_sink_render(&handler->format, event) == false) {
+        return false;
+    }
+    len = handler->format.len;
+
+    if (handler->frame_count == EVENT_HANDLER_FRAMES || handler->len - handler->start + len > EVENT_HANDLER_BUFFER) {
+        handler->dropped++;
+        errno = ENOBUFS;
+        return false;
+    }
+
+    /* make room: move the events not acknowledged to the front, then grow the buffer */
+    if (handler->len + len > handler->size) {
+        memmove(handler->buffer, handler->buffer + handler->start, handler->len - handler->start);
+        handler->sent -= handler->start;
+        handler->len -= handler->start;
+        handler->start = 0;
+    }
+    if (handler->len + len > handler->size) {
+        for (size = handler->size; size < handler->len + len; size *= 2);
+        buffer = realloc(handler->buffer, size);
+        if (buffer == NULL) {
+            handler->dropped++;
+            errno = ENOMEM;
+            return false;
+        }
+        handler->buffer = buffer;
+        handler->size = size;
+    }
+
+    memcpy(handler->buffer + handler->len, handler->format.buffer, len);
+    handler->len += len;
+    handler->frames[(handler->frame_head + handler->frame_count) % EVENT_HANDLER_FRAMES] = len;
+    handler->frame_count++;
+
+    /* while the handler restarts, the events are only buffered */
+    if (handler->in != -1 && handler->writable == false && event_handler_write(handler) == false) {
+        event_handler_restart(handler);
+    }
+
+    return true;
+}
+
+/* write the rest, close stdin and read the acknowledgements until the handler closes its stdout */
+static void event_handler_drain(struct s_event_handler *handler)
+{
+    struct pollfd fds[2];
+    struct timespec start, now;
+    int elapsed = 0;
+
+    event_loop_remove(handler->loop, handler->in);
+    event_loop_remove(handler->loop, handler->out);
+    handler->writable = false;
+    handler->loop = NULL;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    while (handler->out != -1 && elapsed < EVENT_HANDLER_STOP) {
+        /* the end of its stdin tells the handler to exit */
+        if (handler->in != -1 && handler->sent == handler->len) {
+            close(handler->in);
+            handler->in = -1;
+        }
+
+        fds[0].fd = handler->in;
+        fds[0].events = POLLOUT;
+        fds[1].fd = handler->out;
+        fds[1].events = POLLIN;
+        if (poll(fds, 2, EVENT_HANDLER_STOP - elapsed) == -1 && errno != EINTR) {
+            break;
+        }
+        if (fds[0].revents & (POLLERR | POLLHUP)) {
+            handler->sent = handler->len;
+        }
+        else if ((fds[0].revents & POLLOUT) && event_handler_write(handler) == false) {
+            handler->sent = handler->len;
+        }
+        if (fds[1].revents != 0 && event_handler_acks(handler) == false) {
+            close(handler->out);
+            handler->out = -1;
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        elapsed = (now.tv_sec - start.tv_sec) * 1000 + (now.tv_nsec - start.tv_nsec) / 1000000;
+    }
+
+    if (handler->in != -1) {
+        close(handler->in);
+        handler->in = -1;
+    }
+    if (handler->out != -1) {
+        close(handler->out);
+        handler->out = -1;
+    }
+
+    return;
+}
+
+/* stop the handler and free it */
+void event_handler_free(struct s_event_handler *handler)
+{
+    if (handler->timer != -1) {
+        event_loop_remove(handler->loop, handler->timer);
+        handler->timer = -1;
+    }
+    if (handler->pid != -1) {
+        event_handler_drain(handler);
+        event_handler_reap(handler);
+    }
+
+    if (handler->frame_count > 0) {
+        printf("%d events have not been acknowledged by the event handler\n", handler->frame_count);
+    }
+    if (handler->dropped > 0) {
+        printf("%lu events have been dropped, the event handler has been too slow\n", handler->dropped);
+    }
+
+    /* the last event is still in the buffer of the format, it must not be written */
+    handler->format.len = 0;
+    event_sink_free(&handler->format);
+    safefree((void **) &handler->buffer);
+    return;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#include "event_loop.h"
+#include "event_sink.h"
+#include "mcip_event.h"
+
+#define EVENT_HANDLER_BUFFER    (1 << 20)   /* events are dropped when this many bytes are not acknowledged */
+#define EVENT_HANDLER_FRAMES    4096        /* events are dropped when this many events are not acknowledged */
+#define EVENT_HANDLER_RESTART   100         /* first pause before the handler is restarted (ms), it doubles */
+#define EVENT_HANDLER_RESTART_MAX 30000     /* longest pause before the handler is restarted (ms) */
+#define EVENT_HANDLER_STOP      1000        /* time the handler gets to exit after its stdin has been closed (ms) */
+
+/* persistent handler of the events: the command is started once with /bin/sh -c and gets every event on its stdin
+    the events are framed in the output format: one line per event for raw, json and csv (without header), the length
+    (4 bytes, network byte order) followed by the telegram for binary
+    the handler acknowledges every event it has processed with one line on its stdout (the content does not matter)
+    the events are kept until they are acknowledged: if the handler exits or crashes, it is restarted with a growing
+    pause and gets the events again that have not been acknowledged; the events received meanwhile are buffered */
+struct s_event_handler {
+    char *command;
+    struct s_event_sink format;             /* formats the events */
+    struct s_event_loop *loop;
+    pid_t pid;                              /* -1 if the handler is not running */
+    int in;                                 /* stdin of the handler, -1 if it is not running */
+    int out;                                /* stdout of the handler */
+    bool writable;                          /* stdin is watched for EPOLLOUT */
+    int timer;                              /* restart of the handler, -1 if there is none */
+    int pause;                              /* pause before the next restart (ms) */
+    char *buffer;                           /* events not acknowledged yet, from start to len */
+    size_t start;
+    size_t sent;                            /* end of the events written to the handler */
+    size_t len;
+    size_t size;
+    uint32_t frames[EVENT_HANDLER_FRAMES];  /* lengths of the events not acknowledged yet (ring) */
+    int frame_head;
+    int frame_count;
+    unsigned long dropped;                  /* events dropped because the handler has been too slow */
+    unsigned long restarts;
+};
+
+/* initialise a handler, format is the output format given on the command line (NULL for raw)
+    on error, false is returned and errno set appropriately (EINVAL for an unknown format) */
+bool event_handler_init(struct s_event_handler *handler, char *command, const char *format);
+
+/* start the handler, it is watched on the loop
+    on error, false is returned and errno set appropriately */
+bool event_handler_start(struct s_event_handler *handler, struct s_event_loop *loop);
+
+/* pass an event to the handler, it is buffered if the handler cannot take it now
+    on error (the event has been dropped), false is returned and errno set appropriately */
+bool event_handler_send(struct s_event_handler *handler, const struct s_mcip_event *event);
+
+/* write the buffered events, close the stdin of the handler and wait for it to exit, it is killed if it does not
+    exit within EVENT_HANDLER_STOP ms; this must be called before the loop is freed */
+void event_handler_free(struct s_event_handler *handler);
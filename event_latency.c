@@ -0,0 +1,51 @@
+#include "event_latency.h"
+
+/* record the time between two points, stamps of 0 are unknown */
+static void latency_record(struct s_histogram *histogram, int64_t from, int64_t to)
+{
+    if (from == 0 || to == 0) {
+        return;
+    }
+    histogram_record(histogram, (to > from) ? to - from : 0);
+    return;
+}
+
+/* record an event */
+void event_latency_record(struct s_event_latency *latency, const struct s_mcip_stamps *stamps, int64_t filtered, int64_t written)
+{
+    latency_record(&latency->read, stamps->readable, stamps->complete);
+    latency_record(&latency->filter, stamps->complete, filtered);
+    if (written == 0) {
+        latency->filtered++;
+        return;
+    }
+    latency_record(&latency->write, filtered, written);
+    latency_record(&latency->total, stamps->readable, written);
+    return;
+}
+
+/* print one stage */
+static void latency_print_histogram(FILE *out, const char *name, const struct s_histogram *histogram)
+{
+    fprintf(out, "%-16s %8llu %10llu %10llu %10llu %10llu\n", name,
+            (unsigned long long) histogram->count,
+            (unsigned long long) histogram_percentile(histogram, 50),
+            (unsigned long long) histogram_percentile(histogram, 90),
+            (unsigned long long) histogram_percentile(histogram, 99),
+            (unsigned long long) histogram->max);
+    return;
+}
+
+/* print count, p50, p90, p99 and max of every stage */
+void event_latency_print(const struct s_event_latency *latency, FILE *out)
+{
+    fprintf(out, "%-16s %8s %10s %10s %10s %10s\n", "latency [ns]", "count", "p50", "p90", "p99", "max");
+    latency_print_histogram(out, "read", &latency->read);
+    latency_print_histogram(out, "filter", &latency->filter);
+    latency_print_histogram(out, "write", &latency->write);
+    latency_print_histogram(out, "total", &latency->total);
+    fprintf(out, "filtered: %llu\n", (unsigned long long) latency->filtered);
+    fflush(out);
+
+    return;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "histogram.h"
+#include "mcip_event.h"
+
+/* latency of the received events, broken down into the stages of the listener, all times are taken from
+    CLOCK_MONOTONIC in ns:
+        read        the socket has been reported readable -> the read that completed the telegram has returned
+        filter      the read has returned -> the event has been decoded and passed the filters
+        write       the event has passed the filters -> it has been written (to the buffer of the output if the
+                    output is not flushed after every event, or to the event handler)
+        total       the socket has been reported readable -> the event has been written
+    a telegram that is only completed by a later read is measured from the readable socket of that read, the time it
+    has spent in the firmware before is not known */
+struct s_event_latency {
+    struct s_histogram read;
+    struct s_histogram filter;
+    struct s_histogram write;
+    struct s_histogram total;
+    uint64_t filtered;                  /* events dropped by the type or the filter */
+};
+
+/* record an event, filtered and written are the times it has passed the filters and has been written
+    written is 0 if the event has been dropped by the filters */
+void event_latency_record(struct s_event_latency *latency, const struct s_mcip_stamps *stamps, int64_t filtered, int64_t written);
+
+/* print count, p50, p90, p99 and max of every stage */
+void event_latency_print(const struct s_event_latency *latency, FILE *out);
@@ -0,0 +1,330 @@
+#include "event_loop.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+
+#define EVENT_LOOP_EVENTS   16      /* events fetched by one epoll_wait */
+
+enum event_source_type {
+    EVENT_SOURCE_FD,                /* file descriptor of the caller */
+    EVENT_SOURCE_TIMER,             /* timerfd owned by the loop */
+    EVENT_SOURCE_SIGNAL             /* signalfd owned by the loop */
+};
+
+struct s_event_source {
+    int fd;
+    enum event_source_type type;
+    event_loop_callback callback;
+    void *ctx;
+    sigset_t signals;               /* signals blocked for a signal source */
+    bool removed;                   /* removed within a callback, it is freed after the events of the round */
+    struct s_event_source *next;
+};
+
+struct s_event_loop {
+    int epoll_fd;
+    bool running;
+    bool dispatching;               /* the events of a round are dispatched, removed sources must be kept */
+    struct s_event_source *sources;
+};
+
+void safefree(void **pp);
+
+/* create an event loop */
+struct s_event_loop *event_loop_create(void)
+{
+    struct s_event_loop *loop;
+
+    loop = calloc(1, sizeof(struct s_event_loop));
+    if (loop == NULL) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    loop->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (loop->epoll_fd == -1) {
+        safefree((void **) &loop);
+        return NULL;
+    }
+
+    return loop;
+}
+
+/* find the source of a file descriptor */
+static struct s_event_source *event_loop_find(struct s_event_loop *loop, int fd)
+{
+    struct s_event_source *source;
+
+    for (source = loop->sources; source != NULL; source = source->next) {
+        if (source->fd == fd && source->removed == false) {
+            return source;
+        }
+    }
+    return NULL;
+}
+
+/* add a source of any type */
+static struct s_event_source *event_loop_source(struct s_event_loop *loop, int fd, enum event_source_type type, uint32_t events,
+                                                event_loop_callback callback, void *ctx)
+{
+    struct s_event_source *source;
+    struct epoll_event event;
+
+    source = calloc(1, sizeof(struct s_event_source));
+    if (source == NULL) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    source->fd = fd;
+    source->type = type;
+    source->callback = callback;
+    source->ctx = ctx;
+    sigemptyset(&source->signals);
+
+    memset(&event, 0, sizeof(event));
+    event.events = events;
+    event.data.ptr = source;
+    if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0) {
+        safefree((void **) &source);
+        return NULL;
+    }
+
+    source->next = loop->sources;
+    loop->sources = source;
+
+    return source;
+}
+
+/* watch a file descriptor */
+bool event_loop_add(struct s_event_loop *loop, int fd, uint32_t events, event_loop_callback callback, void *ctx)
+{
+    return (event_loop_source(loop, fd, EVENT_SOURCE_FD, events, callback, ctx) != NULL);
+}
+
+/* change the events a file descriptor is watched for */
+bool event_loop_modify(struct s_event_loop *loop, int fd, uint32_t events)
+{
+    struct s_event_source *source;
+    struct epoll_event event;
+
+    source = event_loop_find(loop, fd);
+    if (source == NULL) {
+        errno = ENOENT;
+        return false;
+    }
+
+    memset(&event, 0, sizeof(event));
+    event.events = events;
+    event.data.ptr = source;
+
+    return (epoll_ctl(loop->epoll_fd, EPOLL_CTL_MOD, fd, &event) == 0);
+}
+
+/* free the sources that have been removed */
+static void event_loop_collect(struct s_event_loop *loop)
+{
+    struct s_event_source **pp, *source;
+
+    for (pp = &loop->sources; *pp != NULL; ) {
+        source = *pp;
+        if (source->removed == true) {
+            *pp = source->next;
+            safefree((void **) &source);
+        }
+        else {
+            pp = &source->next;
+        }
+    }
+    return;
+}
+
+/* release what a source holds */
+static void event_loop_release(struct s_event_loop *loop, struct s_event_source *source)
+{
+    epoll_ctl(loop->epoll_fd, EPOLL_CTL_DEL, source->fd, NULL);
+    if (source->type != EVENT_SOURCE_FD) {
+        close(source->fd);
+    }
+    if (source->type == EVENT_SOURCE_SIGNAL) {
+        sigprocmask(SIG_UNBLOCK, &source->signals, NULL);
+    }
+    source->removed = true;
+    return;
+}
+
+/* stop watching a file descriptor */
+void event_loop_remove(struct s_event_loop *loop, int fd)
+{
+    struct s_event_source *source;
+
+    source = event_loop_find(loop, fd);
+    if (source == NULL) {
+        return;
+    }
+    event_loop_release(loop, source);
+
+    if (loop->dispatching == false) {
+        event_loop_collect(loop);
+    }
+    return;
+}
+
+/* rearm a timer */
+bool event_loop_timer_set(struct s_event_loop *loop, int fd, int initial_ms, int interval_ms)
+{
+    struct itimerspec spec;
+
+    memset(&spec, 0, sizeof(spec));
+    spec.it_value.tv_sec = initial_ms / 1000;
+    spec.it_value.tv_nsec = (long) (initial_ms % 1000) * 1000000;
+    spec.it_interval.tv_sec = interval_ms / 1000;
+    spec.it_interval.tv_nsec = (long) (interval_ms % 1000) * 1000000;
+
+    return (timerfd_settime(fd, 0, &spec, NULL) == 0);
+}
+
+/* add a timer */
+int event_loop_timer(struct s_event_loop *loop, int initial_ms, int interval_ms, event_loop_callback callback, void *ctx)
+{
+    int fd;
+
+    fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (fd == -1) {
+        return -1;
+    }
+    if (event_loop_timer_set(loop, fd, initial_ms, interval_ms) == false ||
+        event_loop_source(loop, fd, EVENT_SOURCE_TIMER, EPOLLIN, callback, ctx) == NULL) {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+/* receive signals */
+int event_loop_signals(struct s_event_loop *loop, const int *signals, event_loop_callback callback, void *ctx)
+{
+    struct s_event_source *source;
+    sigset_t set;
+    int fd, i;
+
+    sigemptyset(&set);
+    for (i = 0; signals[i] != 0; i++) {
+        sigaddset(&set, signals[i]);
+    }
+
+    /* the signals have to be blocked, otherwise they are handled before they can be read */
+    if (sigprocmask(SIG_BLOCK, &set, NULL) != 0) {
+        return -1;
+    }
+    fd = signalfd(-1, &set, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (fd == -1) {
+        sigprocmask(SIG_UNBLOCK, &set, NULL);
+        return -1;
+    }
+    source = event_loop_source(loop, fd, EVENT_SOURCE_SIGNAL, EPOLLIN, callback, ctx);
+    if (source == NULL) {
+        close(fd);
+        sigprocmask(SIG_UNBLOCK, &set, NULL);
+        return -1;
+    }
+    source->signals = set;
+
+    return fd;
+}
+
+/* call the callback of a source */
+static void event_loop_dispatch(struct s_event_loop *loop, struct s_event_source *source, uint32_t events)
+{
+    struct signalfd_siginfo info;
+    uint64_t expirations;
+
+    switch (source->type) {
+        case EVENT_SOURCE_FD: {
+            source->callback(loop, source->fd, events, source->ctx);
+            break;
+        }
+
+        case EVENT_SOURCE_TIMER: {
+            if (read(source->fd, &expirations, sizeof(expirations)) == sizeof(expirations)) {
+                source->callback(loop, source->fd, (uint32_t) expirations, source->ctx);
+            }
+            break;
+        }
+
+        case EVENT_SOURCE_SIGNAL: {
+            while (source->removed == false && read(source->fd, &info, sizeof(info)) == sizeof(info)) {
+                source->callback(loop, source->fd, info.ssi_signo, source->ctx);
+            }
+            break;
+        }
+    }
+    return;
+}
+
+/* wait for events and call the callbacks until event_loop_stop is called */
+bool event_loop_run(struct s_event_loop *loop)
+{
+    struct epoll_event events[EVENT_LOOP_EVENTS];
+    struct s_event_source *source;
+    int n, i;
+
+    loop->running = true;
+    while (loop->running == true) {
+        n = epoll_wait(loop->epoll_fd, events, EVENT_LOOP_EVENTS, -1);
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            loop->running = false;
+            return false;
+        }
+
+        loop->dispatching = true;
+        for (i = 0; i < n && loop->running == true; i++) {
+            source = events[i].data.ptr;
+            /* a callback before may have removed it */
+            if (source->removed == false) {
+                event_loop_dispatch(loop, source, events[i].events);
+            }
+        }
+        loop->dispatching = false;
+        event_loop_collect(loop);
+    }
+
+    return true;
+}
+
+/* let event_loop_run return after the current callback */
+void event_loop_stop(struct s_event_loop *loop)
+{
+    loop->running = false;
+    return;
+}
+
+/* close the timers and signal sources and free the loop */
+void event_loop_free(struct s_event_loop **loop)
+{
+    struct s_event_source *source;
+
+    if (loop == NULL || *loop == NULL) {
+        return;
+    }
+
+    for (source = (*loop)->sources; source != NULL; source = source->next) {
+        if (source->removed == false) {
+            event_loop_release(*loop, source);
+        }
+    }
+    (*loop)->dispatching = false;
+    event_loop_collect(*loop);
+    close((*loop)->epoll_fd);
+    safefree((void **) loop);
+
+    return;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/epoll.h>
+
+struct s_event_loop;
+
+/* called when a source of the loop has work:
+    file descriptors    events are the epoll events (EPOLLIN, ...)
+    timers              events is the number of expirations since the last call
+    signals             events is the number of the signal, once for every signal received
+    sources may be added and removed within the callback */
+typedef void (*event_loop_callback)(struct s_event_loop *loop, int fd, uint32_t events, void *ctx);
+
+/* create an event loop
+    on error, NULL is returned and errno set appropriately */
+struct s_event_loop *event_loop_create(void);
+
+/* watch a file descriptor for the given epoll events, the file descriptor stays owned by the caller
+    on error, false is returned and errno set appropriately */
+bool event_loop_add(struct s_event_loop *loop, int fd, uint32_t events, event_loop_callback callback, void *ctx);
+
+/* change the events a file descriptor is watched for */
+bool event_loop_modify(struct s_event_loop *loop, int fd, uint32_t events);
+
+/* stop watching a file descriptor (timers and signal sources are closed) */
+void event_loop_remove(struct s_event_loop *loop, int fd);
+
+/* add a timer (timerfd, CLOCK_MONOTONIC) that expires after initial_ms and then every interval_ms (0 for once)
+    returns the file descriptor of the timer, it is owned by the loop, -1 on error */
+int event_loop_timer(struct s_event_loop *loop, int initial_ms, int interval_ms, event_loop_callback callback, void *ctx);
+
+/* rearm a timer, initial_ms 0 disarms it */
+bool event_loop_timer_set(struct s_event_loop *loop, int fd, int initial_ms, int interval_ms);
+
+/* receive signals (signalfd) instead of handling them asynchronously, the signals are blocked
+    signals is a list terminated by 0, returns the file descriptor owned by the loop, -1 on error */
+int event_loop_signals(struct s_event_loop *loop, const int *signals, event_loop_callback callback, void *ctx);
+
+/* wait for events and call the callbacks until event_loop_stop is called
+    on error, false is returned and errno set appropriately */
+bool event_loop_run(struct s_event_loop *loop);
+
+/* let event_loop_run return after the current callback */
+void event_loop_stop(struct s_event_loop *loop);
+
+/* close the timers and signal sources and free the loop */
+void event_loop_free(struct s_event_loop **loop);
@@ -0,0 +1,370 @@
+#include "event_sink.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+
+void safefree(void **pp);
+
+/* initialise a sink writing to fd */
+bool event_sink_init(struct s_event_sink *sink, int fd, const char *format, const char *flush)
+{
+    char *end;
+    long value;
+
+    memset(sink, 0, sizeof(struct s_event_sink));
+    sink->fd = fd;
+    sink->timer = -1;
+    sink->flush_events = 1;
+
+    if (format == NULL || strcmp(format, "raw") == 0) {
+        sink->format = EVENT_SINK_RAW;
+    }
+    else if (strcmp(format, "json") == 0) {
+        sink->format = EVENT_SINK_JSON;
+    }
+    else if (strcmp(format, "csv") == 0) {
+        sink->format = EVENT_SINK_CSV;
+    }
+    else if (strcmp(format, "binary") == 0) {
+        sink->format = EVENT_SINK_BINARY;
+    }
+    else {
+        errno = EINVAL;
+        return false;
+    }
+
+    if (flush != NULL && strcmp(flush, "event") != 0) {
+        value = strtol(flush, &end, 10);
+        if (end == flush || value < 1 || value > 3600000) {
+            errno = EINVAL;
+            return false;
+        }
+        if (strcmp(end, "ms") == 0) {
+            sink->flush_events = 0;
+            sink->flush_ms = (int) value;
+        }
+        else if (*end == '\0') {
+            sink->flush_events = (int) value;
+        }
+        else {
+            errno = EINVAL;
+            return false;
+        }
+    }
+
+    sink->buffer = malloc(EVENT_SINK_BUFFER);
+    if (sink->buffer == NULL) {
+        errno = ENOMEM;
+        return false;
+    }
+    sink->size = EVENT_SINK_BUFFER;
+
+    return true;
+}
+
+/* write the buffered events */
+bool event_sink_flush(struct s_event_sink *sink)
+{
+    size_t written = 0;
+    ssize_t x;
+
+    while (written < sink->len) {
+        x = write(sink->fd, sink->buffer + written, sink->len - written);
+        if (x == -1 && errno == EINTR) {
+            continue;
+        }
+        if (x <= 0) {
+            /* the events are dropped, a consumer that has gone away would fill the buffer forever */
+            sink->len = 0;
+            sink->pending = 0;
+            return false;
+        }
+        written += x;
+    }
+    sink->len = 0;
+    sink->pending = 0;
+
+    return true;
+}
+
+/* the flush timer has expired */
+static void event_sink_timer(struct s_event_loop *loop, int fd, uint32_t expirations, void *ctx)
+{
+    struct s_event_sink *sink = ctx;
+
+    if (sink->len > 0) {
+        event_sink_flush(sink);
+    }
+    return;
+}
+
+/* start the flush timer of the policy on the loop */
+bool event_sink_attach(struct s_event_sink *sink, struct s_event_loop *loop)
+{
+    if (sink->flush_ms == 0) {
+        return true;
+    }
+
+    sink->loop = loop;
+    sink->timer = event_loop_timer(loop, sink->flush_ms, sink->flush_ms, event_sink_timer, sink);
+
+    return (sink->timer != -1);
+}
+
+/* make room for len more bytes: flush or grow the buffer */
+static bool event_sink_reserve(struct s_event_sink *sink, size_t len)
+{
+    size_t size;
+    char *buffer;
+
+    if (sink->len + len <= sink->size) {
+        return true;
+    }
+    if (sink->len > 0 && event_sink_flush(sink) == false) {
+        return false;
+    }
+    if (len <= sink->size) {
+        return true;
+    }
+
+    for (size = sink->size; size < len; size *= 2);
+    buffer = realloc(sink->buffer, size);
+    if (buffer == NULL) {
+        errno = ENOMEM;
+        return false;
+    }
+    sink->buffer = buffer;
+    sink->size = size;
+
+    return true;
+}
+
+/* append bytes to the buffer, the buffer has been reserved */
+static void event_sink_append(struct s_event_sink *sink, const void *data, size_t len)
+{
+    memcpy(sink->buffer + sink->len, data, len);
+    sink->len += len;
+    return;
+}
+
+/* append a string escaped for JSON, every character may take 6 bytes */
+static void event_sink_append_json(struct s_event_sink *sink, const char *text, size_t len)
+{
+    static const char hex[] = "0123456789abcdef";
+    char *out = sink->buffer + sink->len;
+    unsigned char c;
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        c = (unsigned char) text[i];
+        if (c == '"' || c == '\\') {
+            *out++ = '\\';
+            *out++ = c;
+        }
+        else if (c < 0x20) {
+            *out++ = '\\';
+            *out++ = 'u';
+            *out++ = '0';
+            *out++ = '0';
+            *out++ = hex[c >> 4];
+            *out++ = hex[c & 0x0f];
+        }
+        else {
+            *out++ = c;
+        }
+    }
+    sink->len = out - sink->buffer;
+    return;
+}
+
+/* append a field quoted for CSV, every character may take 2 bytes */
+static void event_sink_append_csv(struct s_event_sink *sink, const char *text, size_t len)
+{
+    char *out = sink->buffer + sink->len;
+    size_t i;
+
+    *out++ = '"';
+    for (i = 0; i < len; i++) {
+        if (text[i] == '"') {
+            *out++ = '"';
+        }
+        *out++ = (text[i] == '\n' || text[i] == '\r') ? ' ' : text[i];
+    }
+    *out++ = '"';
+    sink->len = out - sink->buffer;
+    return;
+}
+
+/* format an event into the buffer */
+static bool event_sink_format(struct s_event_sink *sink, const struct s_mcip_event *event)
+{
+    static const char header[] = "type,oid,input,state,pulses,text\n";
+    static const char header_stamps[] = "time,monotonic,type,oid,input,state,pulses,text\n";
+    char fields[256];
+    char time[40];
+    uint32_t len;
+    int n;
+
+    switch (sink->format) {
+        case EVENT_SINK_RAW: {
+            if (sink->stamps == true) {
+                if (event_sink_reserve(sink, sizeof(time) + 1) == false) {
+                    return false;
+                }
+                mcip_event_time(time, sizeof(time), &event->stamps.realtime);
+                n = strlen(time);
+                time[n++] = ' ';
+                event_sink_append(sink, time, n);
+            }
+            if (sink->raw_telegram == true) {
+                if (event_sink_reserve(sink, event->len + 1) == false) {
+                    return false;
+                }
+                event_sink_append(sink, event->telegram, event->len);
+            }
+            else {
+                if (event_sink_reserve(sink, event->text_len + 1) == false) {
+                    return false;
+                }
+                event_sink_append(sink, event->text, event->text_len);
+            }
+            event_sink_append(sink, "\n", 1);
+            break;
+        }
+
+        case EVENT_SINK_JSON: {
+            n = 0;
+            if (sink->stamps == true) {
+                mcip_event_time(time, sizeof(time), &event->stamps.realtime);
+                n = snprintf(fields, sizeof(fields), "{\"time\":\"%s\",\"monotonic\":%lld,", time, (long long) event->stamps.complete);
+            }
+            else {
+                fields[n++] = '{';
+            }
+            n += snprintf(fields + n, sizeof(fields) - n, "\"type\":\"%s\",\"oid\":%u", mcip_event_type_string(event->type), event->oid);
+            if (event->input[0] != '\0') {
+                n += snprintf(fields + n, sizeof(fields) - n, ",\"input\":\"%s\"", event->input);
+            }
+            if (event->state[0] != '\0') {
+                n += snprintf(fields + n, sizeof(fields) - n, ",\"state\":\"");
+            }
+            if (event_sink_reserve(sink, n + 6 * sizeof(event->state) + 32 + 6 * event->text_len + 4) == false) {
+                return false;
+            }
+            event_sink_append(sink, fields, n);
+            if (event->state[0] != '\0') {
+                event_sink_append_json(sink, event->state, strlen(event->state));
+                event_sink_append(sink, "\"", 1);
+            }
+            if (event->pulses >= 0) {
+                n = snprintf(fields, sizeof(fields), ",\"pulses\":%ld", event->pulses);
+                event_sink_append(sink, fields, n);
+            }
+            event_sink_append(sink, ",\"text\":\"", 9);
+            event_sink_append_json(sink, event->text, event->text_len);
+            event_sink_append(sink, "\"}\n", 3);
+            break;
+        }
+
+        case EVENT_SINK_CSV: {
+            if (sink->header == false) {
+                if (event_sink_reserve(sink, sizeof(header_stamps)) == false) {
+                    return false;
+                }
+                if (sink->stamps == true) {
+                    event_sink_append(sink, header_stamps, sizeof(header_stamps) - 1);
+                }
+                else {
+                    event_sink_append(sink, header, sizeof(header) - 1);
+                }
+                sink->header = true;
+            }
+            n = 0;
+            if (sink->stamps == true) {
+                mcip_event_time(time, sizeof(time), &event->stamps.realtime);
+                n = snprintf(fields, sizeof(fields), "%s,%lld,", time, (long long) event->stamps.complete);
+            }
+            n += snprintf(fields + n, sizeof(fields) - n, "%s,%u,%s,", mcip_event_type_string(event->type), event->oid, event->input);
+            if (event_sink_reserve(sink, n + 2 * sizeof(event->state) + 32 + 2 * event->text_len + 4) == false) {
+                return false;
+            }
+            event_sink_append(sink, fields, n);
+            event_sink_append_csv(sink, event->state, strlen(event->state));
+            n = (event->pulses >= 0) ? snprintf(fields, sizeof(fields), ",%ld,", event->pulses) : snprintf(fields, sizeof(fields), ",,");
+            event_sink_append(sink, fields, n);
+            event_sink_append_csv(sink, event->text, event->text_len);
+            event_sink_append(sink, "\n", 1);
+            break;
+        }
+
+        case EVENT_SINK_BINARY: {
+            if (event_sink_reserve(sink, event->len + 4) == false) {
+                return false;
+            }
+            len = htonl((uint32_t) event->len);
+            event_sink_append(sink, &len, 4);
+            event_sink_append(sink, event->telegram, event->len);
+            break;
+        }
+    }
+
+    return true;
+}
+
+/* write an event */
+bool event_sink_write(struct s_event_sink *sink, const struct s_mcip_event *event)
+{
+    if (event_sink_format(sink, event) == false) {
+        return false;
+    }
+    sink->pending++;
+
+    if (sink->flush_events > 0 && sink->pending >= sink->flush_events) {
+        return event_sink_flush(sink);
+    }
+
+    return true;
+}
+
+/* format an event into the empty buffer without writing it */
+bool event_sink_render(struct s_event_sink *sink, const struct s_mcip_event *event)
+{
+    sink->len = 0;
+    sink->pending = 0;
+
+    return event_sink_format(sink, event);
+}
+
+/* write preformatted output */
+bool event_sink_write_text(struct s_event_sink *sink, const char *text, size_t len)
+{
+    if (event_sink_reserve(sink, len) == false) {
+        return false;
+    }
+    event_sink_append(sink, text, len);
+    sink->pending++;
+
+    if (sink->flush_events > 0 && sink->pending >= sink->flush_events) {
+        return event_sink_flush(sink);
+    }
+
+    return true;
+}
+
+/* flush, stop the timer and free the buffer */
+void event_sink_free(struct s_event_sink *sink)
+{
+    if (sink->len > 0) {
+        event_sink_flush(sink);
+    }
+    if (sink->timer != -1) {
+        event_loop_remove(sink->loop, sink->timer);
+        sink->timer = -1;
+    }
+    safefree((void **) &sink->buffer);
+    return;
+}
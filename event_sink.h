@@ -0,0 +1,70 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include "event_loop.h"
+#include "mcip_event.h"
+
+#define EVENT_SINK_BUFFER       65536   /* size of the output buffer, it grows for larger events */
+
+enum event_sink_format {
+    EVENT_SINK_RAW,                     /* the text of the telegram as received, one line per event */
+    EVENT_SINK_JSON,                    /* one JSON object per line with the decoded fields */
+    EVENT_SINK_CSV,                     /* a header line, then one line per event with the decoded fields */
+    EVENT_SINK_BINARY                   /* the whole telegram prefixed by its length (4 bytes, network byte order) */
+};
+
+/* buffered output of the received events: every event is formatted into the buffer and the buffer is written with
+    one write when the flush policy says so
+    the flush policy is one of
+        event       after every event (default)
+        <n>         after every <n> events
+        <n>ms       every <n> ms (needs an event loop, see event_sink_attach)
+    the buffer is also written when it is full and on event_sink_free */
+struct s_event_sink {
+    int fd;                             /* file descriptor the events are written to */
+    enum event_sink_format format;
+    bool raw_telegram;                  /* raw format: print the whole telegram including the header */
+    bool stamps;                        /* text formats: add the receive time (CLOCK_REALTIME, UTC) and the
+                                           CLOCK_MONOTONIC time (ns) of every event, the raw format only the first */
+    int flush_events;                   /* flush after this many events, 0 if only by the timer */
+    int flush_ms;                       /* flush interval, 0 for none */
+    int pending;                        /* events in the buffer */
+    bool header;                        /* the header of the CSV format has been written */
+    char *buffer;
+    size_t len;
+    size_t size;
+    struct s_event_loop *loop;          /* loop of the flush timer */
+    int timer;                          /* flush timer, -1 if there is none */
+};
+
+/* initialise a sink writing to fd
+    format and flush are the names given on the command line (NULL for the defaults: raw and event)
+    on error, false is returned and errno set appropriately (EINVAL for an unknown format or flush policy) */
+bool event_sink_init(struct s_event_sink *sink, int fd, const char *format, const char *flush);
+
+/* start the flush timer of the policy on the loop, nothing to do for the other policies
+    on error, false is returned and errno set appropriately */
+bool event_sink_attach(struct s_event_sink *sink, struct s_event_loop *loop);
+
+/* write an event
+    on error, false is returned and errno set appropriately */
+bool event_sink_write(struct s_event_sink *sink, const struct s_mcip_event *event);
+
+/* format an event into the buffer without writing it, afterwards the buffer (buffer, len) holds exactly the event
+    this is for the users that write the events themselves, the sink is initialised with fd -1
+    on error, false is returned and errno set appropriately */
+bool event_sink_render(struct s_event_sink *sink, const struct s_mcip_event *event);
+
+/* write preformatted output (e.g. a summary of events), it counts as one event for the flush policy
+    on error, false is returned and errno set appropriately */
+bool event_sink_write_text(struct s_event_sink *sink, const char *text, size_t len);
+
+/* write the buffered events
+    on error, false is returned and errno set appropriately */
+bool event_sink_flush(struct s_event_sink *sink);
+
+/* flush, stop the timer and free the buffer, this must be called before the loop of the timer is freed */
+void event_sink_free(struct s_event_sink *sink);
@@ -0,0 +1,83 @@
+#include "histogram.h"
+
+/* index of the bucket of a value */
+static unsigned int histogram_index(uint64_t value)
+{
+    unsigned int shift;
+
+    if (value < (1 << HISTOGRAM_SUB_BITS)) {
+        return value;
+    }
+
+    shift = 63 - __builtin_clzll(value) - HISTOGRAM_SUB_BITS;
+    return ((shift + 1) << HISTOGRAM_SUB_BITS) + (unsigned int) ((value >> shift) - (1 << HISTOGRAM_SUB_BITS));
+}
+
+/* largest value of a bucket */
+static uint64_t histogram_upper(unsigned int index)
+{
+    unsigned int shift;
+    uint64_t sub;
+
+    if (index < (1 << HISTOGRAM_SUB_BITS)) {
+        return index;
+    }
+
+    shift = (index >> HISTOGRAM_SUB_BITS) - 1;
+    sub = (index & ((1 << HISTOGRAM_SUB_BITS) - 1)) + (1 << HISTOGRAM_SUB_BITS);
+    return ((sub + 1) << shift) - 1;
+}
+
+/* record a value */
+void histogram_record(struct s_histogram *histogram, uint64_t value)
+{
+    histogram->buckets[histogram_index(value)]++;
+    histogram->count++;
+    histogram->sum += value;
+    if (value > histogram->max) {
+        histogram->max = value;
+    }
+    return;
+}
+
+/* value below which <percentile> percent of the recorded values are */
+uint64_t histogram_percentile(const struct s_histogram *histogram, double percentile)
+{
+    uint64_t rank, seen = 0, upper;
+    unsigned int i;
+
+    if (histogram->count == 0) {
+        return 0;
+    }
+
+    rank = (uint64_t) (percentile / 100.0 * histogram->count + 0.5);
+    if (rank < 1) {
+        rank = 1;
+    }
+
+    for (i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        seen += histogram->buckets[i];
+        if (seen >= rank) {
+            upper = histogram_upper(i);
+            return (upper < histogram->max) ? upper : histogram->max;
+        }
+    }
+
+    return histogram->max;
+}
+
+/* add all values of one histogram to another one */
+void histogram_merge(struct s_histogram *to, const struct s_histogram *from)
+{
+    unsigned int i;
+
+    for (i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        to->buckets[i] += from->buckets[i];
+    }
+    to->count += from->count;
+    to->sum += from->sum;
+    if (from->max > to->max) {
+        to->max = from->max;
+    }
+    return;
+}
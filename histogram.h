@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stdint.h>
+
+/* log-linear histogram: every power of two range is split into 2^HISTOGRAM_SUB_BITS linear buckets,
+    so the relative error of a value taken from the histogram is at most 1 / 2^HISTOGRAM_SUB_BITS (12.5 %),
+    recording a value is a few instructions and never allocates */
+#define HISTOGRAM_SUB_BITS      3
+#define HISTOGRAM_BUCKETS       ((64 - HISTOGRAM_SUB_BITS + 1) << HISTOGRAM_SUB_BITS)
+
+struct s_histogram {
+    uint64_t count;                     /* number of recorded values */
+    uint64_t sum;                       /* sum of the recorded values */
+    uint64_t max;                       /* largest recorded value */
+    uint32_t buckets[HISTOGRAM_BUCKETS];
+};
+
+/* record a value */
+void histogram_record(struct s_histogram *histogram, uint64_t value);
+
+/* value below which <percentile> (0 to 100) percent of the recorded values are (the upper bound of the bucket)
+    returns 0 if no value has been recorded */
+uint64_t histogram_percentile(const struct s_histogram *histogram, double percentile);
+
+/* add all values of one histogram to another one */
+void histogram_merge(struct s_histogram *to, const struct s_histogram *from);
@@ -1,9 +1,25 @@
+#define _GNU_SOURCE
 #include "m3_cli.h"
+#include "m3_cli_cache.h"
+#include "m3_cli_stats.h"
 
 #include <libmcip.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
 #include <unistd.h>
 #include <stdbool.h>
 #include <errno.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+/* number of bytes that are at least requested from the socket by one read */
+#define M3_CLI_READ_CHUNK   16384
+
+/* maximum length of a line, that is recognised as prompt */
+#define M3_CLI_PROMPT_MAX   128
 
 /* free wrapper function to avoid dangling pointers */
 void safefree(void **pp)
@@ -15,78 +31,306 @@ void safefree(void **pp)
     return;
 }
 
-/* generic read from the cli socket
-    fd          is needed
-    answer      if given, the answer is written into the buffer (careful, allocated)
-    prompt      if given, the reading of the answer stops on receipt of the prompt (and the prompt is trimmed from the answer)
-    waittime_ms maximum amount of time (in milliseconds) to wait for an answer (use 0 to simply read and discard present data on the socket) */
-bool m3_cli_read_socket(int fd, char **answer, char *prompt, int waittime_ms)
+/* make sure the receive buffer of the session can take at least <size> more bytes
+    the buffer grows geometrically and is kept for all answers of the session */
+static bool m3_cli_buffer_reserve(struct s_m3_cli *cli, size_t size)
+{
+    size_t new_size;
+    char *p;
+
+    if (cli->buffer_len + size <= cli->buffer_size) {
+        return true;
+    }
+
+    new_size = cli->buffer_size ? cli->buffer_size : M3_CLI_READ_CHUNK;
+    while (new_size < cli->buffer_len + size) {
+        new_size *= 2;
+    }
+
+    p = realloc(cli->buffer, new_size);
+    if (p == NULL) {
+        errno = ENOMEM;
+        return false;
+    }
+    cli->buffer = p;
+    cli->buffer_size = new_size;
+
+    return true;
+}
+
+/* drop the answer returned as view by the last command (and its prompt) from the receive buffer */
+static void m3_cli_consume(struct s_m3_cli *cli)
+{
+    if (cli->consumed > 0) {
+        cli->buffer_len -= cli->consumed;
+        memmove(cli->buffer, cli->buffer + cli->consumed, cli->buffer_len);
+        cli->consumed = 0;
+    }
+    return;
+}
+
+/* copy an answer into an allocated string */
+static bool m3_cli_copy_answer(const char *view, size_t len, char **answer)
+{
+    *answer = malloc(len + 1);
+    if (*answer == NULL) {
+        errno = ENOMEM;
+        return false;
+    }
+    memcpy(*answer, view, len);
+    (*answer)[len] = '\0';
+
+    return true;
+}
+
+/* calculate the absolute deadline waittime_ms from now on (CLOCK_MONOTONIC) */
+void m3_cli_deadline(struct timespec *deadline, int waittime_ms)
+{
+    clock_gettime(CLOCK_MONOTONIC, deadline);
+    deadline->tv_sec += waittime_ms / 1000;
+    deadline->tv_nsec += (long) (waittime_ms % 1000) * 1000000;
+    if (deadline->tv_nsec >= 1000000000) {
+        deadline->tv_sec++;
+        deadline->tv_nsec -= 1000000000;
+    }
+    return;
+}
+
+/* milliseconds left until the deadline (rounded up), 0 if it has passed */
+static int m3_cli_remaining_ms(const struct timespec *deadline)
+{
+    struct timespec now;
+    long long remaining_ns;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    remaining_ns = (long long) (deadline->tv_sec - now.tv_sec) * 1000000000 + (deadline->tv_nsec - now.tv_nsec);
+    if (remaining_ns <= 0) {
+        return 0;
+    }
+
+    return (int) ((remaining_ns + 999999) / 1000000);
+}
+
+/* the earlier of two deadlines */
+static const struct timespec *m3_cli_earlier(const struct timespec *a, const struct timespec *b)
 {
-    char buffer[100];
-    fd_set read_fds;
-    struct timeval tv;
-    int ret, read_bytes, current_size = 0;
-    char *cli_reply = NULL, *p;
+    if (a->tv_sec < b->tv_sec || (a->tv_sec == b->tv_sec && a->tv_nsec < b->tv_nsec)) {
+        return a;
+    }
+    return b;
+}
+
+/* wait until the socket is ready for <events> or the deadline has passed
+    returns M3_CLI_PROMPT if the socket is ready (there is no better name for "go on") */
+static enum m3_cli_status m3_cli_wait(struct s_m3_cli *cli, short events, const struct timespec *deadline)
+{
+    struct pollfd pfd;
+    int ret;
 
     for (;;) {
-        FD_ZERO(&read_fds);
-        FD_SET(fd, &read_fds);
-        /* use the correct waittime */
-        if (waittime_ms) {
-            tv.tv_sec = waittime_ms / 1000;
-            tv.tv_usec = waittime_ms * 1000;
-        }
-        else {
-            tv.tv_sec = 0;
-            tv.tv_usec = 0;
-        }
-        ret = select(fd + 1, &read_fds, NULL, NULL, &tv);
-        /* on timeout always return */
+        pfd.fd = cli->fd;
+        pfd.events = events;
+        pfd.revents = 0;
+        ret = poll(&pfd, 1, m3_cli_remaining_ms(deadline));
+        if (ret > 0) {
+            return M3_CLI_PROMPT;
+        }
         if (ret == 0) {
-            break;
+            return M3_CLI_TIMEOUT;
         }
-        if (ret == -1) {
-            safefree((void **) &cli_reply);
-            return false;
+        if (errno != EINTR) {
+            return M3_CLI_ERROR;
         }
-        /* the socket is ready */
-        if (FD_ISSET(fd, &read_fds)) {
-            read_bytes = read(fd, buffer, 100);
-            /* if there are no bytes any more (EOF) return */
-            if (read_bytes == 0) {
-                break;
+    }
+}
+
+/* wait for data on the socket until the deadline and append it to the receive buffer
+    returns M3_CLI_PROMPT if data has been read (the prompt is not checked here), otherwise the reason why not */
+static enum m3_cli_status m3_cli_receive(struct s_m3_cli *cli, const struct timespec *deadline)
+{
+    enum m3_cli_status status;
+    ssize_t read_bytes;
+
+    status = m3_cli_wait(cli, POLLIN, deadline);
+    if (status != M3_CLI_PROMPT) {
+        return status;
+    }
+
+    if (!m3_cli_buffer_reserve(cli, M3_CLI_READ_CHUNK)) {
+        return M3_CLI_ERROR;
+    }
+    read_bytes = read(cli->fd, cli->buffer + cli->buffer_len, cli->buffer_size - cli->buffer_len);
+    if (read_bytes == 0) {
+        return M3_CLI_EOF;
+    }
+    if (read_bytes == -1) {
+        return (errno == EINTR || errno == EAGAIN) ? M3_CLI_PROMPT : M3_CLI_ERROR;
+    }
+    cli->buffer_len += read_bytes;
+
+    return M3_CLI_PROMPT;
+}
+
+/* write all buffers of an io vector with as few system calls as possible, partial writes are continued until the deadline
+    the io vector is modified */
+static enum m3_cli_status m3_cli_write_iov(struct s_m3_cli *cli, struct iovec *iov, int iovcnt, const struct timespec *deadline)
+{
+    enum m3_cli_status status;
+    struct msghdr msg;
+    ssize_t written;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = iovcnt;
+
+    while (msg.msg_iovlen > 0) {
+        written = sendmsg(cli->fd, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (written == -1) {
+            if (errno == EPIPE || errno == ECONNRESET) {
+                return M3_CLI_EOF;
+            }
+            if (errno != EAGAIN && errno != EINTR) {
+                return M3_CLI_ERROR;
             }
-            if (read_bytes == -1) {
-                safefree((void **) &cli_reply);
-                return false;
+            status = m3_cli_wait(cli, POLLOUT, deadline);
+            if (status != M3_CLI_PROMPT) {
+                return status;
             }
+            continue;
+        }
+
+        /* skip what has been written */
+        while (msg.msg_iovlen > 0 && (size_t) written >= msg.msg_iov[0].iov_len) {
+            written -= msg.msg_iov[0].iov_len;
+            msg.msg_iov++;
+            msg.msg_iovlen--;
+        }
+        if (msg.msg_iovlen > 0) {
+            msg.msg_iov[0].iov_base = (char *) msg.msg_iov[0].iov_base + written;
+            msg.msg_iov[0].iov_len -= written;
+        }
+    }
+
+    return M3_CLI_PROMPT;
+}
+
+/* write a command followed by a new line to the socket, partial writes are continued until the deadline */
+static enum m3_cli_status m3_cli_write_command(struct s_m3_cli *cli, const char *command, const struct timespec *deadline)
+{
+    struct iovec iov[2];
+
+    iov[0].iov_base = (void *) command;
+    iov[0].iov_len = strlen(command);
+    iov[1].iov_base = "\n";
+    iov[1].iov_len = 1;
+
+    return m3_cli_write_iov(cli, iov, 2, deadline);
+}
+
+/* discard all data that is present on the socket without waiting
+    returns false if the connection is broken */
+static bool m3_cli_drain(struct s_m3_cli *cli)
+{
+    struct timespec now;
+    enum m3_cli_status status;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    cli->consumed = 0;
+    do {
+        cli->buffer_len = 0;
+        status = m3_cli_receive(cli, &now);
+    }
+    while (status == M3_CLI_PROMPT);
+    cli->buffer_len = 0;
+
+    return (status == M3_CLI_TIMEOUT);
+}
 
-            /* append to the internal reply */
-            cli_reply = realloc(cli_reply, current_size + read_bytes + 1);
-            memcpy(cli_reply + current_size, buffer, read_bytes);
-            current_size += read_bytes;
-            cli_reply[current_size] = '\0';
-
-            /* detect a prompt (if given) */
-            if (prompt != NULL) {
-                p = strstr(cli_reply, prompt);
-                if (p != NULL) {
-                    *p = '\0';
-                    break;
-                }
+/* generic read of an answer from the cli socket
+    cli         is needed (fd and the receive buffer with the data left over from the last answer)
+    answer      if given, it is set to the answer inside the receive buffer (\\0 terminated, NULL on failure), it stays
+                there until the next read of the session
+    len         if given, it is set to the length of the answer
+    prompt      the reading of the answer stops on receipt of the prompt (and the prompt as well as the line break in front
+                of it is trimmed from the answer), data following the prompt is kept for the next answer
+    deadline    point in time (CLOCK_MONOTONIC) when the waiting for the prompt is given up
+    returns M3_CLI_PROMPT if the prompt has been received, otherwise the reason why not */
+static enum m3_cli_status m3_cli_read_socket(struct s_m3_cli *cli, const char **answer, size_t *len, char *prompt, const struct timespec *deadline)
+{
+    enum m3_cli_status status = M3_CLI_PROMPT;
+    size_t prompt_len, scanned = 0, answer_len;
+    char *p = NULL;
+
+    prompt_len = strlen(prompt);
+    m3_cli_consume(cli);
+
+    for (;;) {
+        /* detect the prompt, only the new data and the possibly cut prompt before it has to be scanned */
+        if (cli->buffer_len >= scanned + prompt_len) {
+            p = memmem(cli->buffer + scanned, cli->buffer_len - scanned, prompt, prompt_len);
+            if (p != NULL) {
+                break;
             }
+            scanned = cli->buffer_len - prompt_len + 1;
         }
+
+        status = m3_cli_receive(cli, deadline);
+        if (status != M3_CLI_PROMPT) {
+            break;
+        }
+    }
+
+    /* without the prompt, the received data is useless */
+    if (p == NULL) {
+        cli->buffer_len = 0;
+        if (answer != NULL) {
+            *answer = NULL;
+        }
+        if (len != NULL) {
+            *len = 0;
+        }
+        return status;
+    }
+
+    /* the answer is everything in front of the prompt, it stays in the buffer until the next read */
+    answer_len = p - cli->buffer;
+    if (answer_len > 0 && cli->buffer[answer_len - 1] == '\n') {
+        answer_len--;
+    }
+    if (answer_len > 0 && cli->buffer[answer_len - 1] == '\r') {
+        answer_len--;
     }
+    cli->buffer[answer_len] = '\0';
+    cli->consumed = (p - cli->buffer) + prompt_len;
 
-    /* if the answer is queried, store it in the given buffer */
     if (answer != NULL) {
-        *answer = calloc(1, current_size + 1);
-        memcpy(*answer, cli_reply, current_size);
+        *answer = cli->buffer;
+    }
+    if (len != NULL) {
+        *len = answer_len;
     }
 
-    safefree((void **) &cli_reply);
+    return status;
+}
 
-    return true;
+/* set errno according to the status of a failed command */
+static void m3_cli_set_errno(enum m3_cli_status status)
+{
+    switch (status) {
+        case M3_CLI_TIMEOUT: {
+            errno = ETIMEDOUT;
+            break;
+        }
+        case M3_CLI_EOF: {
+            errno = ECONNRESET;
+            break;
+        }
+        default: {
+            errno = EIO;
+            break;
+        }
+    }
+    return;
 }
 
 /* close the socket */
@@ -94,61 +338,192 @@ void m3_cli_close(struct s_m3_cli *cli)
 {
     if (cli->fd != -1) {
         close(cli->fd);
+        cli->fd = -1;
     }
+    cli->buffer_len = 0;
+    cli->consumed = 0;
     return;
 }
 
-/* read the cli prompt */
-bool m3_cli_read_prompt(struct s_m3_cli *cli)
+/* check if the character at the end of a line is the end of a prompt */
+static bool m3_cli_prompt_end(const char *line, size_t len)
+{
+    if (len > 0 && line[len - 1] == ' ') {
+        len--;
+    }
+
+    return (len > 0 && strchr(">#$:", line[len - 1]) != NULL);
+}
+
+/* check if the received data ends with something that looks like a prompt:
+    a line without line break at the end of the data that ends with '>', '#', '$' or ':' (optionally followed by a space)
+    repeated    is set to true if the prompt has already been received before (e.g. the prompt on connect), that may also
+                be directly in front of it on the same line
+    returns the length of the prompt (it starts at buffer + len - returned length) or 0 */
+static size_t m3_cli_prompt_shape(const char *buffer, size_t len, bool *repeated)
 {
+    size_t start = len;
+    size_t k;
+
+    *repeated = false;
+
+    while (start > 0 && buffer[start - 1] != '\n' && buffer[start - 1] != '\r') {
+        start--;
+    }
+    if (len - start < 1 || len - start > M3_CLI_PROMPT_MAX || !m3_cli_prompt_end(buffer + start, len - start)) {
+        return 0;
+    }
+
+    /* the prompt has been sent twice without a line break, e.g. "cli> cli> " */
+    for (k = start + 1; k < len; k++) {
+        if (buffer[k - 1] == ' ' && m3_cli_prompt_end(buffer + start, k - start) &&
+            k - start >= len - k && memcmp(buffer + 2 * k - len, buffer + k, len - k) == 0) {
+                *repeated = true;
+                return len - k;
+        }
+    }
+
+    *repeated = (memmem(buffer, start, buffer + start, len - start) != NULL);
+
+    return len - start;
+}
+
+/* read the cli prompt
+    a new line is sent right away and the answer is read until it ends with something looking like a prompt, that has
+    already been received before (the prompt on connect and the one for the new line), so there is no fixed waiting time;
+    if the prompt only arrives once, it is taken at the deadline, which is at most the default waittime from now on;
+    a prompt of another shape is only recognised at the deadline: the last line received is taken then */
+static bool m3_cli_read_prompt(struct s_m3_cli *cli, const struct timespec *deadline)
+{
+    enum m3_cli_status status;
+    struct timespec waittime;
+    size_t prompt_len = 0;
+    size_t prompt_start, end;
+    bool repeated = false;
+
     if (cli->fd == -1) {
         errno = EBADF;
         return false;
     }
 
-    /* discard all data on the socket */
-    if (!m3_cli_read_socket(cli->fd, NULL, NULL, cli->waittime_ms) ||
-        write(cli->fd, "\n", 1) != 1 ||
-        !m3_cli_read_socket(cli->fd, &(cli->prompt), NULL, cli->waittime_ms)) {
-            m3_cli_close(cli);
-            errno = EIO;
-            return false;
+    m3_cli_deadline(&waittime, cli->waittime_ms);
+    deadline = m3_cli_earlier(deadline, &waittime);
+
+    cli->buffer_len = 0;
+    cli->consumed = 0;
+    status = m3_cli_write_command(cli, "", deadline);
+
+    while (status == M3_CLI_PROMPT) {
+        status = m3_cli_receive(cli, deadline);
+        if (status == M3_CLI_PROMPT) {
+            prompt_len = m3_cli_prompt_shape(cli->buffer, cli->buffer_len, &repeated);
+            if (repeated == true) {
+                break;
+            }
+        }
     }
 
+    prompt_start = cli->buffer_len - prompt_len;
+
+    /* nothing looks like a prompt: take the last line, that is not empty */
+    if (prompt_len == 0 && status == M3_CLI_TIMEOUT) {
+        end = cli->buffer_len;
+        while (end > 0 && (cli->buffer[end - 1] == '\n' || cli->buffer[end - 1] == '\r')) {
+            end--;
+        }
+        prompt_start = end;
+        while (prompt_start > 0 && cli->buffer[prompt_start - 1] != '\n' && cli->buffer[prompt_start - 1] != '\r') {
+            prompt_start--;
+        }
+        prompt_len = end - prompt_start;
+
+        /* the prompt on connect and the one for the new line without a line break in between */
+        if (prompt_len % 2 == 0 && memcmp(cli->buffer + prompt_start, cli->buffer + prompt_start + prompt_len / 2, prompt_len / 2) == 0) {
+            prompt_start += prompt_len / 2;
+            prompt_len /= 2;
+        }
+    }
+
+    /* no more data: use the last prompt received (if any) */
+    if (prompt_len == 0 || (status != M3_CLI_PROMPT && status != M3_CLI_TIMEOUT)) {
+        cli->status = status;
+        m3_cli_close(cli);
+        errno = EIO;
+        return false;
+    }
+
+    safefree((void **) &cli->prompt);
+    cli->prompt = strndup(cli->buffer + prompt_start, prompt_len);
+    cli->buffer_len = 0;
+
     return true;
 }
 
 /* open UDS connection and read prompt */
-bool m3_cli_open(struct s_m3_cli *cli)
+static bool m3_cli_open(struct s_m3_cli *cli, const struct timespec *deadline)
 {
+    int64_t start, connected;
+    bool ok;
+
     /* open UDS connection */
+    start = m3_cli_stats_now_us();
     cli->fd = mcip_open_uds_socket(cli->socket_path);
     if (cli->fd < 0) {
+        cli->fd = -1;
+        cli->status = M3_CLI_ERROR;
+        m3_cli_stats_connect(cli->stats, 0, 0, false);
         return false;
     }
+    connected = m3_cli_stats_now_us();
 
     /* read prompt */
-    return m3_cli_read_prompt(cli);
+    ok = m3_cli_read_prompt(cli, deadline);
+    m3_cli_stats_connect(cli->stats, connected - start, m3_cli_stats_now_us() - connected, ok);
+
+    return ok;
 }
 
-/* function that send a command to the socket and retrieves the answer */
-bool m3_cli_command(struct s_m3_cli *cli, char *command, char **answer, int waittime_ms)
+/* function that send a command to the socket and retrieves the answer until the deadline
+    the answer is returned as view into the receive buffer */
+static bool m3_cli_command(struct s_m3_cli *cli, char *command, const char **answer, size_t *len, const struct timespec *deadline)
 {
+    int64_t start;
+
+    /* the answers of the submitted commands would get lost */
+    if (cli->requests != NULL) {
+        errno = EBUSY;
+        return false;
+    }
+
+    m3_cli_stats_poll(cli->stats);
+    m3_cli_cache_command(cli->cache, command);
+
     /* if the socket is down, open it (and read prompt) */
     if (cli->fd == -1) {
-        if (!m3_cli_open(cli)) {
+        if (!m3_cli_open(cli, deadline)) {
             errno = EIO;
             return false;
         }
     }
-    /* clear the socket from not fetched data, send command, send \n and get the answer */
-    if (!m3_cli_read_socket(cli->fd, NULL, NULL, 0) ||
-        write(cli->fd, command, strlen(command)) != strlen(command) ||
-        write(cli->fd, "\n", 1) != 1 ||
-        !m3_cli_read_socket(cli->fd, answer, cli->prompt, waittime_ms)) {
-            m3_cli_close(cli);
-            errno = EIO;
-            return false;
+    start = m3_cli_stats_now_us();
+
+    /* clear the socket from not fetched data, send command with \n and get the answer */
+    if (!m3_cli_drain(cli)) {
+        cli->status = M3_CLI_EOF;
+    }
+    else {
+        cli->status = m3_cli_write_command(cli, command, deadline);
+        if (cli->status == M3_CLI_PROMPT) {
+            cli->status = m3_cli_read_socket(cli, answer, len, cli->prompt, deadline);
+        }
+    }
+    m3_cli_stats_command(cli->stats, command, m3_cli_stats_now_us() - start, cli->status);
+
+    /* without the prompt the session is out of sync, it is reopened by the next command */
+    if (cli->status != M3_CLI_PROMPT) {
+        m3_cli_close(cli);
+        m3_cli_set_errno(cli->status);
+        return false;
     }
 
     return true;
@@ -157,18 +532,24 @@ bool m3_cli_command(struct s_m3_cli *cli, char *command, char **answer, int wait
 /* warpper to send a command to the cli without caring about the answer */
 bool m3_cli_send(struct s_m3_cli *cli, char *command)
 {
+    struct timespec deadline;
+
     /* discard data on the socket */
     if (cli == NULL || command == NULL) {
         errno = EINVAL;
         return false;
     }
 
-    return m3_cli_command(cli, command, NULL, cli->waittime_ms);
+    m3_cli_deadline(&deadline, cli->waittime_ms);
+
+    return m3_cli_command(cli, command, NULL, NULL, &deadline);
 }
 
 /* wrapper to send a command to the cli but read back the answer */
 bool m3_cli_query(struct s_m3_cli *cli, char *command, char **answer, int waittime_ms)
 {
+    struct timespec deadline;
+
     /* discard data on the socket */
     if (cli == NULL || command == NULL || answer == NULL) {
         errno = EINVAL;
@@ -178,8 +559,78 @@ bool m3_cli_query(struct s_m3_cli *cli, char *command, char **answer, int waitti
     if (waittime_ms == 0) {
         waittime_ms = cli->waittime_ms;
     }
+    m3_cli_deadline(&deadline, waittime_ms);
 
-    return m3_cli_command(cli, command, answer, waittime_ms);
+    return m3_cli_query_until(cli, command, answer, &deadline);
+}
+
+/* wrapper to send a command to the cli but read back the answer until an absolute deadline */
+bool m3_cli_query_until(struct s_m3_cli *cli, char *command, char **answer, const struct timespec *deadline)
+{
+    const char *view;
+    size_t len;
+
+    if (cli == NULL || command == NULL || answer == NULL || deadline == NULL) {
+        errno = EINVAL;
+        return false;
+    }
+    *answer = NULL;
+
+    /* answer status values from the cache if they are fresh enough */
+    if (m3_cli_cache_lookup(cli->cache, command, answer)) {
+        cli->status = M3_CLI_PROMPT;
+        return true;
+    }
+
+    if (!m3_cli_command(cli, command, &view, &len, deadline) || !m3_cli_copy_answer(view, len, answer)) {
+        return false;
+    }
+    m3_cli_cache_store(cli->cache, command, *answer);
+
+    return true;
+}
+
+/* wrapper to send a command to the cli and return the answer as view into the receive buffer */
+bool m3_cli_query_view(struct s_m3_cli *cli, char *command, const char **answer, size_t *len, int waittime_ms)
+{
+    struct timespec deadline;
+
+    if (cli == NULL || command == NULL || answer == NULL || len == NULL) {
+        errno = EINVAL;
+        return false;
+    }
+
+    if (waittime_ms == 0) {
+        waittime_ms = cli->waittime_ms;
+    }
+    m3_cli_deadline(&deadline, waittime_ms);
+
+    return m3_cli_command(cli, command, answer, len, &deadline);
+}
+
+/* wrapper to send a command to the cli and copy the answer into the given buffer */
+bool m3_cli_query_buf(struct s_m3_cli *cli, char *command, char *buffer, size_t size, size_t *len, int waittime_ms)
+{
+    const char *view;
+
+    if (buffer == NULL || size == 0 || len == NULL) {
+        errno = EINVAL;
+        return false;
+    }
+
+    if (m3_cli_query_view(cli, command, &view, len, waittime_ms) == false) {
+        return false;
+    }
+
+    if (*len >= size) {
+        memcpy(buffer, view, size - 1);
+        buffer[size - 1] = '\0';
+        errno = ENOBUFS;
+        return false;
+    }
+    memcpy(buffer, view, *len + 1);
+
+    return true;
 }
 
 /* wrapper to send a command to the cli but read back the answer and report if the answer is a null sting or "is unknown" */
@@ -200,15 +651,495 @@ bool m3_cli_query_verified(struct s_m3_cli *cli, char *command, char **answer, i
     return true;
 }
 
+/* check if an answer is an error of the cli: only its first line is looked at, it is no "key=value" line and ends
+    with "is unknown" or starts with "error" or "invalid"; the rest of an answer (e.g. an echoed value) may contain
+    anything */
+bool m3_cli_answer_failed(const char *answer)
+{
+    static const char unknown[] = "is unknown";
+    size_t len;
+
+    if (answer == NULL) {
+        return true;
+    }
+    while (*answer == ' ' || *answer == '\t') {
+        answer++;
+    }
+    len = strcspn(answer, "\r\n");
+    while (len > 0 && (answer[len - 1] == ' ' || answer[len - 1] == '\t')) {
+        len--;
+    }
+
+    if (memchr(answer, '=', len) != NULL) {
+        return false;
+    }
+    if (len >= sizeof(unknown) - 1 && memcmp(answer + len - (sizeof(unknown) - 1), unknown, sizeof(unknown) - 1) == 0) {
+        return true;
+    }
+
+    return ((len >= 5 && strncasecmp(answer, "error", 5) == 0) || (len >= 7 && strncasecmp(answer, "invalid", 7) == 0));
+}
+
+/* send a list of commands with one write and read all their answers */
+bool m3_cli_transaction(struct s_m3_cli *cli, struct s_m3_cli_action *actions, int count, int waittime_ms)
+{
+    struct timespec deadline;
+    struct iovec *iov;
+    const char *view;
+    size_t len;
+    int64_t start;
+    int i;
+
+    if (cli == NULL || actions == NULL || count < 1 || count > M3_CLI_TRANSACTION_MAX) {
+        errno = EINVAL;
+        return false;
+    }
+    for (i = 0; i < count; i++) {
+        actions[i].answer = NULL;
+        if (actions[i].command == NULL || strchr(actions[i].command, '\n') != NULL) {
+            errno = EINVAL;
+            return false;
+        }
+    }
+
+    /* the answers of the submitted commands would get lost */
+    if (cli->requests != NULL) {
+        errno = EBUSY;
+        return false;
+    }
+
+    if (waittime_ms == 0) {
+        waittime_ms = cli->waittime_ms;
+    }
+    m3_cli_deadline(&deadline, waittime_ms);
+    m3_cli_stats_poll(cli->stats);
+
+    iov = calloc(2 * count, sizeof(struct iovec));
+    if (iov == NULL) {
+        errno = ENOMEM;
+        return false;
+    }
+    for (i = 0; i < count; i++) {
+        m3_cli_cache_command(cli->cache, actions[i].command);
+        iov[2 * i].iov_base = actions[i].command;
+        iov[2 * i].iov_len = strlen(actions[i].command);
+        iov[2 * i + 1].iov_base = "\n";
+        iov[2 * i + 1].iov_len = 1;
+    }
+
+    /* if the socket is down, open it (and read prompt) */
+    if (cli->fd == -1) {
+        if (!m3_cli_open(cli, &deadline)) {
+            safefree((void **) &iov);
+            errno = EIO;
+            return false;
+        }
+    }
+
+    /* clear the socket from not fetched data once, write all commands at once and read one prompt per command */
+    start = m3_cli_stats_now_us();
+    if (!m3_cli_drain(cli)) {
+        cli->status = M3_CLI_EOF;
+    }
+    else {
+        cli->status = m3_cli_write_iov(cli, iov, 2 * count, &deadline);
+    }
+    safefree((void **) &iov);
+
+    for (i = 0; i < count && cli->status == M3_CLI_PROMPT; i++) {
+        cli->status = m3_cli_read_socket(cli, &view, &len, cli->prompt, &deadline);
+        m3_cli_stats_command(cli->stats, actions[i].command, m3_cli_stats_now_us() - start, cli->status);
+        if (cli->status == M3_CLI_PROMPT && !m3_cli_copy_answer(view, len, &actions[i].answer)) {
+            cli->status = M3_CLI_ERROR;
+        }
+    }
+
+    /* without all prompts the session is out of sync, it is reopened by the next command */
+    if (cli->status != M3_CLI_PROMPT) {
+        m3_cli_close(cli);
+        m3_cli_set_errno(cli->status);
+        return false;
+    }
+
+    return true;
+}
+
+/* free the answers of a transaction */
+void m3_cli_transaction_free(struct s_m3_cli_action *actions, int count)
+{
+    int i;
+
+    for (i = 0; actions != NULL && i < count; i++) {
+        safefree((void **) &actions[i].answer);
+    }
+    return;
+}
+
+/* write a command to the cli without waiting for its answer (pipelining) */
+bool m3_cli_write(struct s_m3_cli *cli, char *command)
+{
+    struct timespec deadline;
+
+    if (cli == NULL || command == NULL) {
+        errno = EINVAL;
+        return false;
+    }
+
+    if (cli->requests != NULL) {
+        errno = EBUSY;
+        return false;
+    }
+
+    m3_cli_stats_poll(cli->stats);
+    m3_cli_cache_command(cli->cache, command);
+    m3_cli_deadline(&deadline, cli->waittime_ms);
+
+    /* if the socket is down, open it (and read prompt) */
+    if (cli->fd == -1) {
+        if (!m3_cli_open(cli, &deadline)) {
+            errno = EIO;
+            return false;
+        }
+    }
+
+    cli->status = m3_cli_write_command(cli, command, &deadline);
+    if (cli->status != M3_CLI_PROMPT) {
+        m3_cli_stats_command(cli->stats, command, 0, cli->status);
+        m3_cli_close(cli);
+        m3_cli_set_errno(cli->status);
+        return false;
+    }
+    m3_cli_stats_written(cli->stats, command);
+
+    return true;
+}
+
+/* read the answer of the oldest command written with m3_cli_write */
+bool m3_cli_read_answer(struct s_m3_cli *cli, char **answer, int waittime_ms)
+{
+    const char *view;
+    size_t len;
+
+    if (answer == NULL) {
+        errno = EINVAL;
+        return false;
+    }
+    *answer = NULL;
+
+    if (m3_cli_read_answer_view(cli, &view, &len, waittime_ms) == false) {
+        return false;
+    }
+
+    return m3_cli_copy_answer(view, len, answer);
+}
+
+/* read the answer of the oldest command written with m3_cli_write as view into the receive buffer */
+bool m3_cli_read_answer_view(struct s_m3_cli *cli, const char **answer, size_t *len, int waittime_ms)
+{
+    struct timespec deadline;
+
+    if (cli == NULL || answer == NULL || len == NULL) {
+        errno = EINVAL;
+        return false;
+    }
+    if (cli->fd == -1) {
+        errno = EBADF;
+        return false;
+    }
+
+    if (waittime_ms == 0) {
+        waittime_ms = cli->waittime_ms;
+    }
+    m3_cli_deadline(&deadline, waittime_ms);
+
+    /* without the prompt the following answers can not be assigned any more */
+    cli->status = m3_cli_read_socket(cli, answer, len, cli->prompt, &deadline);
+    m3_cli_stats_answered(cli->stats, cli->status);
+    if (cli->status != M3_CLI_PROMPT) {
+        m3_cli_close(cli);
+        m3_cli_set_errno(cli->status);
+        return false;
+    }
+
+    return true;
+}
+
+/* text for the status of the last command */
+const char *m3_cli_status_string(enum m3_cli_status status)
+{
+    switch (status) {
+        case M3_CLI_PROMPT:     return "prompt";
+        case M3_CLI_TIMEOUT:    return "timeout";
+        case M3_CLI_EOF:        return "eof";
+        default:                return "error";
+    }
+}
+
+/* take the first request off the queue and report its result */
+static void m3_cli_complete(struct s_m3_cli *cli, enum m3_cli_status status, const char *answer, size_t len)
+{
+    struct s_m3_cli_request *request = cli->requests;
+
+    cli->requests = request->next;
+    if (cli->requests == NULL) {
+        cli->requests_tail = NULL;
+    }
+    cli->status = status;
+    m3_cli_stats_command(cli->stats, request->command, m3_cli_stats_now_us() - request->submitted_us, status);
+
+    /* the callback may already submit the next command */
+    if (request->callback != NULL) {
+        request->callback(cli, status, answer, len, request->ctx);
+    }
+    safefree((void **) &request->command);
+    safefree((void **) &request);
+
+    return;
+}
+
+/* the session is out of sync: report the requests that have (partly) been written as failed and close the socket,
+    the requests not written yet are kept and sent after the session has been reopened */
+static void m3_cli_abort(struct s_m3_cli *cli, enum m3_cli_status status)
+{
+    while (cli->requests != NULL && cli->requests->written > 0) {
+        m3_cli_complete(cli, status, NULL, 0);
+    }
+    m3_cli_close(cli);
+    cli->scanned = 0;
+
+    return;
+}
+
+/* file descriptor to wait for when using the asynchronous functions (-1 if the socket is closed) */
+int m3_cli_fd(struct s_m3_cli *cli)
+{
+    return (cli != NULL) ? cli->fd : -1;
+}
+
+/* poll events the asynchronous functions are waiting for */
+short m3_cli_events(struct s_m3_cli *cli)
+{
+    struct s_m3_cli_request *request;
+    short events = 0;
+
+    if (cli == NULL || cli->fd == -1) {
+        return 0;
+    }
+
+    for (request = cli->requests; request != NULL; request = request->next) {
+        events |= POLLIN;
+        if (request->written < request->len) {
+            events |= POLLOUT;
+            break;
+        }
+    }
+
+    return events;
+}
+
+/* time in milliseconds until m3_cli_step has to be called at latest (the next deadline), -1 if there is none */
+int m3_cli_timeout_ms(struct s_m3_cli *cli)
+{
+    if (cli == NULL || cli->requests == NULL) {
+        return -1;
+    }
+
+    /* the socket has to be reopened */
+    if (cli->fd == -1) {
+        return 0;
+    }
+
+    /* the answers arrive in order, so the first request always has the next deadline that matters */
+    return m3_cli_remaining_ms(&cli->requests->deadline);
+}
+
+/* submit a command that is sent and answered by m3_cli_step */
+bool m3_cli_submit(struct s_m3_cli *cli, char *command, int waittime_ms, m3_cli_callback callback, void *ctx)
+{
+    struct s_m3_cli_request *request;
+
+    if (cli == NULL || command == NULL || strchr(command, '\n') != NULL) {
+        errno = EINVAL;
+        return false;
+    }
+
+    if (waittime_ms == 0) {
+        waittime_ms = cli->waittime_ms;
+    }
+
+    request = calloc(1, sizeof(struct s_m3_cli_request));
+    if (request == NULL) {
+        errno = ENOMEM;
+        return false;
+    }
+    request->len = strlen(command) + 1;
+    request->command = malloc(request->len + 1);
+    if (request->command == NULL) {
+        safefree((void **) &request);
+        errno = ENOMEM;
+        return false;
+    }
+    memcpy(request->command, command, request->len - 1);
+    request->command[request->len - 1] = '\n';
+    request->command[request->len] = '\0';
+    request->callback = callback;
+    request->ctx = ctx;
+    m3_cli_deadline(&request->deadline, waittime_ms);
+    request->submitted_us = m3_cli_stats_now_us();
+    m3_cli_cache_command(cli->cache, command);
+
+    if (cli->requests_tail != NULL) {
+        cli->requests_tail->next = request;
+    }
+    else {
+        cli->requests = request;
+    }
+    cli->requests_tail = request;
+
+    return true;
+}
+
+/* advance the submitted commands without blocking */
+int m3_cli_step(struct s_m3_cli *cli)
+{
+    struct s_m3_cli_request *request;
+    struct timespec deadline;
+    ssize_t x;
+    size_t prompt_len, answer_len;
+    char *p;
+    int completed = 0;
+    bool sent;
+
+    if (cli == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+    m3_cli_stats_poll(cli->stats);
+    if (cli->requests == NULL) {
+        return 0;
+    }
+    m3_cli_consume(cli);
+
+    /* reopen the session, this is the only part that blocks (for the handshake) */
+    if (cli->fd == -1) {
+        m3_cli_deadline(&deadline, cli->waittime_ms);
+        if (!m3_cli_open(cli, &deadline)) {
+            while (cli->requests != NULL) {
+                m3_cli_complete(cli, M3_CLI_ERROR, NULL, 0);
+                completed++;
+            }
+            errno = EIO;
+            return completed;
+        }
+        cli->scanned = 0;
+    }
+
+    /* write as much of the pending commands as the socket takes */
+    for (request = cli->requests; request != NULL; request = request->next) {
+        if (request->written == request->len) {
+            continue;
+        }
+        x = send(cli->fd, request->command + request->written, request->len - request->written, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (x == -1) {
+            if (errno == EAGAIN || errno == EINTR) {
+                break;
+            }
+            m3_cli_abort(cli, (errno == EPIPE || errno == ECONNRESET) ? M3_CLI_EOF : M3_CLI_ERROR);
+            return completed;
+        }
+        request->written += x;
+        if (request->written < request->len) {
+            break;
+        }
+    }
+
+    /* read everything present on the socket */
+    for (;;) {
+        if (!m3_cli_buffer_reserve(cli, M3_CLI_READ_CHUNK)) {
+            m3_cli_abort(cli, M3_CLI_ERROR);
+            return completed;
+        }
+        x = recv(cli->fd, cli->buffer + cli->buffer_len, cli->buffer_size - cli->buffer_len, MSG_DONTWAIT);
+        if (x > 0) {
+            cli->buffer_len += x;
+            continue;
+        }
+        if (x == -1 && (errno == EAGAIN || errno == EINTR)) {
+            break;
+        }
+        /* EOF or error: the answers of the written commands are lost */
+        m3_cli_abort(cli, (x == 0) ? M3_CLI_EOF : M3_CLI_ERROR);
+        return completed;
+    }
+
+    /* every prompt completes the first command that has been written completely */
+    prompt_len = strlen(cli->prompt);
+    while (cli->fd != -1 && cli->requests != NULL && cli->requests->written == cli->requests->len) {
+        p = NULL;
+        if (cli->buffer_len >= cli->scanned + prompt_len) {
+            p = memmem(cli->buffer + cli->scanned, cli->buffer_len - cli->scanned, cli->prompt, prompt_len);
+        }
+        if (p == NULL) {
+            if (cli->buffer_len >= prompt_len) {
+                cli->scanned = cli->buffer_len - prompt_len + 1;
+            }
+            break;
+        }
+
+        answer_len = p - cli->buffer;
+        if (answer_len > 0 && cli->buffer[answer_len - 1] == '\n') {
+            answer_len--;
+        }
+        if (answer_len > 0 && cli->buffer[answer_len - 1] == '\r') {
+            answer_len--;
+        }
+        cli->buffer[answer_len] = '\0';
+
+        /* the answer is still in the buffer while the callback runs */
+        x = (p - cli->buffer) + prompt_len;
+        cli->scanned = 0;
+        m3_cli_complete(cli, M3_CLI_PROMPT, cli->buffer, answer_len);
+        completed++;
+        if (cli->fd == -1) {
+            break;
+        }
+        cli->buffer_len -= x;
+        memmove(cli->buffer, cli->buffer + x, cli->buffer_len);
+    }
+
+    /* the first command did not get its answer in time, if it has been sent, the session is out of sync */
+    if (cli->requests != NULL && m3_cli_remaining_ms(&cli->requests->deadline) == 0) {
+        sent = (cli->requests->written > 0);
+        m3_cli_complete(cli, M3_CLI_TIMEOUT, NULL, 0);
+        completed++;
+        if (sent == true) {
+            m3_cli_abort(cli, M3_CLI_ERROR);
+        }
+    }
+
+    return completed;
+}
+
 /* close cli socket and free the struct */
 void m3_cli_shutdown(struct s_m3_cli **cli)
 {
     if ( cli == NULL || (*cli) == NULL) {
         return;
     }
+    while ((*cli)->requests != NULL) {
+        m3_cli_complete(*cli, M3_CLI_ERROR, NULL, 0);
+    }
     m3_cli_close(*cli);
+    m3_cli_cache_close(&(*cli)->cache);
+    if ((*cli)->stats != NULL) {
+        if ((*cli)->stats->connects > 0) {
+            m3_cli_stats_print((*cli)->stats, (*cli)->stats->out);
+        }
+        m3_cli_stats_free(&(*cli)->stats);
+    }
     safefree((void **)&((*cli)->socket_path));
     safefree((void **)&((*cli)->prompt));
+    safefree((void **)&((*cli)->buffer));
     safefree((void **)cli);
     return;
 }
@@ -219,6 +1150,8 @@ void m3_cli_shutdown(struct s_m3_cli **cli)
 struct s_m3_cli *m3_cli_initialise(const char *socket_path, int default_waittime_ms)
 {
     struct s_m3_cli *cli;
+    struct timespec deadline;
+    char *stats;
 
     if (socket_path == NULL || default_waittime_ms == 0) {
         errno = EINVAL;
@@ -236,7 +1169,14 @@ struct s_m3_cli *m3_cli_initialise(const char *socket_path, int default_waittime
     cli->socket_path = calloc(1, strlen(socket_path) + 1);
     strcpy(cli->socket_path, socket_path);
 
-    if (!m3_cli_open(cli)) {
+    /* record the latencies from the first connect on */
+    stats = getenv(M3_CLI_STATS_ENV);
+    if (stats != NULL) {
+        cli->stats = m3_cli_stats_create(strcmp(stats, "stdout") == 0 ? stdout : stderr);
+    }
+
+    m3_cli_deadline(&deadline, default_waittime_ms);
+    if (!m3_cli_open(cli, &deadline)) {
         m3_cli_shutdown(&cli);
         errno = EIO;
         return NULL;
@@ -1,14 +1,71 @@
 #pragma once
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+/* result of the last command of a cli session */
+enum m3_cli_status {
+    M3_CLI_PROMPT = 0,          /* the prompt has been received, the answer is complete */
+    M3_CLI_TIMEOUT,             /* the deadline has passed before the prompt has been received */
+    M3_CLI_EOF,                 /* the cli closed the connection */
+    M3_CLI_ERROR,               /* reading or writing the socket failed */
+};
+
+struct s_m3_cli;
+struct s_m3_cli_cache;
+struct s_m3_cli_stats;
+
+/* completion callback of a command submitted by m3_cli_submit
+    status  M3_CLI_PROMPT if the answer is complete, otherwise the reason why the command failed
+    answer  the answer (\\0 terminated, NULL on failure), it is only valid during the callback */
+typedef void (*m3_cli_callback)(struct s_m3_cli *cli, enum m3_cli_status status, const char *answer, size_t len, void *ctx);
+
+/* command submitted by m3_cli_submit */
+struct s_m3_cli_request {
+    char *command;              /* command including the new line */
+    size_t len;                 /* length of the command including the new line */
+    size_t written;             /* number of bytes already written to the socket */
+    struct timespec deadline;   /* point in time (CLOCK_MONOTONIC) the answer has to be received until */
+    int64_t submitted_us;       /* point in time (CLOCK_MONOTONIC) of the submission for the statistics */
+    m3_cli_callback callback;   /* function called on completion */
+    void *ctx;                  /* argument for the callback */
+    struct s_m3_cli_request *next;
+};
+
+/* maximum number of commands of a transaction */
+#define M3_CLI_TRANSACTION_MAX  512
+
+/* one command of a transaction */
+struct s_m3_cli_action {
+    char *command;              /* command without new line */
+    char *answer;               /* answer (allocated), NULL if it has not been received */
+};
 
 struct s_m3_cli {
     char *socket_path;          /* socket path (gets allocated and copied on initialisation) */
     int fd;                     /* file descriptor */
     char *prompt;               /* prompt that got read */
     int waittime_ms;            /* default waittime for send commands to retrieve the new prompt */
+    enum m3_cli_status status;  /* result of the last command */
+    char *buffer;               /* receive buffer, it is reused for all answers of this session and
+                                   holds the data received after the last prompt (it belongs to the next answer) */
+    size_t buffer_size;         /* allocated size of the receive buffer */
+    size_t buffer_len;          /* number of bytes in the receive buffer */
+    size_t scanned;             /* number of bytes of the receive buffer already searched for the prompt (asynchronous) */
+    size_t consumed;            /* number of bytes at the start of the receive buffer that belong to the answer returned as
+                                   view (and its prompt), they are dropped by the next command of the session */
+    struct s_m3_cli_request *requests;      /* submitted commands in the order they are answered */
+    struct s_m3_cli_request *requests_tail; /* last submitted command */
+    struct s_m3_cli_cache *cache;           /* optional cache of status values (see m3_cli_cache.h), owned by the session */
+    struct s_m3_cli_stats *stats;           /* optional latency statistics (see m3_cli_stats.h), owned by the session */
 };
 
+/* all waittimes are the total time (CLOCK_MONOTONIC) a command may take including reconnecting, writing and reading:
+    if the prompt has not been received until then, the command fails with ETIMEDOUT (ECONNRESET on EOF),
+    the socket is closed and cli->status tells what happened */
+
 /* send a command to the cli without caring about the answer
     if the socket is not open, it will be initialised
     if the send or read fails, the socket will be closed, so it can be opened by the next call
@@ -21,6 +78,9 @@ bool m3_cli_send(struct s_m3_cli *cli, char *command);
     on error, false is returned and errno set approriately */
 bool m3_cli_query(struct s_m3_cli *cli, char *command, char **answer, int waittime_ms);
 
+/* same as m3_cli_query, but the answer must have been received until the absolute deadline (CLOCK_MONOTONIC) */
+bool m3_cli_query_until(struct s_m3_cli *cli, char *command, char **answer, const struct timespec *deadline);
+
 /* send a command to the cli and retrieve the answer
     but if the answer is an empty string of containers "is unknown" return EINVAL
     if the socket is not open, it will be initialised
@@ -28,12 +88,90 @@ bool m3_cli_query(struct s_m3_cli *cli, char *command, char **answer, int waitti
     on error, false is returned and errno set approriately */
 bool m3_cli_query_verified(struct s_m3_cli *cli, char *command, char **answer, int waittime_ms);
 
+/* check if an answer (e.g. of a setter or a submit) is an error of the cli: the first line is no "key=value" line and
+    ends with "is unknown" or starts with "error" or "invalid", a NULL answer is an error as well */
+bool m3_cli_answer_failed(const char *answer);
+
+/* same as m3_cli_query, but nothing is allocated: the answer is returned as view into the receive buffer of the session
+    answer  points to the answer (\\0 terminated), it is only valid until the next command of the session
+    len     the length of the answer
+    the buffer of the session is reused, so polling does not allocate any memory once it has grown to the answer size;
+    the cache is not used (only the changes are tracked), it is meant for separate processes asking for the same values */
+bool m3_cli_query_view(struct s_m3_cli *cli, char *command, const char **answer, size_t *len, int waittime_ms);
+
+/* same as m3_cli_query_view, but the answer is copied into the given buffer of <size> bytes (\\0 terminated)
+    if the answer does not fit, it is truncated, len is set to the complete length and ENOBUFS is returned,
+    the session stays usable in this case */
+bool m3_cli_query_buf(struct s_m3_cli *cli, char *command, char *buffer, size_t size, size_t *len, int waittime_ms);
+
+/* send an ordered list of commands as one transaction: all commands are written at once (one sendmsg with an io vector),
+    then one prompt per command is read, so the whole list costs about one round trip
+    the answer of every command is stored in actions[i].answer (free them with m3_cli_transaction_free),
+    on failure the answers received so far are kept, the others are NULL and the session is closed
+    the commands should be short (e.g. setters followed by a submit), the cli has to read all of them before its answers
+    are read
+    on error, false is returned and errno set approriately */
+bool m3_cli_transaction(struct s_m3_cli *cli, struct s_m3_cli_action *actions, int count, int waittime_ms);
+
+/* free the answers of a transaction */
+void m3_cli_transaction_free(struct s_m3_cli_action *actions, int count);
+
+/* write a command to the cli without waiting for the answer
+    several commands can be written before their answers are read with m3_cli_read_answer (pipelining)
+    if the socket is not open, it will be initialised
+    if the write fails, the socket will be closed, so it can be opened by the next call
+    on error, false is returned and errno set approriately */
+bool m3_cli_write(struct s_m3_cli *cli, char *command);
+
+/* read the answer of the oldest command that has been written by m3_cli_write
+    the answers have to be read in the same order as the commands have been written
+    if the prompt does not arrive within waittime_ms (0 for the default waittime), ETIMEDOUT is returned
+    if the read fails or times out, the socket will be closed and the answers of all written commands are lost
+    on error, false is returned and errno set approriately */
+bool m3_cli_read_answer(struct s_m3_cli *cli, char **answer, int waittime_ms);
+
+/* same as m3_cli_read_answer, but the answer is returned as view into the receive buffer (see m3_cli_query_view) */
+bool m3_cli_read_answer_view(struct s_m3_cli *cli, const char **answer, size_t *len, int waittime_ms);
+
+/* asynchronous functions: instead of blocking until the answer arrives, commands are submitted and their
+    completion callbacks are called by m3_cli_step, which is called whenever the fd is ready for the events
+    returned by m3_cli_events or after m3_cli_timeout_ms; this allows to drive the cli from a poll/epoll loop
+    together with other sockets; the blocking functions fail with EBUSY while submitted commands are pending */
+
+/* file descriptor of the session to wait for (-1 while the socket is closed) */
+int m3_cli_fd(struct s_m3_cli *cli);
+
+/* poll events (POLLIN, POLLOUT) m3_cli_step is waiting for */
+short m3_cli_events(struct s_m3_cli *cli);
+
+/* milliseconds until m3_cli_step has to be called at latest (to handle a deadline or to reopen the socket),
+    -1 if no command is pending */
+int m3_cli_timeout_ms(struct s_m3_cli *cli);
+
+/* submit a command, it is sent by m3_cli_step and callback is called with the answer
+    waittime_ms (0 for the default waittime) is the time the answer has to be received in
+    on error, false is returned and errno set approriately */
+bool m3_cli_submit(struct s_m3_cli *cli, char *command, int waittime_ms, m3_cli_callback callback, void *ctx);
+
+/* advance the submitted commands without blocking: write the commands, read the answers and call the callbacks
+    if the socket has to be reopened, this blocks until the prompt has been read (at most the default waittime)
+    if a command times out or the connection breaks, all commands already written fail, the others are kept
+    returns the number of completed commands or -1 on error */
+int m3_cli_step(struct s_m3_cli *cli);
+
 /* initialises a cli struct container socket, fd and prompt
     this struct is used to automatically reopen a broken socket in the query or send functions
     open the cli socket and get the prompt
+    if the environment variable M3_CLI_STATS is set, the session records latency statistics and prints them on shutdown
     returns a struct containing all cli information
     on error, NULL is returned and errno set appropriately */
 struct s_m3_cli *m3_cli_initialise(const char *socket_path, int default_waittime_ms);
 
+/* calculate the absolute deadline (CLOCK_MONOTONIC) waittime_ms from now on */
+void m3_cli_deadline(struct timespec *deadline, int waittime_ms);
+
+/* text for the status of the last command ("prompt", "timeout", "eof" or "error") */
+const char *m3_cli_status_string(enum m3_cli_status status);
+
 /* close the socket and free the struct */
 void m3_cli_shutdown(struct s_m3_cli **cli);
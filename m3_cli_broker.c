@@ -0,0 +1,438 @@
+#define _GNU_SOURCE
+#include "m3_cli_broker.h"
+#include "m3_cli.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+/* maximum length of a command line of a client */
+#define BROKER_LINE_MAX     65536
+
+/* maximum number of clients connected at the same time */
+#define BROKER_CLIENTS_MAX  256
+
+struct s_broker;
+
+struct s_broker_client {
+    struct s_broker *broker;    /* broker the client is connected to */
+    int fd;                     /* file descriptor of the client connection (-1 when disconnected) */
+    bool busy;                  /* a command of the client is being answered by its session */
+    int session;                /* session of the client for its whole connection (-1 until its first command) */
+    char *in;                   /* received data, that has not been served yet */
+    size_t in_len;              /* number of bytes in the input buffer */
+    char *out;                  /* answers, that have not been sent yet */
+    size_t out_len;             /* number of bytes in the output buffer */
+    size_t out_size;            /* allocated size of the output buffer */
+};
+
+struct s_broker {
+    struct s_m3_cli **sessions; /* warm sessions to the cli */
+    struct s_broker_client **owners; /* client each session belongs to (NULL if the session is free) */
+    int count;                  /* number of sessions */
+    char *prompt;               /* prompt sent to the clients */
+};
+
+void safefree(void **pp);
+
+/* create the listening socket of the broker
+    the clients get unauthenticated access to the cli, so the socket gets the owner, group and permissions of the cli
+    socket it fronts (but never for others); a socket of a broker that is still running is not taken away */
+static int broker_listen(const char *path, const char *cli_path)
+{
+    struct sockaddr_un addr;
+    struct stat st;
+    mode_t mask;
+    int fd, ret;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+
+    /* only remove a stale socket of a former broker */
+    if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) == 0) {
+        close(fd);
+        errno = EADDRINUSE;
+        return -1;
+    }
+    if (errno == ECONNREFUSED) {
+        unlink(path);
+    }
+    else if (errno != ENOENT) {
+        close(fd);
+        return -1;
+    }
+    close(fd);
+
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+
+    /* the socket is only accessible by its owner until it gets the permissions of the cli socket */
+    mask = umask(0177);
+    ret = bind(fd, (struct sockaddr *) &addr, sizeof(addr));
+    umask(mask);
+    if (ret != 0 || listen(fd, 64) != 0) {
+        close(fd);
+        return -1;
+    }
+    if (stat(cli_path, &st) == 0 && (chown(path, st.st_uid, st.st_gid) != 0 || chmod(path, st.st_mode & 0660) != 0)) {
+        close(fd);
+        unlink(path);
+        return -1;
+    }
+
+    return fd;
+}
+
+/* append data to the output buffer of a client */
+static bool broker_queue(struct s_broker_client *client, const char *data, size_t len)
+{
+    size_t new_size;
+    char *p;
+
+    if (client->out_len + len > client->out_size) {
+        new_size = client->out_size ? client->out_size : 4096;
+        while (new_size < client->out_len + len) {
+            new_size *= 2;
+        }
+        p = realloc(client->out, new_size);
+        if (p == NULL) {
+            return false;
+        }
+        client->out = p;
+        client->out_size = new_size;
+    }
+
+    memcpy(client->out + client->out_len, data, len);
+    client->out_len += len;
+
+    return true;
+}
+
+/* send as much of the output buffer as the socket takes without blocking */
+static bool broker_flush(struct s_broker_client *client)
+{
+    ssize_t x;
+
+    while (client->out_len > 0) {
+        x = send(client->fd, client->out, client->out_len, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (x == -1) {
+            return (errno == EAGAIN || errno == EINTR);
+        }
+        client->out_len -= x;
+        memmove(client->out, client->out + x, client->out_len);
+    }
+
+    return true;
+}
+
+/* read the data of a client into its input buffer, it must not be full */
+static bool broker_receive(struct s_broker_client *client)
+{
+    ssize_t x;
+
+    x = read(client->fd, client->in + client->in_len, BROKER_LINE_MAX - client->in_len);
+    if (x > 0) {
+        client->in_len += x;
+        return true;
+    }
+
+    return (x == -1 && (errno == EAGAIN || errno == EINTR));
+}
+
+/* disconnect a client and free its buffers, the client itself is freed as soon as it is not busy any more */
+static void broker_disconnect(struct s_broker_client *client)
+{
+    if (client->fd != -1) {
+        close(client->fd);
+    }
+    client->fd = -1;
+    safefree((void **) &client->in);
+    safefree((void **) &client->out);
+    client->in_len = client->out_len = client->out_size = 0;
+    return;
+}
+
+/* completion of a command submitted for a client: send the answer followed by the prompt */
+static void broker_answer(struct s_m3_cli *cli, enum m3_cli_status status, const char *answer, size_t len, void *ctx)
+{
+    struct s_broker_client *client = ctx;
+    struct s_broker *broker = client->broker;
+
+    client->busy = false;
+    if (client->fd == -1) {
+        return;
+    }
+
+    /* a failed command closes the client connection just like the cli would do */
+    if (status != M3_CLI_PROMPT ||
+        broker_queue(client, answer, len) == false ||
+        broker_queue(client, "\r\n", 2) == false ||
+        broker_queue(client, broker->prompt, strlen(broker->prompt)) == false ||
+        broker_flush(client) == false) {
+            broker_disconnect(client);
+    }
+
+    return;
+}
+
+/* find a session, that does not belong to a client, returns -1 if all are taken */
+static int broker_free_session(struct s_broker *broker)
+{
+    int i;
+
+    for (i = 0; i < broker->count; i++) {
+        if (broker->owners[i] == NULL) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+/* serve the next command of a client if it has received a complete line: submit it to the session of the client
+    the cli keeps the state of commands that take several steps (e.g. help.debug.sms.*) per session, so a client gets
+    a session of its own with its first command and keeps it until it disconnects; no other client's commands get in
+    between its commands
+    returns false if the client has to be disconnected */
+static bool broker_serve(struct s_broker *broker, struct s_broker_client *client)
+{
+    char *nl;
+    size_t len;
+    bool ok = true;
+
+    nl = memchr(client->in, '\n', client->in_len);
+    if (nl == NULL) {
+        return true;
+    }
+    *nl = '\0';
+    len = nl - client->in;
+    if (len > 0 && client->in[len - 1] == '\r') {
+        client->in[len - 1] = '\0';
+    }
+
+    /* an empty line only asks for the prompt */
+    if (client->in[0] == '\0') {
+        ok = broker_queue(client, "\r\n", 2) && broker_queue(client, broker->prompt, strlen(broker->prompt));
+    }
+    else {
+        if (client->session == -1) {
+            client->session = broker_free_session(broker);
+            broker->owners[client->session] = client;
+        }
+        ok = m3_cli_submit(broker->sessions[client->session], client->in, M3_CLI_BROKER_WAITTIME_MS, broker_answer, client);
+        if (ok == true) {
+            client->busy = true;
+        }
+    }
+
+    client->in_len -= len + 1;
+    memmove(client->in, nl + 1, client->in_len);
+
+    return ok;
+}
+
+/* the client has a command, that can be served right now (it has a session or there is a free one) */
+static bool broker_ready(struct s_broker *broker, struct s_broker_client *client)
+{
+    return (client->fd != -1 && client->busy == false && client->out_len == 0 &&
+            memchr(client->in, '\n', client->in_len) != NULL &&
+            (client->session != -1 || broker_free_session(broker) != -1));
+}
+
+/* run the cli broker */
+int m3_cli_broker_run(const char *listen_path, const char *cli_path, int sessions, int default_waittime_ms)
+{
+    struct s_broker broker;
+    struct s_broker_client **clients;
+    struct s_broker_client *client;
+    struct pollfd *pfds;
+    int listen_fd, fd, count = 0, next_client = 0;
+    int i, n, timeout, polled;
+
+    if (listen_path == NULL || cli_path == NULL || sessions < 1) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    /* open the warm sessions to the cli */
+    memset(&broker, 0, sizeof(broker));
+    broker.count = sessions;
+    broker.sessions = calloc(sessions, sizeof(struct s_m3_cli *));
+    broker.owners = calloc(sessions, sizeof(struct s_broker_client *));
+    for (i = 0; i < sessions; i++) {
+        broker.sessions[i] = m3_cli_initialise(cli_path, default_waittime_ms);
+        if (broker.sessions[i] == NULL) {
+            for (; i >= 0; i--) {
+                m3_cli_shutdown(&broker.sessions[i]);
+            }
+            safefree((void **) &broker.sessions);
+            safefree((void **) &broker.owners);
+            errno = EIO;
+            return -1;
+        }
+    }
+    broker.prompt = strdup(broker.sessions[0]->prompt);
+
+    listen_fd = broker_listen(listen_path, cli_path);
+    if (listen_fd < 0) {
+        for (i = 0; i < sessions; i++) {
+            m3_cli_shutdown(&broker.sessions[i]);
+        }
+        safefree((void **) &broker.sessions);
+        safefree((void **) &broker.owners);
+        safefree((void **) &broker.prompt);
+        return -1;
+    }
+
+    clients = calloc(BROKER_CLIENTS_MAX, sizeof(struct s_broker_client *));
+    pfds = calloc(1 + sessions + BROKER_CLIENTS_MAX, sizeof(struct pollfd));
+
+    for (;;) {
+        /* wait for the clients and the sessions, do not wait if a command is ready to be served */
+        timeout = -1;
+        pfds[0].fd = listen_fd;
+        pfds[0].events = (count < BROKER_CLIENTS_MAX) ? POLLIN : 0;
+        for (i = 0; i < sessions; i++) {
+            pfds[1 + i].fd = m3_cli_fd(broker.sessions[i]);
+            pfds[1 + i].events = m3_cli_events(broker.sessions[i]);
+            n = m3_cli_timeout_ms(broker.sessions[i]);
+            if (n >= 0 && (timeout == -1 || n < timeout)) {
+                timeout = n;
+            }
+        }
+        for (i = 0; i < count; i++) {
+            /* a client with a full input buffer is not read from until its commands have been served */
+            pfds[1 + sessions + i].fd = clients[i]->fd;
+            pfds[1 + sessions + i].events = (clients[i]->in_len < BROKER_LINE_MAX) ? POLLIN : 0;
+            if (clients[i]->out_len > 0) {
+                pfds[1 + sessions + i].events |= POLLOUT;
+            }
+            else if (broker_ready(&broker, clients[i])) {
+                timeout = 0;
+            }
+            if (pfds[1 + sessions + i].events == 0) {
+                pfds[1 + sessions + i].fd = -1;
+            }
+        }
+        polled = count;
+        n = poll(pfds, 1 + sessions + polled, timeout);
+        if (n == -1 && errno != EINTR) {
+            break;
+        }
+
+        /* new client: it gets the prompt right away */
+        if (n > 0 && (pfds[0].revents & POLLIN)) {
+            fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd >= 0) {
+                client = calloc(1, sizeof(struct s_broker_client));
+                client->broker = &broker;
+                client->fd = fd;
+                client->session = -1;
+                client->in = calloc(1, BROKER_LINE_MAX);
+                broker_queue(client, broker.prompt, strlen(broker.prompt));
+                clients[count++] = client;
+            }
+        }
+
+        /* answers of the cli */
+        for (i = 0; i < sessions; i++) {
+            if ((n > 0 && pfds[1 + i].revents != 0) || m3_cli_timeout_ms(broker.sessions[i]) == 0) {
+                m3_cli_step(broker.sessions[i]);
+            }
+        }
+
+        /* receive and send */
+        for (i = 0; n > 0 && i < polled; i++) {
+            client = clients[i];
+            if (client->fd == -1) {
+                continue;
+            }
+            if (client->in_len < BROKER_LINE_MAX && (pfds[1 + sessions + i].revents & (POLLIN | POLLHUP | POLLERR))) {
+                if (broker_receive(client) == false) {
+                    broker_disconnect(client);
+                    continue;
+                }
+            }
+            if (pfds[1 + sessions + i].revents & POLLOUT) {
+                if (broker_flush(client) == false) {
+                    broker_disconnect(client);
+                }
+            }
+
+            /* a line, that does not even fit into the buffer, can never be served */
+            if (client->fd != -1 && client->in_len == BROKER_LINE_MAX && memchr(client->in, '\n', client->in_len) == NULL) {
+                broker_disconnect(client);
+            }
+        }
+
+        /* serve one command of every client in round robin order, clients that have a command in progress or that
+           have not yet fetched their last answer have to wait */
+        for (n = 0; n < count; n++) {
+            client = clients[(next_client + n) % count];
+            if (broker_ready(&broker, client) == false) {
+                continue;
+            }
+            if (broker_serve(&broker, client) == false || broker_flush(client) == false) {
+                broker_disconnect(client);
+            }
+        }
+        if (count > 0) {
+            next_client = (next_client + 1) % count;
+        }
+
+        /* submit the new commands right away */
+        for (i = 0; i < sessions; i++) {
+            if (m3_cli_events(broker.sessions[i]) & POLLOUT) {
+                m3_cli_step(broker.sessions[i]);
+            }
+        }
+
+        /* remove the disconnected clients, that are not waiting for an answer any more, their sessions are free again */
+        for (i = 0; i < count; ) {
+            if (clients[i]->fd == -1 && clients[i]->busy == false) {
+                if (clients[i]->session != -1) {
+                    broker.owners[clients[i]->session] = NULL;
+                }
+                safefree((void **) &clients[i]);
+                clients[i] = clients[--count];
+                continue;
+            }
+            i++;
+        }
+    }
+
+    for (i = 0; i < sessions; i++) {
+        m3_cli_shutdown(&broker.sessions[i]);
+    }
+    for (i = 0; i < count; i++) {
+        broker_disconnect(clients[i]);
+        safefree((void **) &clients[i]);
+    }
+    close(listen_fd);
+    unlink(listen_path);
+    safefree((void **) &broker.sessions);
+    safefree((void **) &broker.owners);
+    safefree((void **) &broker.prompt);
+    safefree((void **) &clients);
+    safefree((void **) &pfds);
+
+    return -1;
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <stdbool.h>
+
+/* socket of the broker, the applets use it instead of the cli socket if it is present */
+#define M3_CLI_BROKER_SOCKET        "/var/run/mcip-cli-broker.socket"
+
+/* maximum time a forwarded command may take (the longest waittime any applet uses) */
+#define M3_CLI_BROKER_WAITTIME_MS   60000
+
+/* run the cli broker, it returns only on error
+    the broker keeps <sessions> warm sessions to the cli at cli_path and accepts clients on listen_path
+    the clients talk to the broker like to the cli itself: they get a prompt, send commands line by line and
+    receive the answer followed by the prompt; every client gets a session of its own with its first command and keeps
+    it until it disconnects, so commands that take several steps (e.g. sending an SMS) are not mixed up between clients;
+    a client waits for a free session if all are taken
+    the socket gets the owner, group and permissions of the cli socket, but no access for others
+    on error, -1 is returned and errno set appropriately (EADDRINUSE if another broker is running) */
+int m3_cli_broker_run(const char *listen_path, const char *cli_path, int sessions, int default_waittime_ms);
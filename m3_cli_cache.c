@@ -0,0 +1,305 @@
+#include "m3_cli_cache.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define M3_CLI_CACHE_MAGIC      0x4d33430a
+#define M3_CLI_CACHE_VERSION    1
+
+struct s_m3_cli_cache_entry {
+    uint32_t hash;                      /* hash of the key, 0 for an unused entry */
+    uint32_t generation;                /* generation of the cache the entry has been stored in */
+    int64_t stored_ns;                  /* time of storing (CLOCK_MONOTONIC) */
+    uint16_t key_len;
+    uint16_t value_len;
+    char key[M3_CLI_CACHE_KEY_MAX];
+    char value[M3_CLI_CACHE_VALUE_MAX];
+};
+
+struct s_m3_cli_cache_file {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t generation;                /* incremented on every invalidation, older entries are stale */
+    uint32_t reserved;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t stores;
+    uint64_t invalidations;
+    struct s_m3_cli_cache_entry entries[M3_CLI_CACHE_ENTRIES];
+};
+
+void safefree(void **pp);
+
+/* current time (CLOCK_MONOTONIC) in nanoseconds */
+static int64_t cache_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* FNV-1a hash of a key, never 0 */
+static uint32_t cache_hash(const char *key, size_t len)
+{
+    uint32_t hash = 2166136261u;
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        hash ^= (uint8_t) key[i];
+        hash *= 16777619u;
+    }
+
+    return hash ? hash : 1;
+}
+
+/* TTL of a command (longest matching prefix), 0 if the command is not cacheable */
+static int cache_ttl(struct s_m3_cli_cache *cache, const char *command, size_t len)
+{
+    size_t best = 0, prefix_len;
+    int ttl = 0, i;
+
+    /* only read only status values */
+    if (strncmp(command, "status.", 7) != 0 || len >= M3_CLI_CACHE_KEY_MAX || strpbrk(command, "= \t") != NULL) {
+        return 0;
+    }
+
+    for (i = 0; i < cache->ttls; i++) {
+        prefix_len = strlen(cache->prefix[i]);
+        if (prefix_len >= best && strncmp(command, cache->prefix[i], prefix_len) == 0) {
+            best = prefix_len;
+            ttl = cache->ttl_ms[i];
+        }
+    }
+
+    return ttl;
+}
+
+/* parse the list of <prefix>=<ttl> */
+static bool cache_parse_ttls(struct s_m3_cli_cache *cache, const char *ttl_spec)
+{
+    char *spec, *item, *save = NULL, *eq;
+
+    spec = strdup(ttl_spec);
+    for (item = strtok_r(spec, ",", &save); item != NULL; item = strtok_r(NULL, ",", &save)) {
+        eq = strrchr(item, '=');
+        if (eq == NULL || eq == item || cache->ttls >= M3_CLI_CACHE_TTLS_MAX || atoi(eq + 1) < 0) {
+            safefree((void **) &spec);
+            return false;
+        }
+        *eq = '\0';
+        cache->prefix[cache->ttls] = strdup(item);
+        cache->ttl_ms[cache->ttls] = atoi(eq + 1);
+        cache->ttls++;
+    }
+    safefree((void **) &spec);
+
+    return true;
+}
+
+/* open (and create) the cache file */
+struct s_m3_cli_cache *m3_cli_cache_open(const char *path, const char *ttl_spec)
+{
+    struct s_m3_cli_cache *cache;
+    struct stat st;
+
+    if (path == NULL) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    cache = calloc(1, sizeof(struct s_m3_cli_cache));
+    if (cache == NULL) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    cache->fd = -1;
+    if (ttl_spec != NULL && cache_parse_ttls(cache, ttl_spec) == false) {
+        m3_cli_cache_close(&cache);
+        errno = EINVAL;
+        return NULL;
+    }
+
+    /* the answers are trusted by every user of the cache, so others must not have access to it and a file, that is not
+        owned by this user (or is no regular file, e.g. a link), is not touched */
+    cache->fd = open(path, O_RDWR | O_CREAT | O_NOFOLLOW | O_CLOEXEC, 0600);
+    if (cache->fd < 0) {
+        m3_cli_cache_close(&cache);
+        return NULL;
+    }
+    if (fstat(cache->fd, &st) != 0 || S_ISREG(st.st_mode) == 0 || st.st_uid != geteuid() || (st.st_mode & 0007) != 0) {
+        m3_cli_cache_close(&cache);
+        errno = EPERM;
+        return NULL;
+    }
+
+    /* the first one initialises the file */
+    flock(cache->fd, LOCK_EX);
+    if (fstat(cache->fd, &st) != 0 ||
+        (st.st_size != sizeof(struct s_m3_cli_cache_file) && ftruncate(cache->fd, 0) != 0) ||
+        ftruncate(cache->fd, sizeof(struct s_m3_cli_cache_file)) != 0) {
+            flock(cache->fd, LOCK_UN);
+            m3_cli_cache_close(&cache);
+            return NULL;
+    }
+    cache->file = mmap(NULL, sizeof(struct s_m3_cli_cache_file), PROT_READ | PROT_WRITE, MAP_SHARED, cache->fd, 0);
+    if (cache->file == MAP_FAILED) {
+        cache->file = NULL;
+        flock(cache->fd, LOCK_UN);
+        m3_cli_cache_close(&cache);
+        return NULL;
+    }
+    if (cache->file->magic != M3_CLI_CACHE_MAGIC || cache->file->version != M3_CLI_CACHE_VERSION) {
+        memset(cache->file, 0, sizeof(struct s_m3_cli_cache_file));
+        cache->file->magic = M3_CLI_CACHE_MAGIC;
+        cache->file->version = M3_CLI_CACHE_VERSION;
+    }
+    flock(cache->fd, LOCK_UN);
+
+    return cache;
+}
+
+/* look up the answer of a command */
+bool m3_cli_cache_lookup(struct s_m3_cli_cache *cache, const char *command, char **answer)
+{
+    struct s_m3_cli_cache_entry *entry;
+    size_t len;
+    uint32_t hash;
+    int ttl;
+    bool hit = false;
+
+    if (cache == NULL || command == NULL || answer == NULL) {
+        return false;
+    }
+    len = strlen(command);
+    ttl = cache_ttl(cache, command, len);
+    if (ttl == 0) {
+        return false;
+    }
+
+    hash = cache_hash(command, len);
+    entry = &cache->file->entries[hash % M3_CLI_CACHE_ENTRIES];
+
+    flock(cache->fd, LOCK_EX);
+    cache->generation = cache->file->generation;
+    if (entry->hash == hash && entry->key_len == len && memcmp(entry->key, command, len) == 0 &&
+        entry->generation == cache->file->generation &&
+        cache_now_ns() - entry->stored_ns < (int64_t) ttl * 1000000) {
+            /* without memory it is a miss, the answer is fetched from the cli then */
+            *answer = calloc(1, entry->value_len + 1);
+            if (*answer != NULL) {
+                memcpy(*answer, entry->value, entry->value_len);
+                hit = true;
+            }
+    }
+    if (hit == true) {
+        cache->file->hits++;
+    }
+    else {
+        cache->file->misses++;
+    }
+    flock(cache->fd, LOCK_UN);
+
+    return hit;
+}
+
+/* store the answer of a command */
+void m3_cli_cache_store(struct s_m3_cli_cache *cache, const char *command, const char *answer)
+{
+    struct s_m3_cli_cache_entry *entry;
+    size_t len, value_len;
+    uint32_t hash;
+
+    if (cache == NULL || command == NULL || answer == NULL) {
+        return;
+    }
+    len = strlen(command);
+    value_len = strlen(answer);
+    if (cache_ttl(cache, command, len) == 0 || value_len >= M3_CLI_CACHE_VALUE_MAX) {
+        return;
+    }
+
+    hash = cache_hash(command, len);
+    entry = &cache->file->entries[hash % M3_CLI_CACHE_ENTRIES];
+
+    flock(cache->fd, LOCK_EX);
+    entry->hash = hash;
+    entry->generation = cache->generation;
+    entry->stored_ns = cache_now_ns();
+    entry->key_len = len;
+    entry->value_len = value_len;
+    memcpy(entry->key, command, len);
+    memcpy(entry->value, answer, value_len);
+    cache->file->stores++;
+    flock(cache->fd, LOCK_UN);
+
+    return;
+}
+
+/* a command is going to be sent: invalidate the cache if it changes something */
+void m3_cli_cache_command(struct s_m3_cli_cache *cache, const char *command)
+{
+    if (cache == NULL || command == NULL) {
+        return;
+    }
+
+    if (strchr(command, '=') == NULL && strstr(command, "submit") == NULL && strstr(command, "activate") == NULL) {
+        return;
+    }
+
+    flock(cache->fd, LOCK_EX);
+    cache->file->generation++;
+    cache->file->invalidations++;
+    flock(cache->fd, LOCK_UN);
+
+    return;
+}
+
+/* print the hit and miss counters */
+void m3_cli_cache_print_stats(struct s_m3_cli_cache *cache, FILE *out)
+{
+    uint64_t hits, misses;
+
+    if (cache == NULL) {
+        return;
+    }
+
+    hits = cache->file->hits;
+    misses = cache->file->misses;
+    fprintf(out, "cache hits: %llu misses: %llu (%.1f%% hits) stores: %llu invalidations: %llu\n",
+            (unsigned long long) hits, (unsigned long long) misses,
+            (hits + misses) ? 100.0 * hits / (hits + misses) : 0.0,
+            (unsigned long long) cache->file->stores, (unsigned long long) cache->file->invalidations);
+
+    return;
+}
+
+/* unmap the file and free the struct */
+void m3_cli_cache_close(struct s_m3_cli_cache **cache)
+{
+    int i;
+
+    if (cache == NULL || *cache == NULL) {
+        return;
+    }
+
+    if ((*cache)->file != NULL) {
+        munmap((*cache)->file, sizeof(struct s_m3_cli_cache_file));
+    }
+    if ((*cache)->fd >= 0) {
+        close((*cache)->fd);
+    }
+    for (i = 0; i < (*cache)->ttls; i++) {
+        safefree((void **) &(*cache)->prefix[i]);
+    }
+    safefree((void **) cache);
+
+    return;
+}
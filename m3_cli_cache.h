@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* file shared by all processes using the cache, it is kept in a directory only root may write to */
+#define M3_CLI_CACHE_FILE           "/var/run/mcip-cli-cache"
+
+#define M3_CLI_CACHE_ENTRIES        256     /* number of cached answers */
+#define M3_CLI_CACHE_KEY_MAX        128     /* maximum length of a cached command */
+#define M3_CLI_CACHE_VALUE_MAX      1024    /* maximum length of a cached answer */
+#define M3_CLI_CACHE_TTLS_MAX       16      /* maximum number of key prefixes with an own TTL */
+
+/* cache of answers of read only "status." commands, it is shared between processes by a memory mapped file
+    every key prefix gets its own TTL (the longest matching prefix is used), e.g.
+    "status.cellular=2000,status.ethernet1=500,status.=1000"
+    commands that change something (key=value, submit, activate) invalidate the whole cache */
+struct s_m3_cli_cache {
+    int fd;                             /* file descriptor of the shared file */
+    struct s_m3_cli_cache_file *file;   /* the mapped file */
+    int ttls;                           /* number of TTLs */
+    char *prefix[M3_CLI_CACHE_TTLS_MAX];/* key prefixes */
+    int ttl_ms[M3_CLI_CACHE_TTLS_MAX];  /* TTL of the key prefixes */
+    uint32_t generation;                /* generation at the last lookup, the answer fetched after a miss is stored
+                                           with it, so an invalidation in between makes it stale right away */
+};
+
+/* open (and create) the cache file, it is created with mode 0600
+    ttl_spec    list of <prefix>=<ttl in ms> separated by ',' (NULL to only invalidate on changes)
+    on error, NULL is returned and errno set appropriately (EPERM if the file is no regular file, is owned by another
+    user or is accessible by others, the owner may grant access to a group) */
+struct s_m3_cli_cache *m3_cli_cache_open(const char *path, const char *ttl_spec);
+
+/* look up the answer of a command, the answer is allocated
+    returns false on a miss */
+bool m3_cli_cache_lookup(struct s_m3_cli_cache *cache, const char *command, char **answer);
+
+/* store the answer of a command (only if it is cacheable) after it has been looked up */
+void m3_cli_cache_store(struct s_m3_cli_cache *cache, const char *command, const char *answer);
+
+/* a command is going to be sent: invalidate the cache if it changes something */
+void m3_cli_cache_command(struct s_m3_cli_cache *cache, const char *command);
+
+/* print the hit and miss counters */
+void m3_cli_cache_print_stats(struct s_m3_cli_cache *cache, FILE *out);
+
+/* unmap the file and free the struct */
+void m3_cli_cache_close(struct s_m3_cli_cache **cache);
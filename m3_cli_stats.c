@@ -0,0 +1,259 @@
+#include "m3_cli_stats.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+
+/* number of signals received that ask for printing the statistics */
+static volatile sig_atomic_t stats_signals = 0;
+
+void safefree(void **pp);
+
+/* current time (CLOCK_MONOTONIC) in us */
+int64_t m3_cli_stats_now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* create the statistics of a session */
+struct s_m3_cli_stats *m3_cli_stats_create(FILE *out)
+{
+    struct s_m3_cli_stats *stats;
+
+    stats = calloc(1, sizeof(struct s_m3_cli_stats));
+    if (stats == NULL) {
+        return NULL;
+    }
+    stats->out = out;
+    stats->signals = stats_signals;
+
+    return stats;
+}
+
+/* entry of the prefix of a command: the first two parts of the key, setters get a '=' appended
+    e.g. "status.ethernet1.port[1].link" -> "status.ethernet1", "administration.hostnames.location=x" -> "administration.hostnames=" */
+static struct s_m3_cli_stats_entry *stats_entry(struct s_m3_cli_stats *stats, const char *command)
+{
+    char key[M3_CLI_STATS_KEY_MAX];
+    size_t len = 0;
+    int dots = 0, i;
+
+    while (command[len] != '\0' && strchr("= \t\r\n", command[len]) == NULL && len < M3_CLI_STATS_KEY_MAX - 2) {
+        if (command[len] == '.' && ++dots == 2) {
+            break;
+        }
+        len++;
+    }
+    memcpy(key, command, len);
+    if (strchr(command, '=') != NULL) {
+        key[len++] = '=';
+    }
+    key[len] = '\0';
+
+    for (i = 0; i < stats->keys; i++) {
+        if (strcmp(stats->entries[i].key, key) == 0) {
+            return &stats->entries[i];
+        }
+    }
+
+    /* the table is full: the last entry takes all other commands */
+    if (stats->keys == M3_CLI_STATS_KEYS) {
+        strcpy(stats->entries[M3_CLI_STATS_KEYS].key, "other");
+        return &stats->entries[M3_CLI_STATS_KEYS];
+    }
+    strcpy(stats->entries[stats->keys].key, key);
+
+    return &stats->entries[stats->keys++];
+}
+
+/* record a connect */
+void m3_cli_stats_connect(struct s_m3_cli_stats *stats, int64_t connect_us, int64_t handshake_us, bool ok)
+{
+    if (stats == NULL) {
+        return;
+    }
+
+    if (ok == false) {
+        stats->failed_connects++;
+        return;
+    }
+
+    histogram_record(&stats->connect, connect_us);
+    histogram_record(&stats->handshake, handshake_us);
+    if (stats->connects > 0) {
+        stats->reconnects++;
+    }
+    stats->connects++;
+
+    /* the commands written before are lost */
+    stats->pipeline_count = 0;
+
+    return;
+}
+
+/* record the result of a command of an entry */
+static void stats_record(struct s_m3_cli_stats *stats, struct s_m3_cli_stats_entry *entry, int64_t us, enum m3_cli_status status)
+{
+    if (status == M3_CLI_PROMPT) {
+        histogram_record(&entry->histogram, (us > 0) ? us : 0);
+    }
+    else if (status == M3_CLI_TIMEOUT) {
+        entry->timeouts++;
+        stats->timeouts++;
+    }
+    else {
+        stats->errors++;
+    }
+    return;
+}
+
+/* record the round trip time of a command */
+void m3_cli_stats_command(struct s_m3_cli_stats *stats, const char *command, int64_t us, enum m3_cli_status status)
+{
+    if (stats == NULL || command == NULL) {
+        return;
+    }
+
+    stats_record(stats, stats_entry(stats, command), us, status);
+
+    return;
+}
+
+/* a command has been written without waiting for the answer */
+void m3_cli_stats_written(struct s_m3_cli_stats *stats, const char *command)
+{
+    int i;
+
+    if (stats == NULL || command == NULL) {
+        return;
+    }
+
+    /* only the latest commands are timed */
+    if (stats->pipeline_count == M3_CLI_STATS_PIPELINE) {
+        stats->pipeline_head = (stats->pipeline_head + 1) % M3_CLI_STATS_PIPELINE;
+        stats->pipeline_count--;
+    }
+    i = (stats->pipeline_head + stats->pipeline_count) % M3_CLI_STATS_PIPELINE;
+    stats->pipeline[i] = m3_cli_stats_now_us();
+    stats->pipeline_entry[i] = stats_entry(stats, command);
+    stats->pipeline_count++;
+
+    return;
+}
+
+/* the answer of the oldest written command has been read */
+void m3_cli_stats_answered(struct s_m3_cli_stats *stats, enum m3_cli_status status)
+{
+    int i;
+
+    if (stats == NULL || stats->pipeline_count == 0) {
+        return;
+    }
+
+    i = stats->pipeline_head;
+    stats_record(stats, stats->pipeline_entry[i], m3_cli_stats_now_us() - stats->pipeline[i], status);
+    stats->pipeline_head = (i + 1) % M3_CLI_STATS_PIPELINE;
+    stats->pipeline_count--;
+
+    /* the session gets closed, the answers of the other commands are lost */
+    if (status != M3_CLI_PROMPT) {
+        stats->pipeline_count = 0;
+    }
+
+    return;
+}
+
+/* print one histogram */
+static void stats_print_histogram(FILE *out, const char *name, const struct s_histogram *histogram, uint64_t timeouts)
+{
+    fprintf(out, "%-32s %8llu %10llu %10llu %10llu %10llu %8llu\n", name,
+            (unsigned long long) histogram->count,
+            (unsigned long long) histogram_percentile(histogram, 50),
+            (unsigned long long) histogram_percentile(histogram, 90),
+            (unsigned long long) histogram_percentile(histogram, 99),
+            (unsigned long long) histogram->max,
+            (unsigned long long) timeouts);
+    return;
+}
+
+/* print count, p50, p90, p99 and max of every histogram as well as the counters */
+void m3_cli_stats_print(struct s_m3_cli_stats *stats, FILE *out)
+{
+    struct s_histogram *all;
+    int i;
+
+    if (stats == NULL || out == NULL) {
+        return;
+    }
+
+    fprintf(out, "%-32s %8s %10s %10s %10s %10s %8s\n", "cli latency [us]", "count", "p50", "p90", "p99", "max", "timeouts");
+    stats_print_histogram(out, "connect", &stats->connect, 0);
+    stats_print_histogram(out, "handshake", &stats->handshake, 0);
+
+    all = calloc(1, sizeof(struct s_histogram));
+    for (i = 0; i <= M3_CLI_STATS_KEYS; i++) {
+        if (stats->entries[i].key[0] == '\0') {
+            continue;
+        }
+        stats_print_histogram(out, stats->entries[i].key, &stats->entries[i].histogram, stats->entries[i].timeouts);
+        if (all != NULL) {
+            histogram_merge(all, &stats->entries[i].histogram);
+        }
+    }
+    if (all != NULL) {
+        stats_print_histogram(out, "all commands", all, stats->timeouts);
+        safefree((void **) &all);
+    }
+
+    fprintf(out, "connects: %llu reconnects: %llu failed connects: %llu timeouts: %llu errors: %llu\n",
+            (unsigned long long) stats->connects, (unsigned long long) stats->reconnects,
+            (unsigned long long) stats->failed_connects, (unsigned long long) stats->timeouts,
+            (unsigned long long) stats->errors);
+    fflush(out);
+
+    return;
+}
+
+/* signal handler: only count the request */
+static void stats_signal_handler(int signum)
+{
+    stats_signals++;
+    return;
+}
+
+/* print the statistics of all sessions whenever the signal arrives */
+bool m3_cli_stats_signal(int signum)
+{
+    struct sigaction sa;
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = stats_signal_handler;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+
+    return (sigaction(signum, &sa, NULL) == 0);
+}
+
+/* print the statistics if the signal has arrived since the last call */
+void m3_cli_stats_poll(struct s_m3_cli_stats *stats)
+{
+    if (stats == NULL || stats->signals == stats_signals) {
+        return;
+    }
+
+    stats->signals = stats_signals;
+    m3_cli_stats_print(stats, (stats->out != NULL) ? stats->out : stderr);
+
+    return;
+}
+
+/* free the statistics */
+void m3_cli_stats_free(struct s_m3_cli_stats **stats)
+{
+    safefree((void **) stats);
+    return;
+}
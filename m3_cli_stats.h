@@ -0,0 +1,71 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "histogram.h"
+#include "m3_cli.h"
+
+/* environment variable that enables the statistics of all sessions ("stdout" or anything else for stderr) */
+#define M3_CLI_STATS_ENV        "M3_CLI_STATS"
+
+#define M3_CLI_STATS_KEYS       32      /* number of command prefixes with an own histogram, the rest is "other" */
+#define M3_CLI_STATS_KEY_MAX    48      /* maximum length of a command prefix */
+#define M3_CLI_STATS_PIPELINE   64      /* number of written commands whose start time is kept for m3_cli_read_answer */
+
+struct s_m3_cli_stats_entry {
+    char key[M3_CLI_STATS_KEY_MAX];     /* command prefix, e.g. "status.ethernet1" or "administration.hostnames=" */
+    uint64_t timeouts;                  /* commands of this prefix that timed out */
+    struct s_histogram histogram;       /* round trip times in us */
+};
+
+/* latency statistics of a cli session, all times are taken from CLOCK_MONOTONIC in us */
+struct s_m3_cli_stats {
+    FILE *out;                          /* where the statistics are printed on shutdown and on a signal (NULL for never) */
+    struct s_histogram connect;         /* time to connect the socket */
+    struct s_histogram handshake;       /* time to read the prompt */
+    uint64_t connects;                  /* successful connects */
+    uint64_t reconnects;                /* connects after the first one */
+    uint64_t failed_connects;           /* connects or handshakes that failed */
+    uint64_t timeouts;                  /* commands that timed out */
+    uint64_t errors;                    /* commands that failed otherwise (EOF, socket errors) */
+    int signals;                        /* number of dump requests already handled */
+    int keys;                           /* number of used entries */
+    struct s_m3_cli_stats_entry entries[M3_CLI_STATS_KEYS + 1];
+    int pipeline_head;                  /* oldest written command */
+    int pipeline_count;                 /* number of written commands without answer */
+    int64_t pipeline[M3_CLI_STATS_PIPELINE];            /* start times of the written commands */
+    struct s_m3_cli_stats_entry *pipeline_entry[M3_CLI_STATS_PIPELINE];
+};
+
+/* current time (CLOCK_MONOTONIC) in us */
+int64_t m3_cli_stats_now_us(void);
+
+/* create the statistics of a session, they are printed to <out> on shutdown (if not NULL) */
+struct s_m3_cli_stats *m3_cli_stats_create(FILE *out);
+
+/* record a connect: the time it took to open the socket and to read the prompt (ok is false if it failed) */
+void m3_cli_stats_connect(struct s_m3_cli_stats *stats, int64_t connect_us, int64_t handshake_us, bool ok);
+
+/* record the round trip time of a command */
+void m3_cli_stats_command(struct s_m3_cli_stats *stats, const char *command, int64_t us, enum m3_cli_status status);
+
+/* a command has been written without waiting for the answer (pipelining) */
+void m3_cli_stats_written(struct s_m3_cli_stats *stats, const char *command);
+
+/* the answer of the oldest written command has been read (or the session has been closed if status is not M3_CLI_PROMPT) */
+void m3_cli_stats_answered(struct s_m3_cli_stats *stats, enum m3_cli_status status);
+
+/* print count, p50, p90, p99 and max of every histogram as well as the counters */
+void m3_cli_stats_print(struct s_m3_cli_stats *stats, FILE *out);
+
+/* print the statistics of all sessions whenever the signal arrives (e.g. SIGUSR1)
+    the signal only sets a flag, the statistics are printed by the next command of every session */
+bool m3_cli_stats_signal(int signum);
+
+/* print the statistics if the signal has arrived since the last call */
+void m3_cli_stats_poll(struct s_m3_cli_stats *stats);
+
+/* free the statistics */
+void m3_cli_stats_free(struct s_m3_cli_stats **stats);
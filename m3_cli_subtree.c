@@ -0,0 +1,205 @@
+#include "m3_cli_subtree.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+void safefree(void **pp);
+
+/* order of the values */
+static int subtree_compare(const void *a, const void *b)
+{
+    return strcmp(((const struct s_m3_cli_value *) a)->key, ((const struct s_m3_cli_value *) b)->key);
+}
+
+/* remove white space at the end of a string */
+static void subtree_rtrim(char *s)
+{
+    size_t len = strlen(s);
+
+    while (len > 0 && (s[len - 1] == ' ' || s[len - 1] == '\t' || s[len - 1] == '\r')) {
+        s[--len] = '\0';
+    }
+    return;
+}
+
+/* split the answer into lines of "key=value" and sort them */
+static bool subtree_index(struct s_m3_cli_subtree *tree)
+{
+    struct s_m3_cli_value *values;
+    size_t lines = 1;
+    char *line, *next, *eq;
+
+    for (line = tree->answer; (line = strchr(line, '\n')) != NULL; line++) {
+        lines++;
+    }
+    tree->values = calloc(lines, sizeof(struct s_m3_cli_value));
+    if (tree->values == NULL) {
+        errno = ENOMEM;
+        return false;
+    }
+    values = tree->values;
+
+    for (line = tree->answer; line != NULL; line = next) {
+        next = strchr(line, '\n');
+        if (next != NULL) {
+            *next++ = '\0';
+        }
+
+        /* lines without a value are not part of the index */
+        eq = strchr(line, '=');
+        if (eq == NULL) {
+            continue;
+        }
+        *eq = '\0';
+        while (*line == ' ' || *line == '\t') {
+            line++;
+        }
+        subtree_rtrim(line);
+        eq++;
+        while (*eq == ' ' || *eq == '\t') {
+            eq++;
+        }
+        subtree_rtrim(eq);
+        if (*line == '\0') {
+            continue;
+        }
+
+        values[tree->count].key = line;
+        values[tree->count].value = eq;
+        tree->count++;
+    }
+
+    qsort(values, tree->count, sizeof(struct s_m3_cli_value), subtree_compare);
+
+    return true;
+}
+
+/* fetch a whole branch in one round trip and index it */
+bool m3_cli_query_subtree(struct s_m3_cli *cli, char *branch, struct s_m3_cli_subtree **tree, int waittime_ms)
+{
+    char *answer = NULL;
+
+    if (cli == NULL || branch == NULL || tree == NULL) {
+        errno = EINVAL;
+        return false;
+    }
+
+    if (m3_cli_query(cli, branch, &answer, waittime_ms) == false) {
+        return false;
+    }
+    if (answer == NULL || *answer == '\0' || m3_cli_answer_failed(answer) == true) {
+        safefree((void **) &answer);
+        errno = EINVAL;
+        return false;
+    }
+
+    *tree = calloc(1, sizeof(struct s_m3_cli_subtree));
+    if (*tree == NULL) {
+        safefree((void **) &answer);
+        errno = ENOMEM;
+        return false;
+    }
+    (*tree)->branch = strdup(branch);
+    (*tree)->answer = answer;
+    if (subtree_index(*tree) == false) {
+        m3_cli_subtree_free(tree);
+        return false;
+    }
+
+    return true;
+}
+
+/* binary search of a key */
+static const char *subtree_find(const struct s_m3_cli_subtree *tree, const char *key)
+{
+    struct s_m3_cli_value needle, *found;
+
+    needle.key = key;
+    found = bsearch(&needle, tree->values, tree->count, sizeof(struct s_m3_cli_value), subtree_compare);
+
+    return (found != NULL) ? found->value : NULL;
+}
+
+/* compare "<branch>.<key>" with a key of the answer (like strcmp) without joining them */
+static int subtree_compare_full(const char *branch, size_t len, const char *key, const char *other)
+{
+    int c;
+
+    c = strncmp(branch, other, len);
+    if (c != 0) {
+        return c;
+    }
+    if (other[len] != '.') {
+        return '.' - (unsigned char) other[len];
+    }
+
+    return strcmp(key, other + len + 1);
+}
+
+/* binary search of the key relative to the branch */
+static const char *subtree_find_full(const struct s_m3_cli_subtree *tree, size_t len, const char *key)
+{
+    size_t low = 0, high = tree->count, mid;
+    int c;
+
+    while (low < high) {
+        mid = low + (high - low) / 2;
+        c = subtree_compare_full(tree->branch, len, key, tree->values[mid].key);
+        if (c == 0) {
+            return tree->values[mid].value;
+        }
+        if (c < 0) {
+            high = mid;
+        }
+        else {
+            low = mid + 1;
+        }
+    }
+
+    return NULL;
+}
+
+/* look up a value by its full key or the key relative to the branch */
+const char *m3_cli_subtree_get(const struct s_m3_cli_subtree *tree, const char *key)
+{
+    const char *value;
+    size_t len;
+
+    if (tree == NULL || key == NULL) {
+        return NULL;
+    }
+
+    value = subtree_find(tree, key);
+    if (value != NULL) {
+        return value;
+    }
+
+    /* the cli answers with full keys, but the key is relative to the branch */
+    len = strlen(tree->branch);
+    if (strncmp(key, tree->branch, len) != 0) {
+        return subtree_find_full(tree, len, key);
+    }
+
+    /* the cli answers with relative keys, but the key is a full one */
+    if (key[len] == '.') {
+        return subtree_find(tree, key + len + 1);
+    }
+
+    return NULL;
+}
+
+/* free the subtree */
+void m3_cli_subtree_free(struct s_m3_cli_subtree **tree)
+{
+    if (tree == NULL || *tree == NULL) {
+        return;
+    }
+
+    safefree((void **) &(*tree)->branch);
+    safefree((void **) &(*tree)->answer);
+    safefree((void **) &(*tree)->values);
+    safefree((void **) tree);
+
+    return;
+}
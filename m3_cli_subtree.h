@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "m3_cli.h"
+
+/* one value of a subtree, key and value point into the answer */
+struct s_m3_cli_value {
+    const char *key;
+    const char *value;
+};
+
+/* a whole cli branch fetched by one query, indexed by key for local lookups */
+struct s_m3_cli_subtree {
+    char *branch;                       /* branch that has been queried */
+    char *answer;                       /* answer of the cli, split into keys and values */
+    struct s_m3_cli_value *values;      /* values sorted by key */
+    size_t count;                       /* number of values */
+};
+
+/* fetch a whole branch (e.g. "status.ethernet1") in one round trip and index the "key=value" lines of the answer
+    an unknown branch (the first line of the answer is an error of the cli, see m3_cli_answer_failed) is reported as EINVAL
+    on error, false is returned and errno set appropriately */
+bool m3_cli_query_subtree(struct s_m3_cli *cli, char *branch, struct s_m3_cli_subtree **tree, int waittime_ms);
+
+/* look up a value by its full key (e.g. "status.ethernet1.port[1].link") or the key relative to the branch
+    (e.g. "port[1].link"), returns NULL if the key is not part of the subtree */
+const char *m3_cli_subtree_get(const struct s_m3_cli_subtree *tree, const char *key);
+
+/* free the subtree */
+void m3_cli_subtree_free(struct s_m3_cli_subtree **tree);
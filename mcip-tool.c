@@ -1,182 +1,696 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
 #include <getopt.h>
 #include <stdbool.h>
+#include <unistd.h>
+#include <time.h>
+#include <signal.h>
+#include <poll.h>
 #include <arpa/inet.h>
 #include <sys/utsname.h>
 
 #include "libmcip.h"
 #include "m3_cli.h"
+#include "m3_cli_broker.h"
+#include "m3_cli_cache.h"
+#include "m3_cli_stats.h"
+#include "m3_cli_subtree.h"
+#include "sms_sender.h"
+#include "sms_spool.h"
+#include "mcip_listener.h"
+#include "mcip_hub.h"
+#include "mcip_event.h"
+#include "event_sink.h"
+#include "event_filter.h"
+#include "pulse_aggregate.h"
+#include "event_handler.h"
+#include "event_latency.h"
+#include "mcip_sender.h"
+
+#define M3_CLI_UDS_SOCKET   "/devices/cli_no_auth/cli.socket"
 
 void safefree(void **pp);
 
-/* read from MCIP */
-static bool read_from_mcip(int sock, bool listen)
+/* stop listening on SIGINT and SIGTERM */
+static void stop_listening(struct s_event_loop *loop, int fd, uint32_t signum, void *ctx)
 {
-    int i = 0;
-    int x = 0;
-    int sel = 0;
-    int length = 0;
-    fd_set fds_master, fds_tmp;
-    struct timeval tv;
-    uint8_t p[1500];
-
-    FD_ZERO(&fds_master);
-    FD_SET(sock, &fds_master);
-    for(; listen == true; ) {
-        FD_ZERO(&fds_tmp);
-        fds_tmp = fds_master;
-        tv.tv_sec = 10;
-        tv.tv_usec = 0;
-        sel = select(sock + 1, &fds_tmp, NULL, NULL, &tv);
-        if(sel > 0) {
-            /* read everything from socket */
-            if(FD_ISSET(sock, &fds_tmp)) {
-                x = read(sock, p + length, 1500 - length);
-
-                if(x > 0) {
-                    length += x;
-                }
-                else if(x == -1) {
-                    break;
-                }
-                else {
-                    sleep(1);
-                }
-            }
+    event_loop_stop(loop);
+    return;
+}
+
+/* create the event loop of a listener, it stops on SIGINT and SIGTERM, so the listener can deregister */
+static struct s_event_loop *create_listener_loop(void)
+{
+    static const int signals[] = { SIGINT, SIGTERM, 0 };
+    struct s_event_loop *loop;
+
+    loop = event_loop_create();
+    if (loop == NULL) {
+        printf("Failed to create the event loop (%d): %s\n", errno, strerror(errno));
+        return NULL;
+    }
+    if (event_loop_signals(loop, signals, stop_listening, NULL) == -1) {
+        printf("Failed to receive signals (%d): %s\n", errno, strerror(errno));
+        event_loop_free(&loop);
+        return NULL;
+    }
+
+    return loop;
+}
+
+/* options of the output of a listener, NULL (false) for the defaults */
+struct s_event_options {
+    char *filter;               /* --filter */
+    char *aggregate;            /* --aggregate */
+    char *exec;                 /* --exec-persistent */
+    char *format;               /* --format */
+    char *flush;                /* --flush */
+    bool timestamps;            /* --timestamps */
+    bool latency;               /* --latency */
+};
+
+/* events printed by a listener */
+struct s_event_listener {
+    bool all;                   /* print every telegram, not only the ones of type */
+    enum mcip_event_type type;  /* type of the events to print */
+    bool perma;                 /* do not exit after the first event */
+    struct s_event_filter filter;   /* only events matching the filter are printed */
+    struct s_event_sink sink;   /* output of the events */
+    bool aggregating;           /* pulses are summed, a summary is printed for every window */
+    struct s_pulse_aggregate aggregate;
+    bool handling;              /* the events are passed to a persistent handler instead of the output */
+    struct s_event_handler handler;
+    bool tracing;               /* the latency of the events is recorded */
+    struct s_event_latency latency;
+};
+
+static void close_event_listener(struct s_event_listener *events);
+
+/* initialise the output of a listener */
+static bool init_event_listener(struct s_event_listener *events, bool all, enum mcip_event_type type, bool perma, const struct s_event_options *options)
+{
+    memset(events, 0, sizeof(struct s_event_listener));
+    events->all = all;
+    events->type = type;
+    events->perma = perma;
+    events->tracing = options->latency;
+
+    if (options->filter != NULL && event_filter_compile(&events->filter, options->filter) == false) {
+        if (errno == E2BIG) {
+            printf("The filter is too long: %s\n", options->filter);
         }
+        else {
+            printf("Invalid filter: %s\n%*s^\n", options->filter, 16 + events->filter.error, "");
+        }
+        return false;
+    }
 
-        /* check if length of received telegram is already here */
-        if (length >= 5) {
-            /* check if telegram is already complete */
-            if (length >= (p[3] | p[4] << 8)) {
-                /* print the received telegram */
-                for(i = i; i < length; i++) {
-                    printf("%c", p[i]);
-                }
-                printf("\n");
+    if (event_sink_init(&events->sink, STDOUT_FILENO, options->format, options->flush) == false) {
+        printf("Invalid output format \"%s\" or flush policy \"%s\"\n", options->format ? options->format : "raw", options->flush ? options->flush : "event");
+        event_sink_free(&events->sink);
+        return false;
+    }
+    events->sink.stamps = options->timestamps;
+
+    /* the summaries are printed until the tool is stopped */
+    if (options->aggregate != NULL) {
+        if (pulse_aggregate_init(&events->aggregate, options->aggregate, &events->sink) == false) {
+            printf("Invalid interval \"%s\" (or binary format) for the aggregation\n", options->aggregate);
+            event_sink_free(&events->sink);
+            return false;
+        }
+        events->aggregating = true;
+        events->perma = true;
+    }
 
-                listen = false;
-            }
+    /* the handler is started with the loop */
+    if (options->exec != NULL) {
+        if (options->aggregate != NULL) {
+            printf("The aggregated pulses cannot be passed to an event handler\n");
+            close_event_listener(events);
+            return false;
         }
+        if (event_handler_init(&events->handler, options->exec, options->format) == false) {
+            printf("Failed to initialise the event handler (%d): %s\n", errno, strerror(errno));
+            close_event_listener(events);
+            return false;
+        }
+        events->handler.format.stamps = options->timestamps;
+        events->handling = true;
+        events->perma = true;
     }
 
     return true;
 }
 
-/* init CLI session */
-static bool init_cli(struct s_m3_cli **cli)
+/* print the latency of the events on SIGUSR1 */
+static void print_latency(struct s_event_loop *loop, int fd, uint32_t signum, void *ctx)
 {
-    char *M3_CLI_UDS_SOCKET = "/devices/cli_no_auth/cli.socket";
+    struct s_event_listener *events = ctx;
 
-    /* initialise the CLI, opens the socket and retrieves the prompt */
-    *cli = m3_cli_initialise(M3_CLI_UDS_SOCKET, 300);
-    if (*cli == NULL) {
-        printf("Failed to initialise CLI (%d): %s\n", errno, strerror(errno));
-        printf("Maybe the container has not been added to the \"Read/Write\" user group for access the CLI without authentication?");
+    event_latency_print(&events->latency, stderr);
+    return;
+}
+
+/* start the timers of a listener on the loop, the latency is printed on SIGUSR1 */
+static bool attach_event_listener(struct s_event_listener *events, struct s_event_loop *loop)
+{
+    static const int signals[] = { SIGUSR1, 0 };
+
+    if (event_sink_attach(&events->sink, loop) == false) {
+        printf("Failed to start the flush timer (%d): %s\n", errno, strerror(errno));
+        return false;
+    }
+    if (events->aggregating == true && pulse_aggregate_attach(&events->aggregate, loop) == false) {
+        printf("Failed to start the aggregation timer (%d): %s\n", errno, strerror(errno));
+        return false;
+    }
+    if (events->handling == true && event_handler_start(&events->handler, loop) == false) {
+        printf("Failed to start the event handler (%d): %s\n", errno, strerror(errno));
+        return false;
+    }
+    if (events->tracing == true && event_loop_signals(loop, signals, print_latency, events) == -1) {
+        printf("Failed to receive signals (%d): %s\n", errno, strerror(errno));
         return false;
     }
 
     return true;
 }
 
+/* print the last summary and the latency, flush the output and free it, this must be done before the loop is freed */
+static void close_event_listener(struct s_event_listener *events)
+{
+    if (events->tracing == true) {
+        event_latency_print(&events->latency, stderr);
+        events->tracing = false;
+    }
+    if (events->handling == true) {
+        event_handler_free(&events->handler);
+        events->handling = false;
+    }
+    if (events->aggregating == true) {
+        pulse_aggregate_free(&events->aggregate);
+        events->aggregating = false;
+    }
+    event_sink_free(&events->sink);
+    return;
+}
+
+/* print a received event, returns if the tool should keep listening */
+static bool handle_event(const uint8_t *p, size_t length, const struct s_mcip_stamps *stamps, void *ctx)
+{
+    struct s_event_listener *events = ctx;
+    struct s_mcip_event event;
+    int64_t filtered = 0;
+    bool ok = true;
+
+    mcip_event_decode(&event, p, length);
+    event.stamps = *stamps;
+
+    /* only print if we should, e.g. get-input prints only input change events and get-pulses only pulse events;
+       do not abort after a wrong event, when the tool should exit after one event */
+    if ((events->all == false && event.type != events->type) || event_filter_match(&events->filter, &event) == false) {
+        if (events->tracing == true) {
+            event_latency_record(&events->latency, stamps, mcip_event_now_ns(), 0);
+        }
+        return true;
+    }
+    if (events->tracing == true) {
+        filtered = mcip_event_now_ns();
+    }
+
+    if (events->aggregating == true) {
+        pulse_aggregate_add(&events->aggregate, &event, &stamps->realtime);
+    }
+    else if (events->handling == true) {
+        /* a handler that is too slow loses events, they are counted and reported on exit */
+        event_handler_send(&events->handler, &event);
+    }
+    else if (event_sink_write(&events->sink, &event) == false) {
+        printf("Failed to write the event (%d): %s\n", errno, strerror(errno));
+        ok = false;
+    }
+
+    if (events->tracing == true) {
+        event_latency_record(&events->latency, stamps, filtered, mcip_event_now_ns());
+    }
+
+    return (ok == true && events->perma == true);
+}
+
+/* listen for MCIP telegrams and print the events until the tool should exit, MCIP is not available any more or a signal
+    stops it; the telegrams are received from the MCIP hub with the subscription, if it is not NULL
+    the output of the events is flushed and freed */
+static int listen_mcip(uint16_t my_oid, char *subscription, struct s_event_listener *events)
+{
+    struct s_event_loop *loop;
+    struct s_mcip_listener listener;
+    int ret = 0;
+
+    loop = create_listener_loop();
+    if (loop == NULL) {
+        close_event_listener(events);
+        return -1;
+    }
+    if (attach_event_listener(events, loop) == false) {
+        close_event_listener(events);
+        event_loop_free(&loop);
+        return -1;
+    }
+    if (subscription != NULL) {
+        if (mcip_listener_open_hub(&listener, loop, mcip_hub_socket(), subscription, handle_event, events) == false) {
+            close_event_listener(events);
+            event_loop_free(&loop);
+            return -1;
+        }
+    }
+    else if (mcip_listener_open(&listener, loop, &my_oid, 1, handle_event, events) == false) {
+        close_event_listener(events);
+        event_loop_free(&loop);
+        return -1;
+    }
+
+    if (event_loop_run(loop) == false) {
+        printf("Failed to wait for MCIP (%d): %s\n", errno, strerror(errno));
+        ret = -1;
+    }
+    if (listener.failed == true) {
+        ret = -1;
+    }
+
+    mcip_listener_close(&listener);
+    close_event_listener(events);
+    event_loop_free(&loop);
+
+    return ret;
+}
+
+/* init CLI session
+    cache_ttls  TTLs of the status values cached (see m3_cli_cache.h), if NULL they are taken from the environment
+                variable M3_CLI_CACHE; the cache is also attached without TTLs if it exists, so changes invalidate it */
+static bool init_cli(struct s_m3_cli **cli, char *cache_ttls)
+{
+    char *socket_path;
+    bool ok = false;
+
+    if (cache_ttls == NULL) {
+        cache_ttls = getenv("M3_CLI_CACHE");
+    }
+
+    /* the latency statistics are printed on exit and on SIGUSR1 */
+    if (getenv(M3_CLI_STATS_ENV) != NULL) {
+        m3_cli_stats_signal(SIGUSR1);
+    }
+
+    /* another socket (e.g. of a fake CLI for benchmarks) is used as is */
+    socket_path = getenv("M3_CLI_SOCKET");
+    if (socket_path == NULL) {
+        socket_path = M3_CLI_UDS_SOCKET;
+
+        /* use the CLI broker if it is running, it already has a session open */
+        if (access(M3_CLI_BROKER_SOCKET, F_OK) == 0) {
+            *cli = m3_cli_initialise(M3_CLI_BROKER_SOCKET, 300);
+            ok = (*cli != NULL);
+        }
+    }
+
+    /* initialise the CLI, opens the socket and retrieves the prompt */
+    if (ok == false) {
+        *cli = m3_cli_initialise(socket_path, 300);
+        if (*cli == NULL) {
+            printf("Failed to initialise CLI (%d): %s\n", errno, strerror(errno));
+            printf("Maybe the container has not been added to the \"Read/Write\" user group for access the CLI without authentication?");
+            return false;
+        }
+    }
+
+    /* attach the cache of status values */
+    if (cache_ttls != NULL || access(M3_CLI_CACHE_FILE, F_OK) == 0) {
+        (*cli)->cache = m3_cli_cache_open(M3_CLI_CACHE_FILE, cache_ttls);
+        if ((*cli)->cache == NULL) {
+            printf("Failed to open the CLI cache (%d): %s\n", errno, strerror(errno));
+        }
+    }
+
+    return true;
+}
+
+/* print the step of a transaction, that failed */
+static void print_transaction_error(struct s_m3_cli_action *actions, char **errors, int count)
+{
+    int err = errno;
+    int i;
+
+    for (i = 0; i < count - 1 && actions[i].answer != NULL; i++);
+    printf("Failed to %s (%d): %s\n", errors[i], err, strerror(err));
+
+    return;
+}
+
 /* send as SMS via CLI */
 static bool send_sms(char *number, char *text, char *modem)
 {
     struct s_m3_cli *cli = NULL;
-    char *cli_answer = NULL;
-    char buffer[1000] = { 0 };
+    char modem_cmd[1000] = { 0 };
+    char recipient_cmd[1000] = { 0 };
+    char *text_cmd = NULL;
+    char submit_cmd[] = "help.debug.sms.submit=1";
+    struct s_m3_cli_action actions[4];
+    char *errors[] = { "set modem to use", "set the recipient phone number", "set the SMS text", "set the SMS" };
+    int i;
 
     /* initialise the CLI, opens the socket and retrieves the prompt */
-    if (init_cli(&cli) == false) {
+    if (init_cli(&cli, NULL) == false) {
         return false;
     }
 
-    /* configure the modem that should be used */
-    if (modem != NULL) {
-        sprintf(buffer, "help.debug.sms.modem=%s", modem);
+    /* configure the modem that should be used, the recipients phone number and the SMS text, then submit */
+    snprintf(modem_cmd, sizeof(modem_cmd), "help.debug.sms.modem=%s", (modem != NULL) ? modem : "lte2");
+    snprintf(recipient_cmd, sizeof(recipient_cmd), "help.debug.sms.recipient=%s", number);
+    text_cmd = calloc(1, strlen(text) + 64);
+    if (text_cmd == NULL) {
+        printf("Failed to allocate the SMS text\n");
+        m3_cli_shutdown(&cli);
+        return false;
+    }
+    sprintf(text_cmd, "help.debug.sms.text=-----BEGIN ...-----%s-----END ...-----", text);
+
+    /* all commands are sent at once */
+    actions[0].command = modem_cmd;
+    actions[1].command = recipient_cmd;
+    actions[2].command = text_cmd;
+    actions[3].command = submit_cmd;
+    if (m3_cli_transaction(cli, actions, 4, 60000) == false) {
+        print_transaction_error(actions, errors, 4);
+        m3_cli_transaction_free(actions, 4);
+        safefree((void **) &text_cmd);
+        m3_cli_shutdown(&cli);
+        return false;
+    }
+
+    /* the same check as for many recipients: a step, that the cli answered with an error */
+    for (i = 0; i < 4; i++) {
+        if (m3_cli_answer_failed(actions[i].answer)) {
+            printf("Failed to %s: %s\n", errors[i], (actions[i].answer != NULL) ? actions[i].answer : "no answer");
+            m3_cli_transaction_free(actions, 4);
+            safefree((void **) &text_cmd);
+            m3_cli_shutdown(&cli);
+            return false;
+        }
+    }
+
+    printf("SMS sending %s\n", actions[3].answer);
+    m3_cli_transaction_free(actions, 4);
+    safefree((void **) &text_cmd);
+
+    m3_cli_shutdown(&cli);
+
+    return true;
+}
+
+/* print the result of an SMS sent to one of many recipients */
+static void print_sms_result(struct s_sms_message *message, void *ctx)
+{
+    if (message->sent == true) {
+        printf("%s: sent in %lld ms: %s\n", message->number, (long long) message->duration_us / 1000, message->result);
     }
     else {
-        sprintf(buffer, "help.debug.sms.modem=lte2");
+        printf("%s: failed: %s\n", message->number, message->result);
     }
-    if (m3_cli_send(cli, buffer) == false) {
-        printf("Failed to set modem to use (%d): %s\n", errno, strerror(errno));
-        return false;
+    fflush(stdout);
+    return;
+}
+
+/* free the messages read from a recipient list */
+static void free_recipients(struct s_sms_message *messages, int count)
+{
+    int i;
+
+    for (i = 0; i < count; i++) {
+        safefree((void **) &messages[i].number);
+        safefree((void **) &messages[i].text);
+        safefree((void **) &messages[i].result);
     }
+    safefree((void **) &messages);
+    return;
+}
 
-    /* configure the recipients phone number */
-    sprintf(buffer, "help.debug.sms.recipient=%s", number);
-    if (m3_cli_send(cli, buffer) == false) {
-        printf("Failed to set the recipient phone number (%d): %s\n", errno, strerror(errno));
+/* read a recipient list: every line holds a number, optionally followed by an own text (otherwise the given text is used)
+    lines without a text are reported and counted in *failed
+    on error, false is returned */
+static bool read_recipients(char *file, char *text, char *modem, struct s_sms_message **messages, int *count, int *failed)
+{
+    FILE *input;
+    char *line = NULL;
+    char *number, *own_text;
+    size_t line_size = 0;
+    ssize_t len;
+
+    if (strcmp(file, "-") == 0) {
+        input = stdin;
+    }
+    else if ((input = fopen(file, "r")) == NULL) {
+        printf("Failed to open %s (%d): %s\n", file, errno, strerror(errno));
         return false;
     }
 
-    /* configure the SMS text */
-    sprintf(buffer, "help.debug.sms.text=-----BEGIN ...-----%s-----END ...-----", text);
-    if (m3_cli_send(cli, buffer) == false) {
-        printf("Failed to set the SMS text (%d): %s\n", errno, strerror(errno));
-        return false;
+    while ((len = getline(&line, &line_size, input)) != -1) {
+        while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) {
+            line[--len] = '\0';
+        }
+        number = line + strspn(line, " \t");
+        /* skip empty lines and comments */
+        if (number[0] == '\0' || number[0] == '#') {
+            continue;
+        }
+        own_text = number + strcspn(number, " \t");
+        if (own_text[0] != '\0') {
+            *own_text++ = '\0';
+            own_text += strspn(own_text, " \t");
+        }
+        if (own_text[0] == '\0' && text == NULL) {
+            printf("%s: failed: no text\n", number);
+            (*failed)++;
+            continue;
+        }
+
+        *messages = realloc(*messages, (*count + 1) * sizeof(struct s_sms_message));
+        memset(&(*messages)[*count], 0, sizeof(struct s_sms_message));
+        (*messages)[*count].number = strdup(number);
+        (*messages)[*count].text = strdup((own_text[0] != '\0') ? own_text : text);
+        (*messages)[*count].modem = (modem != NULL) ? modem : "lte2";
+        (*count)++;
+    }
+    safefree((void **) &line);
+    if (input != stdin) {
+        fclose(input);
     }
 
-    /* send the submit command */
-    if (m3_cli_query(cli, "help.debug.sms.submit=1", &cli_answer, 60000) == false) {
-        printf("Failed to set the SMS (%d): %s\n", errno, strerror(errno));
+    if (*count == 0) {
+        printf("No recipient has been given\n");
         return false;
     }
 
-    printf("SMS sending %s\n", cli_answer);
-    safefree((void **) & cli_answer);
+    return true;
+}
+
+/* send SMS to all recipients of a file over one CLI session
+    returns the number of SMS that have not been sent */
+static int send_sms_bulk(char *file, char *text, char *modem)
+{
+    struct s_m3_cli *cli = NULL;
+    struct s_sms_session session;
+    struct s_sms_message *messages = NULL;
+    int count = 0, failed = 0, unsent;
+    int64_t start;
+
+    if (read_recipients(file, text, modem, &messages, &count, &failed) == false) {
+        free_recipients(messages, count);
+        return failed + 1;
+    }
+
+    /* initialise the CLI, opens the socket and retrieves the prompt */
+    if (init_cli(&cli, NULL) == false) {
+        failed += count;
+    }
+    else {
+        memset(&session, 0, sizeof(session));
+        session.cli = cli;
+        start = m3_cli_stats_now_us();
+        unsent = sms_send(&session, messages, count, print_sms_result, NULL);
+        printf("Sent %d of %d SMS in %.1f s (%.2f SMS/s)\n", count - unsent, count,
+               (m3_cli_stats_now_us() - start) / 1e6, (count - unsent) * 1e6 / (m3_cli_stats_now_us() - start + 1));
+        failed += unsent;
+        sms_session_free(&session);
+        m3_cli_shutdown(&cli);
+    }
+
+    free_recipients(messages, count);
+
+    return failed;
+}
+
+/* append SMS to the spool of the SMS daemon, the CLI is not used
+    file is a recipient list (see read_recipients) or NULL to queue one SMS to number
+    returns the number of SMS that have not been queued */
+static int queue_sms(char *spool, char *file, char *number, char *text, char *modem)
+{
+    struct s_sms_message *messages = NULL;
+    int count = 0, failed = 0, queued = 0, i;
+
+    if (sms_spool_create(spool) == false) {
+        printf("Failed to create the spool %s (%d): %s\n", spool, errno, strerror(errno));
+        return 1;
+    }
+
+    if (file == NULL) {
+        if (sms_spool_enqueue(spool, (modem != NULL) ? modem : "lte2", number, text) == false) {
+            printf("Failed to queue the SMS (%d): %s\n", errno, strerror(errno));
+            return 1;
+        }
+        printf("SMS queued\n");
+        return 0;
+    }
+
+    if (read_recipients(file, text, modem, &messages, &count, &failed) == false) {
+        free_recipients(messages, count);
+        return failed + 1;
+    }
+    for (i = 0; i < count; i++) {
+        if (sms_spool_enqueue(spool, messages[i].modem, messages[i].number, messages[i].text) == false) {
+            printf("%s: failed to queue (%d): %s\n", messages[i].number, errno, strerror(errno));
+            failed++;
+        }
+        else {
+            queued++;
+        }
+    }
+    printf("Queued %d of %d SMS\n", queued, count);
+    free_recipients(messages, count);
+
+    return failed;
+}
+
+static volatile sig_atomic_t sms_daemon_stop = 0;
+
+/* signal handler of the SMS daemon */
+static void sms_daemon_signal(int signum)
+{
+    sms_daemon_stop = 1;
+    return;
+}
+
+/* send the SMS of the spool until SIGTERM or SIGINT
+    the CLI session is kept open, it is initialised again with a backoff as long as the CLI is not available */
+static int sms_daemon(char *spool, int rate)
+{
+    struct s_m3_cli *cli = NULL;
+    struct s_sms_session session;
+    struct sigaction action;
+    int backoff_ms = SMS_SPOOL_BACKOFF_MIN_MS;
+    int ret;
+
+    if (sms_spool_create(spool) == false) {
+        printf("Failed to create the spool %s (%d): %s\n", spool, errno, strerror(errno));
+        return -1;
+    }
+
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = sms_daemon_signal;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGTERM, &action, NULL);
+    sigaction(SIGINT, &action, NULL);
+
+    while (sms_daemon_stop == 0 && init_cli(&cli, NULL) == false) {
+        printf("\nRetrying in %d s\n", backoff_ms / 1000);
+        fflush(stdout);
+        poll(NULL, 0, backoff_ms);
+        backoff_ms = (backoff_ms * 2 < SMS_SPOOL_BACKOFF_MAX_MS) ? backoff_ms * 2 : SMS_SPOOL_BACKOFF_MAX_MS;
+    }
+    if (cli == NULL) {
+        return 0;
+    }
+
+    memset(&session, 0, sizeof(session));
+    session.cli = cli;
+    ret = sms_spool_run(spool, &session, rate, print_sms_result, NULL, &sms_daemon_stop);
+    if (ret == -1) {
+        printf("Failed to read the spool %s (%d): %s\n", spool, errno, strerror(errno));
+    }
 
+    sms_session_free(&session);
     m3_cli_shutdown(&cli);
 
-    return true;
+    return ret;
 }
 
-/* switch_output */
-static bool switch_output(char *output, char *state)
+/* switch several outputs over one CLI session
+    the commands (output, state and submit for every output) are sent at once, so the outputs change within a short
+    time window, the result is printed for every output
+    returns the number of outputs, that failed */
+static int switch_outputs(char **outputs, char **states, int count)
 {
-    char *M3_CLI_UDS_SOCKET = "/devices/cli_no_auth/cli.socket";
     struct s_m3_cli *cli = NULL;
-    char *cli_answer = NULL;
-    char buffer[1000] = { 0 };
+    struct s_m3_cli_action *actions;
+    char submit_cmd[] = "help.debug.output.submit";
+    char *reason;
+    int failed = 0;
+    int i, k;
+
+    if (count < 1 || 3 * count > M3_CLI_TRANSACTION_MAX) {
+        printf("The number of outputs must be in range of 1 to %d\n", M3_CLI_TRANSACTION_MAX / 3);
+        return count;
+    }
 
     /* initialise the CLI, opens the socket and retrieves the prompt */
-    cli = m3_cli_initialise(M3_CLI_UDS_SOCKET, 300);
-    if (cli == NULL) {
-        printf("Failed to initialise CLI (%d): %s\n", errno, strerror(errno));
-        printf("Maybe the container has not been added to the \"Read/Write\" user group for access the CLI without authentication?");
-        return false;
+    if (init_cli(&cli, NULL) == false) {
+        return count;
     }
 
-    /* determine output */
-    sprintf(buffer, "help.debug.output.output=%s", output);
-    if (m3_cli_send(cli, buffer) == false) {
-        printf("Failed to determine output %s (%d): %s\n", output, errno, strerror(errno));
-        return false;
+    /* determine output and state, then submit */
+    actions = calloc(3 * count, sizeof(struct s_m3_cli_action));
+    for (i = 0; i < count; i++) {
+        actions[3 * i].command = calloc(1, strlen(outputs[i]) + 32);
+        sprintf(actions[3 * i].command, "help.debug.output.output=%s", outputs[i]);
+        actions[3 * i + 1].command = calloc(1, strlen(states[i]) + 32);
+        sprintf(actions[3 * i + 1].command, "help.debug.output.change=%s", states[i]);
+        actions[3 * i + 2].command = submit_cmd;
     }
 
-    /* determine state  */
-    sprintf(buffer, "help.debug.output.change=%s", state);
-    if (m3_cli_send(cli, buffer) == false) {
-        printf("Failed to set state of output %s (%d): %s\n", state, errno, strerror(errno));
-        return false;
+    /* the answers received before a failure are still evaluated */
+    if (m3_cli_transaction(cli, actions, 3 * count, 6000) == false) {
+        printf("Failed to send the commands (%d): %s\n", errno, strerror(errno));
     }
 
-    /* submit */
-    sprintf(buffer, "help.debug.output.submit");
-    if (m3_cli_send(cli, buffer) == false) {
-        printf("Failed to set the the output %s (%d): %s\n", output, errno, strerror(errno));
-        return false;
+    for (i = 0; i < count; i++) {
+        reason = NULL;
+        for (k = 3 * i; k < 3 * i + 3 && reason == NULL; k++) {
+            if (m3_cli_answer_failed(actions[k].answer)) {
+                reason = (actions[k].answer != NULL) ? actions[k].answer : "no answer";
+            }
+        }
+        if (reason == NULL) {
+            printf("Output set: %s to %s\n", outputs[i], states[i]);
+        }
+        else {
+            printf("Failed to set output %s to %s: %s\n", outputs[i], states[i], reason);
+            failed++;
+        }
     }
 
-    printf("Output set: %s to %s\n", output, state);
-    safefree((void **) & cli_answer);
+    m3_cli_transaction_free(actions, 3 * count);
+    for (i = 0; i < count; i++) {
+        safefree((void **) &actions[3 * i].command);
+        safefree((void **) &actions[3 * i + 1].command);
+    }
+    safefree((void **) &actions);
 
     m3_cli_shutdown(&cli);
 
-    return true;
+    return failed;
 }
 
 /* print all applet names of this multi binary */
@@ -209,6 +723,33 @@ static void usage_tool(void)
             "  -l, --listen          Listen for a message, print it on the console and exit.\n"   \
             "  -s, --send \"value\"    Send the <value> to the OID given.\n"                      \
             "  -p, --permanently     Do not exit after receiving an MCIP telegram.\n"             \
+            "  -o, --format value    Output of the received telegrams: raw (default), json, csv\n" \
+            "                        or binary (length in network byte order and telegram).\n"  \
+            "  -F, --flush value     Write the output after every telegram (event, default),\n"  \
+            "                        every <n> telegrams (<n>) or every <n> ms (<n>ms).\n"      \
+            "  -T, --timestamps      Add the receive time (UTC) and CLOCK_MONOTONIC (ns) to every\n" \
+            "                        telegram (raw: only the time).\n"                         \
+            "  -L, --latency         Print the latency of the listener on exit and on SIGUSR1\n" \
+            "                        to stderr.\n"                                               \
+            "\n"                                                                                  \
+            "  -I, --send-stdin      Send every message read from stdin to the OID given, then\n" \
+            "                        print the messages, telegrams and rates sent.\n"            \
+            "  -f, --framing value   Messages on stdin: one per line (line, default) or prefixed\n" \
+            "                        by their length in network byte order (length).\n"        \
+            "  -c, --coalesce value  Join messages (separated by '\\n') into one telegram up to\n" \
+            "                        <value> bytes (default 0: one message per telegram), not\n" \
+            "                        with --framing length.\n"                                 \
+            "  -r, --rate value      Send at most <value> messages per second.\n"              \
+            "\n"                                                                                  \
+            "  -B, --cli-broker      Run as CLI broker: keep sessions to the CLI open and serve\n" \
+            "                        the CLI commands of the other applets over the socket\n"   \
+            "                        " M3_CLI_BROKER_SOCKET ".\n"                       \
+            "  -S, --sessions value  Number of CLI sessions kept open by the broker (default 1).\n" \
+            "\n"                                                                                  \
+            "  -H, --hub             Run as MCIP hub: register to MCIP once and pass the\n"       \
+            "                        telegrams on to the listeners started with --hub over the\n" \
+            "                        socket " MCIP_HUB_SOCKET ".\n"                             \
+            "  -O, --hub-oids \"list\" OIDs the hub registers, separated by ',' (default 3,4).\n" \
             "\n");
 
     usage_applets();
@@ -226,6 +767,29 @@ static void usage(char *tool, char *description)
             "  -m  --my-oid value    OID (decimal) of this tool. \n"                              \
             "  -p, --permanently     Do not exit after receiving an MCIP telegram.\n"             \
             "                        with --to-oid default.\n"                                    \
+            "  -H, --hub             Receive the events from the MCIP hub (mcip-tool --hub)\n"    \
+            "                        instead of registering to MCIP.\n"                          \
+            "  -f, --filter \"expr\"   Print only the events matching the expression, e.g.\n"   \
+            "                        'input in {2.1,2.3} and state == LOW'. Fields: type, oid,\n" \
+            "                        input, state, pulses, text. Operators: == != < <= > >=,\n" \
+            "                        in {...}, contains, combined with and, or, not, ( ).\n"   \
+            "  -a, --aggregate value Only get-pulses: sum the pulses per input and print one\n" \
+            "                        summary per input every <n>s, <n>m or <n>h, aligned to\n"  \
+            "                        the clock. Implies --permanently.\n"                       \
+            "  -e, --exec-persistent \"command\"\n"                                               \
+            "                        Start <command> once and pass every event to its stdin in\n" \
+            "                        the output format (binary: length and telegram). It must\n" \
+            "                        acknowledge every event with a line on its stdout. It is\n" \
+            "                        restarted if it exits, the events are buffered meanwhile.\n" \
+            "                        Implies --permanently.\n"                                  \
+            "  -o, --format value    Output of the events: raw (default), json, csv or binary\n" \
+            "                        (length in network byte order and telegram).\n"            \
+            "  -F, --flush value     Write the output after every event (event, default),\n"     \
+            "                        every <n> events (<n>) or every <n> ms (<n>ms).\n"         \
+            "  -T, --timestamps      Add the receive time (UTC) and CLOCK_MONOTONIC (ns) to every\n" \
+            "                        event (raw: only the time).\n"                            \
+            "  -L, --latency         Print the latency of the listener (read, filter, write) on\n" \
+            "                        exit and on SIGUSR1 to stderr.\n"                          \
             "\n", tool, description);
 
     exit(0);
@@ -244,12 +808,35 @@ static void usage_sms(void)
             "  -p, --permanently           Exit after receiving an SMS\n"                          \
             "  -m  --my-oid value          OID (decimal) of this tool. This is mandatory for\n"    \
             "                              receiving SMS.\n"                                       \
+            "  -H, --hub                   Receive the SMS from the MCIP hub (mcip-tool --hub)\n"  \
+            "                              instead of registering to MCIP.\n"                      \
+            "  -o, --format value          Output of the SMS: raw (default), json, csv or binary\n" \
+            "                              (length in network byte order and telegram).\n"        \
+            "  -F, --flush value           Write the output after every SMS (event, default),\n"  \
+            "                              every <n> SMS (<n>) or every <n> ms (<n>ms).\n"        \
+            "  -T, --timestamps            Add the receive time (UTC) and CLOCK_MONOTONIC (ns)\n" \
+            "                              to every SMS (raw: only the time).\n"                  \
+            "  -L, --latency               Print the latency of the listener on exit and on\n"    \
+            "                              SIGUSR1 to stderr.\n"                                  \
             "\n"                                                                                   \
             "Send SMS:\n"                                                                          \
             "  -s, --send                  Send an SMS.\n"                                         \
             "  -n, --number \"number\"       Phone number to whom the SMS should be sent.\n"       \
             "  -t, --text \"text\"           SMS text to be sent.\n"                               \
             "  -i, --interface \"interface\" Set the interface (modem) to use for sending SMS.\n"  \
+            "  -r, --recipients \"file\"     Send the SMS to all numbers of <file> (\"-\" for\n"     \
+            "                              stdin) over one CLI session. Every line holds a\n"      \
+            "                              number, optionally followed by an own text. The\n"      \
+            "                              result is printed for every recipient.\n"               \
+            "  -q, --queue                 Append the SMS (-s or -r) to the spool of the SMS\n"    \
+            "                              daemon instead of sending it, the CLI is not used.\n"   \
+            "\n"                                                                                   \
+            "SMS daemon:\n"                                                                        \
+            "  -d, --daemon                Send the SMS of the spool over one CLI session until\n" \
+            "                              SIGTERM. Failed SMS are retried with a backoff and\n"   \
+            "                              moved to \"<spool>/failed\" after 10 attempts.\n"     \
+            "  -S, --spool \"dir\"           Directory of the spool (default " SMS_SPOOL_DIR ").\n"  \
+            "  -R, --rate value            Maximum number of SMS per minute and modem.\n"           \
             "\n");
 
     usage_applets();
@@ -260,12 +847,18 @@ static void usage_sms(void)
 /* print help for set-output, then exit */
 static void usage_output(char *tool, char *description)
 {
-    printf("\nUsage: %s [OPTIONS]\n"                                                              \
+    printf("\nUsage: %s [OPTIONS] [<slot>.<output>=<state> ...]\n"                                \
             "%s\n"                                                                                \
             "\n"                                                                                  \
             "  -h, --help            Display this help and exit.\n"                               \
             "  -o, --output          Output to set. Syntax: <slot>.<output> (e.g. -o 4.1).\n"     \
             "  -s, --state           State of output (open, close).\n"                            \
+            "  -f, --file \"file\"     Read assignments <slot>.<output>=<state> separated by\n"  \
+            "                        white space from <file> (\"-\" for stdin).\n"              \
+            "\n"                                                                                  \
+            "Several outputs can be given as assignments (e.g. 4.1=close 4.2=open), they are\n"  \
+            "set over one CLI session with all commands sent at once and the result is\n"       \
+            "reported for every output.\n"                                                      \
             "\n", tool, description);
 
     usage_applets();
@@ -277,10 +870,34 @@ static void usage_output(char *tool, char *description)
 static void usage_cli(char *tool, char *description)
 {
     printf("\nUsage: %s [OPTIONS] <CLI command>\n"                                                \
+            "       %s [OPTIONS] --subtree <branch> [key ...]\n"                                 \
             "%s\n"                                                                                \
             "\n"                                                                                  \
             "  -h, --help            Display this help and exit.\n"                               \
-            "\n", tool, description);
+            "  -t, --subtree \"branch\" Fetch the whole branch (e.g. \"status.ethernet1\") with\n" \
+            "                        one command and print the values of the given keys (full\n" \
+            "                        or relative to the branch) as \"key=value\", all values if\n" \
+            "                        no key is given.\n"                                         \
+            "  -W, --watch \"keys\"    Keep polling the keys separated by ',' and print a value\n" \
+            "                        with a timestamp only when it has changed.\n"             \
+            "  -i, --interval value  Time between two polls in watch mode in ms (default 1000).\n" \
+            "  -f, --file \"file\"     Read the commands line by line from <file> (\"-\" for\n"    \
+            "                        stdin) and send them over one CLI session. Each answer\n"  \
+            "                        is preceded by a line \"=== <n> <status> <command>\"\n"     \
+            "                        with the status OK, UNKNOWN or ERROR.\n"                   \
+            "  -w, --window value    Number of commands sent before their answers have been\n"  \
+            "                        received in batch mode (default 8).\n"                     \
+            "  -c, --cache \"ttls\"    Answer status values from a cache shared by all applets.\n" \
+            "                        <ttls> is a list of <key prefix>=<TTL in ms>, e.g.\n"      \
+            "                        \"status.cellular=2000,status.=500\" (default: environment\n" \
+            "                        variable M3_CLI_CACHE).\n"                                  \
+            "  -C, --cache-stats     Print the hit and miss counters of the cache.\n"           \
+            "  -s, --stats           Print the latencies (p50, p90, p99, max) of connect,\n"    \
+            "                        handshake and commands as well as the number of\n"         \
+            "                        timeouts and reconnects on exit and on SIGUSR1 (the\n"      \
+            "                        other applets print them to stderr if the environment\n"   \
+            "                        variable M3_CLI_STATS is set).\n"                           \
+            "\n", tool, tool, description);
 
     usage_applets();
 
@@ -306,7 +923,7 @@ static void usage_container(char *tool, char *description)
 }
 
 /* read the given parameters for generic mcip-tool */
-static bool get_options_tool(int argc, char **argv, char *strOpts_tool, struct option *Opts_tool, uint16_t *my_oid, uint16_t *to_oid, bool *listen, char **send, bool *perma)
+static bool get_options_tool(int argc, char **argv, char *strOpts_tool, struct option *Opts_tool, uint16_t *my_oid, uint16_t *to_oid, bool *listen, char **send, bool *perma, bool *broker, int *sessions, bool *hub, char **hub_oids, bool *send_stdin_mode, bool *length_framing, int *coalesce, int *rate, struct s_event_options *options)
 {
     int iOpts = 0;
     int c;
@@ -360,62 +977,213 @@ static bool get_options_tool(int argc, char **argv, char *strOpts_tool, struct o
                 break;
             }
 
-            default:
-            case 'h': {
-                usage_tool();
+            case 'B': {
+                *broker = true;
+                break;
             }
-        }
-    }
-
-    return true;
-}
-
-/* read the given parameters for input events and input pulses */
-static bool get_options(int argc, char **argv, char *strOpts_tool, struct option *Opts_tool, uint16_t *my_oid, bool *perma, char *description)
-{
-    int iOpts = 0;
-    int c;
-    char *pArg = 0;
-
-    while ((c = getopt_long(argc, argv, strOpts_tool, Opts_tool, &iOpts)) != -1) {
-        pArg = optarg;
-        if (pArg && (pArg[0] == '=')) {
-            pArg++;
-        }
 
-        switch (c) {
-            case 'm': {
+            case 'S': {
                 if (pArg != NULL) {
-                    *my_oid = atoi(pArg);
-                    if (*my_oid < 2 || *my_oid > 65534) {
-                        printf("The given value for my-oid must be in range of 2 to 65534)\n");
+                    *sessions = atoi(pArg);
+                    if (*sessions < 1 || *sessions > 16) {
+                        printf("The given value for sessions must be in range of 1 to 16)\n");
                         exit(-EINVAL);
                     }
                 }
                 break;
             }
 
-            case 'p': {
-                *perma = true;
+            case 'H': {
+                *hub = true;
                 break;
             }
 
-            default:
-            case 'h': {
-                usage(argv[0], description);
+            case 'O': {
+                if (pArg != NULL) {
+                    *hub_oids = pArg;
+                }
+                break;
             }
-        }
-    }
 
-    return true;
-}
-
-/* read the given parameters for output */
-static bool get_options_output(int argc, char **argv, char *strOpts_tool, struct option *Opts_tool, char **output, char **state, char *description)
-{
-    int iOpts = 0;
-    int c;
-    char *pArg = 0;
+            case 'o': {
+                if (pArg != NULL) {
+                    options->format = pArg;
+                }
+                break;
+            }
+
+            case 'F': {
+                if (pArg != NULL) {
+                    options->flush = pArg;
+                }
+                break;
+            }
+
+            case 'T': {
+                options->timestamps = true;
+                break;
+            }
+
+            case 'L': {
+                options->latency = true;
+                break;
+            }
+
+            case 'I': {
+                *send_stdin_mode = true;
+                break;
+            }
+
+            case 'f': {
+                if (pArg != NULL) {
+                    if (strcmp(pArg, "length") == 0) {
+                        *length_framing = true;
+                    }
+                    else if (strcmp(pArg, "line") == 0) {
+                        *length_framing = false;
+                    }
+                    else {
+                        printf("The given value for framing must be line or length\n");
+                        exit(-EINVAL);
+                    }
+                }
+                break;
+            }
+
+            case 'c': {
+                if (pArg != NULL) {
+                    *coalesce = atoi(pArg);
+                    if (*coalesce < 0 || *coalesce > MCIP_SENDER_MAX) {
+                        printf("The given value for coalesce must be in range of 0 to %d)\n", MCIP_SENDER_MAX);
+                        exit(-EINVAL);
+                    }
+                }
+                break;
+            }
+
+            case 'r': {
+                if (pArg != NULL) {
+                    *rate = atoi(pArg);
+                    if (*rate < 1 || *rate > 1000000) {
+                        printf("The given value for rate must be in range of 1 to 1000000)\n");
+                        exit(-EINVAL);
+                    }
+                }
+                break;
+            }
+
+            default:
+            case 'h': {
+                usage_tool();
+            }
+        }
+    }
+
+    /* the joined messages are separated by '\n', messages framed by their length may contain it */
+    if (*length_framing == true && *coalesce > 0) {
+        printf("The options coalesce and framing length can not be used together\n");
+        exit(-EINVAL);
+    }
+
+    return true;
+}
+
+/* read the given parameters for input events and input pulses */
+static bool get_options(int argc, char **argv, char *strOpts_tool, struct option *Opts_tool, uint16_t *my_oid, bool *perma, bool *hub, struct s_event_options *options, char *description)
+{
+    int iOpts = 0;
+    int c;
+    char *pArg = 0;
+
+    while ((c = getopt_long(argc, argv, strOpts_tool, Opts_tool, &iOpts)) != -1) {
+        pArg = optarg;
+        if (pArg && (pArg[0] == '=')) {
+            pArg++;
+        }
+
+        switch (c) {
+            case 'm': {
+                if (pArg != NULL) {
+                    *my_oid = atoi(pArg);
+                    if (*my_oid < 2 || *my_oid > 65534) {
+                        printf("The given value for my-oid must be in range of 2 to 65534)\n");
+                        exit(-EINVAL);
+                    }
+                }
+                break;
+            }
+
+            case 'p': {
+                *perma = true;
+                break;
+            }
+
+            case 'H': {
+                *hub = true;
+                break;
+            }
+
+            case 'f': {
+                if (pArg != NULL) {
+                    options->filter = pArg;
+                }
+                break;
+            }
+
+            case 'a': {
+                if (pArg != NULL) {
+                    options->aggregate = pArg;
+                }
+                break;
+            }
+
+            case 'e': {
+                if (pArg != NULL) {
+                    options->exec = pArg;
+                }
+                break;
+            }
+
+            case 'o': {
+                if (pArg != NULL) {
+                    options->format = pArg;
+                }
+                break;
+            }
+
+            case 'F': {
+                if (pArg != NULL) {
+                    options->flush = pArg;
+                }
+                break;
+            }
+
+            case 'T': {
+                options->timestamps = true;
+                break;
+            }
+
+            case 'L': {
+                options->latency = true;
+                break;
+            }
+
+            default:
+            case 'h': {
+                usage(argv[0], description);
+            }
+        }
+    }
+
+    return true;
+}
+
+/* read the given parameters for output */
+static bool get_options_output(int argc, char **argv, char *strOpts_tool, struct option *Opts_tool, char **output, char **state, char **file, char *description)
+{
+    int iOpts = 0;
+    int c;
+    char *pArg = 0;
 
     while ((c = getopt_long(argc, argv, strOpts_tool, Opts_tool, &iOpts)) != -1) {
         pArg = optarg;
@@ -434,6 +1202,11 @@ static bool get_options_output(int argc, char **argv, char *strOpts_tool, struct
                 break;
             }
 
+             case 'f': {
+                *file = pArg;
+                break;
+            }
+
             default:
             case 'h': {
                 usage_output(argv[0], description);
@@ -445,7 +1218,7 @@ static bool get_options_output(int argc, char **argv, char *strOpts_tool, struct
 }
 
 /* read the given parameters for sms-tool */
-static bool get_options_sms(int argc, char **argv, char *strOpts_tool, struct option *Opts_tool, uint16_t *my_oid, bool *perma, bool *send, bool *listen, char **number, char **text, char **modem)
+static bool get_options_sms(int argc, char **argv, char *strOpts_tool, struct option *Opts_tool, uint16_t *my_oid, bool *perma, bool *send, bool *listen, char **number, char **text, char **modem, char **recipients, bool *queue, bool *daemon, char **spool, int *rate, bool *hub, struct s_event_options *options)
 {
     int iOpts = 0;
     int c;
@@ -479,6 +1252,35 @@ static bool get_options_sms(int argc, char **argv, char *strOpts_tool, struct op
                 break;
             }
 
+            case 'H': {
+                *hub = true;
+                break;
+            }
+
+            case 'o': {
+                if (pArg != NULL) {
+                    options->format = pArg;
+                }
+                break;
+            }
+
+            case 'F': {
+                if (pArg != NULL) {
+                    options->flush = pArg;
+                }
+                break;
+            }
+
+            case 'T': {
+                options->timestamps = true;
+                break;
+            }
+
+            case 'L': {
+                options->latency = true;
+                break;
+            }
+
             case 'l': {
                 *listen = true;
                 break;
@@ -505,6 +1307,41 @@ static bool get_options_sms(int argc, char **argv, char *strOpts_tool, struct op
                 break;
             }
 
+            case 'r': {
+                if (pArg != NULL) {
+                    *recipients = pArg;
+                }
+                break;
+            }
+
+            case 'q': {
+                *queue = true;
+                break;
+            }
+
+            case 'd': {
+                *daemon = true;
+                break;
+            }
+
+            case 'S': {
+                if (pArg != NULL) {
+                    *spool = pArg;
+                }
+                break;
+            }
+
+            case 'R': {
+                if (pArg != NULL) {
+                    *rate = atoi(pArg);
+                    if (*rate < 0) {
+                        printf("The given value for rate must not be negative\n");
+                        exit(-EINVAL);
+                    }
+                }
+                break;
+            }
+
             default:
             case 'h': {
                 usage_sms();
@@ -516,7 +1353,7 @@ static bool get_options_sms(int argc, char **argv, char *strOpts_tool, struct op
 }
 
 /* read the given parameters for cli-cmd */
-static bool get_options_cli(int argc, char **argv, char *strOpts_tool, struct option *Opts_tool, char **cmd, char *description)
+static bool get_options_cli(int argc, char **argv, char *strOpts_tool, struct option *Opts_tool, char **cmd, char **file, int *window, char **cache, bool *cache_stats, char **subtree, char ***keys, int *keys_count, char **watch, int *interval, bool *stats, char *description)
 {
     int iOpts = 0;
     int c;
@@ -529,6 +1366,58 @@ static bool get_options_cli(int argc, char **argv, char *strOpts_tool, struct op
         }
 
         switch (c) {
+            case 'f': {
+                *file = pArg;
+                break;
+            }
+
+            case 'w': {
+                if (pArg != NULL) {
+                    *window = atoi(pArg);
+                    if (*window < 1 || *window > 1024) {
+                        printf("The given value for window must be in range of 1 to 1024)\n");
+                        exit(-EINVAL);
+                    }
+                }
+                break;
+            }
+
+            case 'c': {
+                *cache = pArg;
+                break;
+            }
+
+            case 'C': {
+                *cache_stats = true;
+                break;
+            }
+
+            case 't': {
+                *subtree = pArg;
+                break;
+            }
+
+            case 'W': {
+                *watch = pArg;
+                break;
+            }
+
+            case 's': {
+                *stats = true;
+                break;
+            }
+
+            case 'i': {
+                if (pArg != NULL) {
+                    *interval = atoi(pArg);
+                    if (*interval < 10 || *interval > 86400000) {
+                        printf("The given value for interval must be in range of 10 to 86400000 ms)\n");
+                        exit(-EINVAL);
+                    }
+                }
+                break;
+            }
+
             default:
             case 'h': {
                 usage_cli(argv[0], description);
@@ -541,6 +1430,10 @@ static bool get_options_cli(int argc, char **argv, char *strOpts_tool, struct op
         *cmd = argv[optind];
     }
 
+    /* all remaining arguments are keys of the subtree */
+    *keys = argv + optind;
+    *keys_count = argc - optind;
+
     return true;
 }
 
@@ -589,23 +1482,22 @@ static bool get_options_container(int argc, char **argv, char *strOpts_tool, str
 static int main_sms_tool(int argc, char **argv)
 {
     bool perma = false;
-    bool again = true;
     bool send = false;
     bool listen = false;
-    char *number;
-    char *text;
-    char *modem;
+    char *number = NULL;
+    char *text = NULL;
+    char *modem = NULL;
+    char *recipients = NULL;
+    bool queue = false;
+    bool daemon = false;
+    char *spool = SMS_SPOOL_DIR;
+    int rate = 0;
+    bool hub = false;
+    char subscription[32];
+    struct s_event_options options;
+    struct s_event_listener events;
     uint16_t my_oid = 3;
-    uint8_t p[1500];
-    int sock = -1;
-    int i = 0;
-    int x = 0;
-    int sel = 0;
-    int length = 0;
-    fd_set fds_master, fds_tmp;
-    struct timeval tv;
-    struct oid_list *my_oids = NULL;
-    static char strOpts_sms[] = "hlm:psn:t:i:";
+    static char strOpts_sms[] = "hlm:psn:t:i:r:qdS:R:Ho:F:TL";
     static struct option Opts_sms[] = {
         { "my-oid",         required_argument,  0, 'm' },
         { "help",           no_argument,        0, 'h' },
@@ -615,14 +1507,40 @@ static int main_sms_tool(int argc, char **argv)
         { "number",         required_argument,  0, 'n' },
         { "text",           required_argument,  0, 't' },
         { "interface",      required_argument,  0, 'i' },
+        { "recipients",     required_argument,  0, 'r' },
+        { "queue",          no_argument,        0, 'q' },
+        { "daemon",         no_argument,        0, 'd' },
+        { "spool",          required_argument,  0, 'S' },
+        { "rate",           required_argument,  0, 'R' },
+        { "hub",            no_argument,        0, 'H' },
+        { "format",         required_argument,  0, 'o' },
+        { "flush",          required_argument,  0, 'F' },
+        { "timestamps",     no_argument,        0, 'T' },
+        { "latency",        no_argument,        0, 'L' },
         { 0,                0,                  0,  0  }
     };
 
     /* get parameters */
-    if (get_options_sms(argc, argv, strOpts_sms, Opts_sms, &my_oid, &perma, &send, &listen, &number, &text, &modem) == false) {
+    memset(&options, 0, sizeof(struct s_event_options));
+    if (get_options_sms(argc, argv, strOpts_sms, Opts_sms, &my_oid, &perma, &send, &listen, &number, &text, &modem, &recipients, &queue, &daemon, &spool, &rate, &hub, &options) == false) {
         return -1;
     }
 
+    /* send the SMS of the spool */
+    if (daemon == true) {
+        return sms_daemon(spool, rate);
+    }
+
+    /* append the SMS to the spool */
+    if (queue == true && (recipients != NULL || (send == true && number != NULL && text != NULL))) {
+        return (queue_sms(spool, recipients, number, text, modem) == 0) ? 0 : -1;
+    }
+
+    /* send a SMS to many recipients */
+    if (recipients != NULL) {
+        return (send_sms_bulk(recipients, text, modem) == 0) ? 0 : -1;
+    }
+
     /* send a SMS */
     if (send == true && number != NULL && text != NULL) {
         return send_sms(number, text, modem);
@@ -630,78 +1548,11 @@ static int main_sms_tool(int argc, char **argv)
 
     /* receive SMS */
     if (listen == true) {
-        /* init my OIDs */
-        mcip_oid_append(&my_oids, my_oid);
-
-        /* connect to MCIP via UDS (Unix Domain Socket) */
-        sock = mcip_uds_register("/devices/mcip.socket", my_oids);
-        if(sock == -1) {
-            printf("Failed to register to MCIP\n");
-            mcip_oids_destroy(my_oids);
+        if (init_event_listener(&events, true, MCIP_EVENT_OTHER, perma, &options) == false) {
             return -1;
         }
-
-        /* read from MCIP */
-        FD_ZERO(&fds_master);
-        FD_SET(sock, &fds_master);
-        do {
-            again = true;
-            FD_ZERO(&fds_tmp);
-            fds_tmp = fds_master;
-            tv.tv_sec = 10;
-            tv.tv_usec = 0;
-            sel = select(sock + 1, &fds_tmp, NULL, NULL, &tv);
-            if(sel > 0) {
-                /* read everything from socket */
-                if(FD_ISSET(sock, &fds_tmp)) {
-                    x = read(sock, p + length, 1500 - length);
-                    if(x > 0) {
-                        length += x;
-                    }
-                    else {
-                        printf("Failed to read from MCIP\n");
-
-                        /* reconnect to MCIP */
-                        mcip_uds_deregister(&sock);
-                        mcip_oids_destroy(my_oids);
-
-                        /* init my OIDs */
-                        mcip_oid_append(&my_oids, my_oid);
-
-                        /* connect to MCIP via UDS (Unix Domain Socket) */
-                        sock = mcip_uds_register("/devices/mcip.socket", my_oids);
-                        if(sock == -1) {
-                            printf("Failed to register to MCIP\n");
-                            mcip_oids_destroy(my_oids);
-                            return -1;
-                        }
-                        length = x = sel = 0;
-                    }
-                }
-            }
-
-            /* check if length of received telegram is already here */
-            if (length > 7) {
-                /* check if telegram is already complete */
-                if (length >= (p[3] | p[4] << 8)) {
-                    /* print the received telegram */
-                    for(i = 7; i < ((p[3] | p[4] << 8) + 5); i++) {
-                        printf("%c", p[i]);
-                    }
-                    printf("\n");
-                    again = false;
-                }
-                length = x = sel = 0;
-            }
-
-        }
-        while (perma == true || again == true);
-
-        /* deregister */
-        mcip_uds_deregister(&sock);
-
-        /* free OID list */
-        mcip_oids_destroy(my_oids);
+        snprintf(subscription, sizeof(subscription), "oid=%u", my_oid);
+        return listen_mcip(my_oid, (hub == true) ? subscription : NULL, &events);
     }
 
     return 0;
@@ -710,125 +1561,46 @@ static int main_sms_tool(int argc, char **argv)
 /* get input change events or input pulses */
 static int get_input(int argc, char **argv, bool pulses, char *description)
 {
+    struct s_event_listener events;
     bool perma = false;
-    bool print = false;
-    bool repeat = false;
+    bool hub = false;
+    char subscription[32];
+    struct s_event_options options;
     uint16_t my_oid = 4;
-    uint8_t p[1500];
-    int sock = -1;
-    int i = 0;
-    int x = 0;
-    int sel = 0;
-    int length = 0;
-    fd_set fds_master, fds_tmp;
-    struct timeval tv;
-    struct oid_list *my_oids = NULL;
-    static char strOpts[] = "hm:p";
+    static char strOpts[] = "hm:pHf:a:e:o:F:TL";
     static struct option Opts[] = {
         { "my-oid",         required_argument,  0, 'm' },
         { "help",           no_argument,        0, 'h' },
         { "permanently",    no_argument,        0, 'p' },
+        { "hub",            no_argument,        0, 'H' },
+        { "filter",         required_argument,  0, 'f' },
+        { "aggregate",      required_argument,  0, 'a' },
+        { "exec-persistent", required_argument, 0, 'e' },
+        { "format",         required_argument,  0, 'o' },
+        { "flush",          required_argument,  0, 'F' },
+        { "timestamps",     no_argument,        0, 'T' },
+        { "latency",        no_argument,        0, 'L' },
         { 0,                0,                  0,  0  }
     };
 
     /* get parameters */
-    if (get_options(argc, argv, strOpts, Opts, &my_oid, &perma, description) == false) {
+    memset(&options, 0, sizeof(struct s_event_options));
+    if (get_options(argc, argv, strOpts, Opts, &my_oid, &perma, &hub, &options, description) == false) {
         return -1;
     }
-
-    /* init my OIDs */
-    mcip_oid_append(&my_oids, my_oid);
-
-    /* connect to MCIP via UDS (Unix Domain Socket) */
-    sock = mcip_uds_register("/devices/mcip.socket", my_oids);
-    if(sock == -1) {
-        printf("Failed to register to MCIP\n");
-        mcip_oids_destroy(my_oids);
+    if (options.aggregate != NULL && pulses == false) {
+        printf("Only pulses can be aggregated\n");
         return -1;
     }
 
-    /* read from MCIP */
-    FD_ZERO(&fds_master);
-    FD_SET(sock, &fds_master);
-    do {
-        FD_ZERO(&fds_tmp);
-        fds_tmp = fds_master;
-        tv.tv_sec = 10;
-        tv.tv_usec = 0;
-        sel = select(sock + 1, &fds_tmp, NULL, NULL, &tv);
-        if(sel > 0) {
-            /* read everything from socket */
-            if(FD_ISSET(sock, &fds_tmp)) {
-                x = read(sock, p + length, 1500 - length);
-                if(x > 0) {
-                    length += x;
-                }
-                else {
-                    printf("Failed to read from MCIP\n");
-
-                    /* reconnect to MCIP */
-                    mcip_uds_deregister(&sock);
-                    mcip_oids_destroy(my_oids);
-
-                    /* init my OIDs */
-                    mcip_oid_append(&my_oids, my_oid);
-
-                    /* connect to MCIP via UDS (Unix Domain Socket) */
-                    sock = mcip_uds_register("/devices/mcip.socket", my_oids);
-                    if(sock == -1) {
-                        printf("Failed to register to MCIP\n");
-                        mcip_oids_destroy(my_oids);
-                        return -1;
-                    }
-                    length = x = sel = 0;
-                }
-            }
-        }
-
-        /* check if length of received telegram is already here */
-        if (length > 7) {
-            /* check if telegram is already complete */
-            if (length >= (p[3] | p[4] << 8)) {
-                /* only print if we should:
-                   it is a input change event e.g. 2.1 is now LOW
-                   it is a pulse event e.g. 2.1 pulses detected: 1 */
-                print = false;
-                if (pulses == false && p[11] == 'i') {
-                    print = true;
-
-                }
-                else if (pulses == true && p[11] == 'p') {
-                    print = true;
-                }
-
-                /* print the received telegram */
-                if (print == true) {
-                    for(i = 7; i < ((p[3] | p[4] << 8) + 5); i++) {
-                        printf("%c", p[i]);
-                    }
-                    printf("\n");
-                }
-            }
-            length = x = sel = 0;
-        }
-
-        /* do not abort after a wrong event, when the tool should exit after one event */
-        if (perma != true && print == false) {
-            repeat = true;
-        }
-        else {
-            repeat = false;
-        }
+    if (init_event_listener(&events, false, (pulses == true) ? MCIP_EVENT_PULSE : MCIP_EVENT_INPUT, perma, &options) == false) {
+        return -1;
     }
-    while (perma == true || repeat == true);
 
-    /* deregister */
-    mcip_uds_deregister(&sock);
-
-    /* free OID list */
-    mcip_oids_destroy(my_oids);
+    /* the hub only passes on the events of the tool */
+    snprintf(subscription, sizeof(subscription), "%s,oid=%u", (pulses == true) ? "pulse" : "input", my_oid);
 
-    return 0;
+    return listen_mcip(my_oid, (hub == true) ? subscription : NULL, &events);
 }
 
 /* get input events */
@@ -843,27 +1615,123 @@ static int main_get_pulses(int argc, char **argv)
     return get_input(argc, argv, true, "Receive input pulses.");
 }
 
+/* add an assignment <slot>.<output>=<state> to the lists of outputs and states */
+static bool add_output(char *assignment, char ***outputs, char ***states, int *count)
+{
+    char *eq;
+
+    eq = strchr(assignment, '=');
+    if (eq == NULL || eq == assignment || eq[1] == '\0') {
+        printf("Invalid assignment \"%s\", the syntax is <slot>.<output>=<state>\n", assignment);
+        return false;
+    }
+
+    *outputs = realloc(*outputs, (*count + 1) * sizeof(char *));
+    *states = realloc(*states, (*count + 1) * sizeof(char *));
+    (*outputs)[*count] = strndup(assignment, eq - assignment);
+    (*states)[*count] = strdup(eq + 1);
+    (*count)++;
+
+    return true;
+}
+
+/* read the assignments separated by white space from a file */
+static bool read_outputs(char *file, char ***outputs, char ***states, int *count)
+{
+    FILE *input;
+    char *line = NULL;
+    char *word, *save;
+    size_t line_size = 0;
+    bool ok = true;
+
+    if (strcmp(file, "-") == 0) {
+        input = stdin;
+    }
+    else if ((input = fopen(file, "r")) == NULL) {
+        printf("Failed to open %s (%d): %s\n", file, errno, strerror(errno));
+        return false;
+    }
+
+    while (ok == true && getline(&line, &line_size, input) != -1) {
+        /* skip comments */
+        if (line[0] == '#') {
+            continue;
+        }
+        save = NULL;
+        for (word = strtok_r(line, " \t\r\n", &save); ok == true && word != NULL; word = strtok_r(NULL, " \t\r\n", &save)) {
+            ok = add_output(word, outputs, states, count);
+        }
+    }
+
+    safefree((void **) &line);
+    if (input != stdin) {
+        fclose(input);
+    }
+
+    return ok;
+}
+
 /* set output state */
 static int set_output(int argc, char **argv, char *description)
 {
-    char *output;
-    char *state;
-    static char strOpts[] = "ho:s:";
+    char *output = NULL;
+    char *state = NULL;
+    char *file = NULL;
+    char **outputs = NULL;
+    char **states = NULL;
+    int count = 0;
+    int failed = 0;
+    bool ok = true;
+    int i;
+    static char strOpts[] = "ho:s:f:";
     static struct option Opts[] = {
         { "help",           no_argument,        0, 'h' },
         { "output",         required_argument,  0, 'o' },
         { "state",          required_argument,  0, 's' },
+        { "file",           required_argument,  0, 'f' },
         { 0,                0,                  0,  0  }
     };
 
     /* get parameters */
-    if (get_options_output(argc, argv, strOpts, Opts, &output, &state, description) == false) {
+    if (get_options_output(argc, argv, strOpts, Opts, &output, &state, &file, description) == false) {
         return -1;
     }
 
-    switch_output(output, state);
+    /* collect the outputs of the options, the arguments and the file */
+    if (output != NULL || state != NULL) {
+        if (output == NULL || state == NULL) {
+            printf("Both output and state have to be given\n");
+            return -1;
+        }
+        outputs = calloc(1, sizeof(char *));
+        states = calloc(1, sizeof(char *));
+        outputs[0] = strdup(output);
+        states[0] = strdup(state);
+        count = 1;
+    }
+    for (i = optind; ok == true && i < argc; i++) {
+        ok = add_output(argv[i], &outputs, &states, &count);
+    }
+    if (ok == true && file != NULL) {
+        ok = read_outputs(file, &outputs, &states, &count);
+    }
+
+    if (ok == true && count == 0) {
+        printf("No output has been given\n");
+        ok = false;
+    }
+    if (ok == true) {
+        failed = switch_outputs(outputs, states, count);
+    }
 
-    return 0;
+    for (i = 0; i < count; i++) {
+        safefree((void **) &outputs[i]);
+        safefree((void **) &states[i]);
+    }
+    safefree((void **) &outputs);
+    safefree((void **) &states);
+
+    return (ok == true && failed == 0) ? 0 : -1;
 }
 
 /* set output state */
@@ -873,17 +1741,161 @@ static int main_set_output(int argc, char **argv)
 }
 
 /* the normal mcip-tool operation */
+/* send the messages read from stdin, every message is terminated by a newline or, with length_framing, prefixed by its
+    length (4 bytes, network byte order); all messages are read into one buffer and sent from there
+    returns the number of messages that have not been sent */
+static int send_stdin(int sock, uint16_t to_oid, uint16_t my_oid, bool length_framing, int coalesce, int rate)
+{
+    struct s_mcip_sender sender;
+    struct pollfd pfd;
+    char *buffer, *message, *end;
+    size_t size, start = 0, len = 0, n;
+    uint32_t length;
+    bool discard = false;
+    bool eof = false;
+    ssize_t x;
+    int failed;
+
+    if (mcip_sender_init(&sender, sock, to_oid, my_oid, coalesce, rate) == false) {
+        printf("Failed to allocate the send buffer\n");
+        return -1;
+    }
+    size = mcip_sender_max(&sender) + 4;
+    buffer = malloc(size);
+    if (buffer == NULL) {
+        printf("Failed to allocate the receive buffer\n");
+        mcip_sender_free(&sender);
+        return -1;
+    }
+
+    while (eof == false) {
+        x = read(STDIN_FILENO, buffer + len, size - len);
+        if (x == -1 && errno == EINTR) {
+            continue;
+        }
+        if (x == -1) {
+            printf("Failed to read from stdin (%d): %s\n", errno, strerror(errno));
+            break;
+        }
+        if (x == 0) {
+            eof = true;
+        }
+        len += x;
+
+        /* send every complete message in the buffer */
+        for (;;) {
+            message = buffer + start;
+            if (length_framing == true) {
+                if (len - start < 4) {
+                    break;
+                }
+                memcpy(&length, message, 4);
+                n = ntohl(length);
+                if (n > mcip_sender_max(&sender)) {
+                    printf("Message of %zu bytes is too long, the framing is lost\n", n);
+                    sender.failed++;
+                    eof = true;
+                    start = len;
+                    break;
+                }
+                if (len - start < 4 + n) {
+                    break;
+                }
+                message += 4;
+                start += 4 + n;
+            }
+            else {
+                end = memchr(message, '\n', len - start);
+                if (end == NULL) {
+                    /* the last line may lack its newline */
+                    if (eof == false || len == start) {
+                        break;
+                    }
+                    end = buffer + len;
+                }
+                n = end - message;
+                start += n + ((end < buffer + len) ? 1 : 0);
+                if (n > 0 && message[n - 1] == '\r') {
+                    n--;
+                }
+
+                /* the rest of a line that has been too long */
+                if (discard == true) {
+                    discard = false;
+                    continue;
+                }
+                if (n == 0) {
+                    continue;
+                }
+            }
+
+            if (mcip_sender_send(&sender, message, n) == false) {
+                printf("Failed to send string to MCIP%s\n", (errno == EMSGSIZE) ? ", it is too long" : "");
+            }
+        }
+
+        /* keep the incomplete message, a line that does not fit into the buffer is too long */
+        if (start == 0 && len == size && length_framing == false) {
+            if (discard == false) {
+                printf("Failed to send string to MCIP, it is too long\n");
+                sender.failed++;
+            }
+            discard = true;
+            len = 0;
+        }
+        memmove(buffer, buffer + start, len - start);
+        len -= start;
+        start = 0;
+
+        /* nothing more is waiting: send the joined messages instead of waiting for the next input */
+        if (sender.pending > 0) {
+            pfd.fd = STDIN_FILENO;
+            pfd.events = POLLIN;
+            if (poll(&pfd, 1, 0) == 0 && mcip_sender_flush(&sender) == false) {
+                printf("Failed to send string to MCIP\n");
+            }
+        }
+    }
+    if (length_framing == true && len > 0) {
+        printf("The last message is incomplete\n");
+        sender.failed++;
+    }
+
+    safefree((void **) &buffer);
+    mcip_sender_free(&sender);
+    mcip_sender_report(&sender);
+    failed = sender.failed;
+
+    return failed;
+}
+
 static int main_mcip_tool(int argc, char **argv)
 {
     bool listen = 0;
     bool perma = false;
+    bool broker = false;
+    int sessions = 1;
+    bool hub = false;
+    char *hub_oids = "3,4";
+    uint16_t oids[MCIP_LISTENER_OIDS];
+    int oid_count = 0;
+    char *item, *end;
+    long oid;
     uint16_t my_oid = 0;
     uint16_t to_oid = 2;
     char *send = NULL;
+    bool send_stdin_mode = false;
+    bool length_framing = false;
+    int coalesce = 0;
+    int rate = 0;
     int sock = -1;
-    struct oid_list *my_oids = NULL;
-    char *s = NULL;
-    static char strOpts_tool[] = "hm:t:ls:p";
+    int ret = 0;
+    struct s_event_loop *loop;
+    struct s_mcip_listener listener;
+    struct s_mcip_sender sender;
+    struct s_event_listener events;
+    struct s_event_options options;
+    static char strOpts_tool[] = "hm:t:ls:pBS:HO:o:F:TLIf:c:r:";
     static struct option Opts_tool[] = {
         { "my-oid",         required_argument,  0, 'm' },
         { "to-oid",         required_argument,  0, 't' },
@@ -891,76 +1903,364 @@ static int main_mcip_tool(int argc, char **argv)
         { "listen",         no_argument,        0, 'l' },
         { "send",           required_argument,  0, 's' },
         { "permanently",    no_argument,        0, 'p' },
+        { "cli-broker",     no_argument,        0, 'B' },
+        { "sessions",       required_argument,  0, 'S' },
+        { "hub",            no_argument,        0, 'H' },
+        { "hub-oids",       required_argument,  0, 'O' },
+        { "format",         required_argument,  0, 'o' },
+        { "flush",          required_argument,  0, 'F' },
+        { "timestamps",     no_argument,        0, 'T' },
+        { "latency",        no_argument,        0, 'L' },
+        { "send-stdin",     no_argument,        0, 'I' },
+        { "framing",        required_argument,  0, 'f' },
+        { "coalesce",       required_argument,  0, 'c' },
+        { "rate",           required_argument,  0, 'r' },
         { 0,                0,                  0,  0  }
     };
 
     /* get parameters */
-    if (get_options_tool(argc, argv, strOpts_tool, Opts_tool, &my_oid, &to_oid, &listen, &send, &perma) == false) {
+    memset(&options, 0, sizeof(struct s_event_options));
+    if (get_options_tool(argc, argv, strOpts_tool, Opts_tool, &my_oid, &to_oid, &listen, &send, &perma, &broker, &sessions, &hub, &hub_oids,
+                         &send_stdin_mode, &length_framing, &coalesce, &rate, &options) == false) {
         return -1;
     }
 
-    /* init my OIDs */
-    mcip_oid_append(&my_oids, my_oid);
+    /* serve the CLI for the other applets, this does not need MCIP */
+    if (broker == true) {
+        if (getenv(M3_CLI_STATS_ENV) != NULL) {
+            m3_cli_stats_signal(SIGUSR1);
+        }
+        m3_cli_broker_run(M3_CLI_BROKER_SOCKET, M3_CLI_UDS_SOCKET, sessions, 300);
+        printf("CLI broker failed (%d): %s\n", errno, strerror(errno));
+        return -1;
+    }
 
-    /* connect to MCIP via UDS (Unix Domain Socket) */
-    sock = mcip_uds_register("/devices/mcip.socket", my_oids);
-    if(sock == -1) {
-        printf("Failed to register to MCIP\n");
-        mcip_oids_destroy(my_oids);
+    /* register to MCIP once for all listeners */
+    if (hub == true) {
+        for (item = hub_oids; *item != '\0'; item = (*end == ',') ? end + 1 : end) {
+            oid = strtol(item, &end, 10);
+            if (end == item || (*end != ',' && *end != '\0') || oid < 2 || oid > 65534 || oid_count == MCIP_LISTENER_OIDS) {
+                printf("Invalid OIDs for the hub: %s\n", hub_oids);
+                return -1;
+            }
+            oids[oid_count++] = (uint16_t) oid;
+        }
+        return mcip_hub_run(mcip_hub_socket(), oids, oid_count);
+    }
+
+    /* print the whole telegrams */
+    if (init_event_listener(&events, true, MCIP_EVENT_OTHER, perma, &options) == false) {
         return -1;
     }
+    events.sink.raw_telegram = true;
+
+    /* connect to MCIP via UDS (Unix Domain Socket), the telegrams are read on the event loop */
+    loop = create_listener_loop();
+    if (loop == NULL) {
+        close_event_listener(&events);
+        return -1;
+    }
+    if (attach_event_listener(&events, loop) == false) {
+        close_event_listener(&events);
+        event_loop_free(&loop);
+        return -1;
+    }
+    if (mcip_listener_open(&listener, loop, &my_oid, 1, handle_event, &events) == false) {
+        close_event_listener(&events);
+        event_loop_free(&loop);
+        return -1;
+    }
+    sock = listener.sock;
 
     /* send the given string */
     if (send != NULL) {
-        s = calloc(1, 2 + 2 + strlen(send));
-        s[0] = to_oid & 0x00FF;
-        s[1] = (to_oid & 0xFF00) >> 8;
-        if (my_oid == 0) {
-            strcat(s + 2, send);
-            if (mcip_send(sock, MCIP_CMD_WRITE, strlen(send) + 2, s) != 0) {
-                printf("Failed to send string to MCIP\n");
-            }
+        if (mcip_sender_init(&sender, sock, to_oid, my_oid, 0, 0) == false) {
+            printf("Failed to allocate the send buffer\n");
+            ret = -1;
         }
         else {
-            s[2] = my_oid & 0x00FF;
-            s[3] = (my_oid & 0xFF00) >> 8;
-            strcat(s + 4, send);
-            if (mcip_send(sock, MCIP_CMD_WRITE, strlen(send) + 4, s) != 0) {
+            if (mcip_sender_send(&sender, send, strlen(send)) == false) {
                 printf("Failed to send string to MCIP\n");
             }
+            mcip_sender_free(&sender);
         }
+    }
 
-        safefree((void **) &s);
+    /* send the messages of stdin */
+    if (send_stdin_mode == true && send_stdin(sock, to_oid, my_oid, length_framing, coalesce, rate) != 0) {
+        ret = -1;
     }
 
     /* read from MCIP */
-    do {
-        if (read_from_mcip(sock, listen) == false) {
-            printf("Failed to read from MCIP\n");
-
-            /* reconnect to MCIP */
-            mcip_uds_deregister(&sock);
-            mcip_oids_destroy(my_oids);
-
-            /* init my OIDs */
-            mcip_oid_append(&my_oids, my_oid);
-
-            /* connect to MCIP via UDS (Unix Domain Socket) */
-            sock = mcip_uds_register("/devices/mcip.socket", my_oids);
-            if(sock == -1) {
-                printf("Failed to register to MCIP\n");
-                mcip_oids_destroy(my_oids);
-                return -1;
+    if (listen == true && event_loop_run(loop) == false) {
+        printf("Failed to wait for MCIP (%d): %s\n", errno, strerror(errno));
+        ret = -1;
+    }
+    if (listener.failed == true) {
+        ret = -1;
+    }
+
+    /* deregister */
+    mcip_listener_close(&listener);
+    close_event_listener(&events);
+    event_loop_free(&loop);
+
+    return ret;
+}
+
+/* print the answer of a command sent in batch mode and return if it has been successful */
+static bool print_batch_answer(int number, char *cmd, char *answer, bool sent)
+{
+    char *status = "OK";
+    int err = errno;
+
+    if (sent == false) {
+        status = "ERROR";
+    }
+    else if (answer == NULL || strstr(answer, "is unknown")) {
+        status = "UNKNOWN";
+    }
+
+    printf("=== %d %s %s\n", number, status, cmd);
+    if (answer != NULL) {
+        printf("%s\n", answer);
+    }
+    else if (sent == false) {
+        printf("%s\n", strerror(err));
+    }
+
+    return (strcmp(status, "OK") == 0);
+}
+
+/* send the commands read from a file over one CLI session
+    up to <window> commands are written before their answers are read (pipelining)
+    a failing command does not abort the batch, returns the number of failed commands */
+static int cli_batch(struct s_m3_cli *cli, FILE *input, int window)
+{
+    char **in_flight;
+    char *line = NULL;
+    char *cli_answer = NULL;
+    size_t line_size = 0;
+    ssize_t len;
+    int head = 0, count = 0, number = 0, failed = 0;
+    bool eof = false;
+
+    in_flight = calloc(window, sizeof(char *));
+
+    while (eof == false || count > 0) {
+        /* fill the window with new commands */
+        while (eof == false && count < window) {
+            len = getline(&line, &line_size, input);
+            if (len == -1) {
+                eof = true;
+                break;
+            }
+            while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) {
+                line[--len] = '\0';
             }
+            /* skip empty lines and comments */
+            if (len == 0 || line[0] == '#') {
+                continue;
+            }
+
+            number++;
+            if (m3_cli_write(cli, line) == false) {
+                /* the session got closed, the commands in flight are lost */
+                for (; count > 0; count--) {
+                    print_batch_answer(number - count, in_flight[head], NULL, false);
+                    safefree((void **) &in_flight[head]);
+                    head = (head + 1) % window;
+                    failed++;
+                }
+                print_batch_answer(number, line, NULL, false);
+                failed++;
+                continue;
+            }
+            in_flight[(head + count) % window] = strdup(line);
+            count++;
         }
+
+        if (count == 0) {
+            continue;
+        }
+
+        /* read the answer of the oldest command */
+        if (m3_cli_read_answer(cli, &cli_answer, 6000) == false) {
+            /* the session got closed, all commands in flight are lost */
+            for (; count > 0; count--) {
+                print_batch_answer(number - count + 1, in_flight[head], NULL, false);
+                safefree((void **) &in_flight[head]);
+                head = (head + 1) % window;
+                failed++;
+            }
+            continue;
+        }
+
+        if (print_batch_answer(number - count + 1, in_flight[head], cli_answer, true) == false) {
+            failed++;
+        }
+        safefree((void **) &cli_answer);
+        safefree((void **) &in_flight[head]);
+        head = (head + 1) % window;
+        count--;
     }
-    while (perma == true);
 
-    /* deregister */
-    mcip_uds_deregister(&sock);
+    safefree((void **) &line);
+    safefree((void **) &in_flight);
+
+    return failed;
+}
+
+/* fetch a branch of the cli with one command and print the requested keys from the index
+    returns the number of keys, that are not part of the branch */
+static int cli_subtree(struct s_m3_cli *cli, char *branch, char **keys, int keys_count)
+{
+    struct s_m3_cli_subtree *tree = NULL;
+    const char *value;
+    int failed = 0;
+    size_t i;
+    int k;
+
+    if (m3_cli_query_subtree(cli, branch, &tree, 6000) == false) {
+        printf("Failed to fetch %s (%d): %s\n", branch, errno, strerror(errno));
+        return -1;
+    }
+
+    if (keys_count == 0) {
+        for (i = 0; i < tree->count; i++) {
+            printf("%s=%s\n", tree->values[i].key, tree->values[i].value);
+        }
+    }
+
+    for (k = 0; k < keys_count; k++) {
+        value = m3_cli_subtree_get(tree, keys[k]);
+        if (value != NULL) {
+            printf("%s=%s\n", keys[k], value);
+        }
+        else {
+            printf("%s is unknown\n", keys[k]);
+            failed++;
+        }
+    }
+
+    m3_cli_subtree_free(&tree);
+
+    return failed;
+}
+
+/* print a watched value with the current time */
+static void print_watch_value(const char *key, const char *value)
+{
+    struct timespec now;
+    struct tm tm;
+    char stamp[32];
+
+    clock_gettime(CLOCK_REALTIME, &now);
+    localtime_r(&now.tv_sec, &tm);
+    strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%S", &tm);
+    printf("%s.%03ld %s=%s\n", stamp, now.tv_nsec / 1000000, key, value);
+    fflush(stdout);
+
+    return;
+}
+
+static volatile sig_atomic_t cli_watch_stop = 0;
+
+/* signal handler of the watch mode */
+static void cli_watch_signal(int signum)
+{
+    cli_watch_stop = 1;
+    return;
+}
+
+/* poll the keys separated by ',' every <interval> ms over one session and print only the values, that changed
+    the polls are started on an absolute timer, so the period does not drift with the time the answers take
+    this runs until SIGINT or SIGTERM, returns 0 then and -1 on error */
+static int cli_watch(struct s_m3_cli *cli, char *watch, int interval)
+{
+    char **keys = NULL;
+    char **values = NULL;
+    char **p;
+    const char *cli_answer;
+    char *key, *save = NULL;
+    struct timespec next, now;
+    struct sigaction action;
+    size_t len;
+    int count = 0, written, err = 0, i;
+
+    for (key = strtok_r(watch, ",", &save); key != NULL; key = strtok_r(NULL, ",", &save)) {
+        p = realloc(keys, (count + 1) * sizeof(char *));
+        if (p == NULL) {
+            printf("Failed to allocate the keys\n");
+            safefree((void **) &keys);
+            return -1;
+        }
+        keys = p;
+        keys[count++] = key;
+    }
+    if (count == 0) {
+        printf("No key to watch has been given\n");
+        return -1;
+    }
+    values = calloc(count, sizeof(char *));
+    if (values == NULL) {
+        printf("Failed to allocate the values\n");
+        safefree((void **) &keys);
+        return -1;
+    }
+
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = cli_watch_signal;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGTERM, &action, NULL);
+    sigaction(SIGINT, &action, NULL);
+
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    while (cli_watch_stop == 0) {
+        /* all keys of a poll are pipelined over the session */
+        for (written = 0; written < count; written++) {
+            if (m3_cli_write(cli, keys[written]) == false) {
+                err = errno;
+                break;
+            }
+        }
+
+        /* the answers are compared in the receive buffer, only changed values get copied */
+        for (i = 0; i < count && cli_watch_stop == 0; i++) {
+            if (i < written && m3_cli_read_answer_view(cli, &cli_answer, &len, interval) == false) {
+                err = errno;
+                written = i;
+            }
+            if (i >= written) {
+                /* the session gets reopened by the next poll, the error is only reported once */
+                cli_answer = strerror(err);
+            }
+            if (cli_watch_stop == 0 && (values[i] == NULL || strcmp(values[i], cli_answer) != 0)) {
+                print_watch_value(keys[i], cli_answer);
+                safefree((void **) &values[i]);
+                values[i] = strdup(cli_answer);
+            }
+        }
+
+        /* next poll, skip the polls that have been missed */
+        next.tv_sec += interval / 1000;
+        next.tv_nsec += (interval % 1000) * 1000000;
+        if (next.tv_nsec >= 1000000000) {
+            next.tv_sec++;
+            next.tv_nsec -= 1000000000;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (now.tv_sec > next.tv_sec || (now.tv_sec == next.tv_sec && now.tv_nsec > next.tv_nsec)) {
+            next = now;
+        }
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL) == EINTR && cli_watch_stop == 0);
+    }
 
-    /* free OID list */
-    mcip_oids_destroy(my_oids);
+    for (i = 0; i < count; i++) {
+        safefree((void **) &values[i]);
+    }
+    safefree((void **) &values);
+    safefree((void **) &keys);
 
     return 0;
 }
@@ -970,32 +2270,109 @@ static int main_cli_cmd(int argc, char **argv)
 {
     struct s_m3_cli *cli = NULL;
     char *cli_answer = NULL;
-    char *cmd;
-    static char strOpts[] = "h";
+    char *cmd = NULL;
+    char *file = NULL;
+    char *cache = NULL;
+    char *subtree = NULL;
+    char **keys = NULL;
+    char *watch = NULL;
+    bool cache_stats = false;
+    bool stats = false;
+    int keys_count = 0;
+    int interval = 1000;
+    int window = 8;
+    int failed = 0;
+    FILE *input;
+    static char strOpts[] = "hf:w:c:Ct:W:i:s";
     static struct option Opts[] = {
         { "help",           no_argument,        0, 'h' },
+        { "file",           required_argument,  0, 'f' },
+        { "window",         required_argument,  0, 'w' },
+        { "cache",          required_argument,  0, 'c' },
+        { "cache-stats",    no_argument,        0, 'C' },
+        { "subtree",        required_argument,  0, 't' },
+        { "watch",          required_argument,  0, 'W' },
+        { "interval",       required_argument,  0, 'i' },
+        { "stats",          no_argument,        0, 's' },
         { 0,                0,                  0,  0  }
     };
 
     /* get parameters */
-    if (get_options_cli(argc, argv, strOpts, Opts, &cmd,
+    if (get_options_cli(argc, argv, strOpts, Opts, &cmd, &file, &window, &cache, &cache_stats, &subtree, &keys, &keys_count, &watch, &interval, &stats,
                         "Send a command to the cli and print the answer") == false) {
         return -1;
     }
 
-    if (init_cli(&cli) == false) {
+    /* the statistics are recorded from the first connect on and printed on shutdown */
+    if (stats == true) {
+        setenv(M3_CLI_STATS_ENV, "stdout", 1);
+    }
+
+    if (init_cli(&cli, cache) == false) {
         return -1;
     }
 
+    /* only print the cache counters */
+    if (cache_stats == true && cmd == NULL && file == NULL && subtree == NULL && watch == NULL) {
+        m3_cli_cache_print_stats(cli->cache, stdout);
+        m3_cli_shutdown(&cli);
+        return 0;
+    }
+
+    /* batch mode: send all commands of the file over this session */
+    if (file != NULL) {
+        if (strcmp(file, "-") == 0) {
+            input = stdin;
+        }
+        else if ((input = fopen(file, "r")) == NULL) {
+            printf("Failed to open %s (%d): %s\n", file, errno, strerror(errno));
+            m3_cli_shutdown(&cli);
+            return -1;
+        }
+
+        failed = cli_batch(cli, input, window);
+
+        if (input != stdin) {
+            fclose(input);
+        }
+        if (cache_stats == true) {
+            m3_cli_cache_print_stats(cli->cache, stdout);
+        }
+        m3_cli_shutdown(&cli);
+
+        return (failed == 0) ? 0 : -1;
+    }
+
+    /* watch mode: keep the session and print the changes */
+    if (watch != NULL) {
+        failed = cli_watch(cli, watch, interval);
+        m3_cli_shutdown(&cli);
+
+        return (failed == 0) ? 0 : -1;
+    }
+
+    /* subtree mode: one command for the whole branch, the keys are looked up locally */
+    if (subtree != NULL) {
+        failed = cli_subtree(cli, subtree, keys, keys_count);
+        if (cache_stats == true) {
+            m3_cli_cache_print_stats(cli->cache, stdout);
+        }
+        m3_cli_shutdown(&cli);
+
+        return (failed == 0) ? 0 : -1;
+    }
+
     /* send the command */
     if (cmd != NULL) {
         if (m3_cli_query(cli, cmd, &cli_answer, 6000) == false) {
             printf("Failed to send the command (%d): %s\n", errno, strerror(errno));
+            m3_cli_shutdown(&cli);
             return -1;
         }
     }
     else {
         printf("No command has been given\n");
+        m3_cli_shutdown(&cli);
         return 0;
     }
 
@@ -1004,6 +2381,9 @@ static int main_cli_cmd(int argc, char **argv)
     }
     safefree((void **) & cli_answer);
 
+    if (cache_stats == true) {
+        m3_cli_cache_print_stats(cli->cache, stdout);
+    }
     m3_cli_shutdown(&cli);
 
     return 0;
@@ -1013,7 +2393,7 @@ static int main_cli_cmd(int argc, char **argv)
 static int main_container(int argc, char **argv)
 {
     struct s_m3_cli *cli = NULL;
-    char *cli_answer = NULL;
+    struct s_m3_cli_action actions[3];
     char *name = NULL;
     char *cmd = NULL;
     int action = 2; /* default: restart */
@@ -1039,7 +2419,7 @@ static int main_container(int argc, char **argv)
         return -1;
     }
 
-    if (init_cli(&cli) == false) {
+    if (init_cli(&cli, NULL) == false) {
         return -1;
     }
 
@@ -1047,6 +2427,7 @@ static int main_container(int argc, char **argv)
     if (name == NULL) {
         if (uname(&buf) != 0) {
             printf("Could not get the host name of this container\n");
+            m3_cli_shutdown(&cli);
             return -1;
         }
         cmd = calloc(1, strlen(buf.nodename) + strlen("help.debug.container_state.name=") + 1);
@@ -1058,40 +2439,29 @@ static int main_container(int argc, char **argv)
         sprintf(cmd, "help.debug.container_state.name=%s", name);
     }
 
-    if (m3_cli_query(cli, cmd, &cli_answer, 6000) == false) {
-        printf("Failed to send the command (%d): %s\n", errno, strerror(errno));
-        safefree((void **) &cmd);
-        return -1;
-    }
-    safefree((void **) &cmd);
-    safefree((void **) & cli_answer);
-
-    /* send the command restart */
+    /* send the name, the action and the command to execute it at once */
+    actions[0].command = cmd;
     if (action == 2) {
-        ret = m3_cli_query(cli, cmd_restart, &cli_answer, 6000);
+        actions[1].command = cmd_restart;
     }
-    /* send the command restart */
     else if (action == 1) {
-        ret = m3_cli_query(cli, cmd_start, &cli_answer, 6000);
+        actions[1].command = cmd_start;
     }
     else {
-        ret = m3_cli_query(cli, cmd_stop, &cli_answer, 6000);
-    }
-    if (ret == false) {
-        printf("Failed to send the command (%d): %s\n", errno, strerror(errno));
-        return -1;
+        actions[1].command = cmd_stop;
     }
-    safefree((void **) & cli_answer);
+    actions[2].command = cmd_submit;
 
-    /* send the command to execute the restart */
-    if (m3_cli_query(cli, cmd_submit, &cli_answer, 6000) == false) {
+    ret = m3_cli_transaction(cli, actions, 3, 6000);
+    if (ret == false) {
         printf("Failed to send the command (%d): %s\n", errno, strerror(errno));
-        return -1;
     }
+    m3_cli_transaction_free(actions, 3);
+    safefree((void **) &cmd);
 
     m3_cli_shutdown(&cli);
 
-    return 0;
+    return (ret == true) ? 0 : -1;
 }
 
 
@@ -0,0 +1,121 @@
+#include "mcip_event.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+
+/* copy a word of the text, it is truncated to the size of the destination */
+static void mcip_event_copy(char *dst, size_t size, const char *src, size_t len)
+{
+    if (len >= size) {
+        len = size - 1;
+    }
+    memcpy(dst, src, len);
+    dst[len] = '\0';
+    return;
+}
+
+/* find the first <slot>.<input> in the text */
+static void mcip_event_input(struct s_mcip_event *event)
+{
+    const char *t = event->text;
+    size_t n = event->text_len, i, j;
+
+    for (i = 0; i < n; i++) {
+        if (isdigit((unsigned char) t[i]) == 0 || (i > 0 && isalnum((unsigned char) t[i - 1]) != 0)) {
+            continue;
+        }
+        for (j = i; j < n && isdigit((unsigned char) t[j]); j++);
+        if (j + 1 >= n || t[j] != '.' || isdigit((unsigned char) t[j + 1]) == 0) {
+            continue;
+        }
+        for (j++; j < n && isdigit((unsigned char) t[j]); j++);
+        mcip_event_copy(event->input, sizeof(event->input), t + i, j - i);
+        return;
+    }
+    return;
+}
+
+/* current time (CLOCK_MONOTONIC) in ns */
+int64_t mcip_event_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* format a time as ISO 8601 */
+void mcip_event_time(char *buffer, size_t size, const struct timespec *time)
+{
+    struct tm tm;
+    size_t n;
+
+    gmtime_r(&time->tv_sec, &tm);
+    n = strftime(buffer, size, "%Y-%m-%dT%H:%M:%S", &tm);
+    snprintf(buffer + n, size - n, ".%06ldZ", time->tv_nsec / 1000);
+    return;
+}
+
+/* decode a telegram */
+void mcip_event_decode(struct s_mcip_event *event, const uint8_t *p, size_t len)
+{
+    const char *t;
+    size_t end, start;
+
+    memset(event, 0, sizeof(struct s_mcip_event));
+    event->telegram = p;
+    event->len = len;
+    event->type = MCIP_EVENT_OTHER;
+    event->pulses = -1;
+    if (len > 11 && p[11] == 'i') {
+        event->type = MCIP_EVENT_INPUT;
+    }
+    else if (len > 11 && p[11] == 'p') {
+        event->type = MCIP_EVENT_PULSE;
+    }
+    if (len < MCIP_EVENT_TEXT_OFFSET) {
+        event->text = "";
+        return;
+    }
+    event->oid = p[5] | p[6] << 8;
+    event->text = (const char *) p + MCIP_EVENT_TEXT_OFFSET;
+    event->text_len = len - MCIP_EVENT_TEXT_OFFSET;
+    if (event->type == MCIP_EVENT_OTHER) {
+        return;
+    }
+
+    mcip_event_input(event);
+    t = event->text;
+    end = event->text_len;
+    while (end > 0 && isspace((unsigned char) t[end - 1])) {
+        end--;
+    }
+
+    /* the state is the last word, the number of pulses the number at the end */
+    for (start = end; start > 0 && isspace((unsigned char) t[start - 1]) == 0; start--);
+    if (event->type == MCIP_EVENT_INPUT) {
+        mcip_event_copy(event->state, sizeof(event->state), t + start, end - start);
+    }
+    else if (start < end && isdigit((unsigned char) t[start])) {
+        /* the text is not terminated */
+        for (event->pulses = 0; start < end && isdigit((unsigned char) t[start]); start++) {
+            event->pulses = event->pulses * 10 + (t[start] - '0');
+        }
+    }
+
+    return;
+}
+
+/* name of the type of an event */
+const char *mcip_event_type_string(enum mcip_event_type type)
+{
+    switch (type) {
+        case MCIP_EVENT_INPUT:
+            return "input";
+        case MCIP_EVENT_PULSE:
+            return "pulse";
+        default:
+            return "other";
+    }
+}
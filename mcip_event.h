@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+
+#define MCIP_EVENT_TEXT_OFFSET  7       /* the text of a telegram starts after the header and the OID */
+
+enum mcip_event_type {
+    MCIP_EVENT_OTHER,                   /* anything else, e.g. SMS */
+    MCIP_EVENT_INPUT,                   /* input change event, byte 11 is 'i' (e.g. 2.1 is now LOW) */
+    MCIP_EVENT_PULSE                    /* pulse event, byte 11 is 'p' (e.g. 2.1 pulses detected: 1) */
+};
+
+/* times of a received telegram: CLOCK_MONOTONIC (ns) to measure latencies and CLOCK_REALTIME to compare with other
+    clocks, all telegrams of one read get the same times */
+struct s_mcip_stamps {
+    int64_t readable;                   /* the socket has been reported readable */
+    int64_t complete;                   /* the read that completed the telegram has returned */
+    struct timespec realtime;           /* CLOCK_REALTIME when the read has returned */
+};
+
+/* fields of a received telegram, the decoding is done once and shared by the outputs and filters */
+struct s_mcip_event {
+    const uint8_t *telegram;            /* the whole telegram including the header */
+    size_t len;                         /* length of the telegram */
+    enum mcip_event_type type;
+    uint16_t oid;                       /* OID the telegram has been sent to (bytes 5 and 6) */
+    const char *text;                   /* text of the telegram (not terminated) */
+    size_t text_len;
+    char input[16];                     /* input of an input or pulse event (e.g. "2.1"), empty if not found */
+    char state[16];                     /* state of an input change event (the last word, e.g. "LOW"), empty if not found */
+    long pulses;                        /* number of pulses of a pulse event, -1 if not found */
+    struct s_mcip_stamps stamps;        /* set by the receiver, 0 if unknown */
+};
+
+/* current time (CLOCK_MONOTONIC) in ns */
+int64_t mcip_event_now_ns(void);
+
+/* format a time (CLOCK_REALTIME) as ISO 8601 in UTC with microseconds, e.g. 2024-01-31T12:00:00.000000Z */
+void mcip_event_time(char *buffer, size_t size, const struct timespec *time);
+
+/* decode a telegram, the event points into the telegram (the stamps are left 0) */
+void mcip_event_decode(struct s_mcip_event *event, const uint8_t *p, size_t len);
+
+/* name of the type of an event */
+const char *mcip_event_type_string(enum mcip_event_type type);
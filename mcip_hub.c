@@ -0,0 +1,438 @@
+#define _GNU_SOURCE
+#include "mcip_hub.h"
+#include "mcip_listener.h"
+#include "event_loop.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+struct s_hub;
+
+struct s_hub_subscriber {
+    struct s_hub *hub;          /* hub the subscriber is connected to */
+    int fd;                     /* file descriptor of the subscriber connection */
+    bool subscribed;            /* the subscription has been received */
+    char line[MCIP_HUB_FILTER_MAX]; /* subscription received so far */
+    size_t line_len;
+    struct s_mcip_hub_filter filter;
+    uint8_t *out;               /* telegrams, that have not been sent yet */
+    size_t out_len;             /* number of bytes in the output buffer */
+    size_t out_size;            /* allocated size of the output buffer */
+    bool writable;              /* the connection is watched for EPOLLOUT */
+    uint64_t dropped;           /* telegrams dropped because the subscriber is too slow */
+};
+
+struct s_hub {
+    struct s_event_loop *loop;
+    int listen_fd;
+    struct s_hub_subscriber *subscribers[MCIP_HUB_SUBSCRIBERS];
+};
+
+void safefree(void **pp);
+
+/* parse a subscription */
+bool mcip_hub_filter_parse(struct s_mcip_hub_filter *filter, const char *subscription)
+{
+    char *copy, *item, *save = NULL;
+    long oid;
+    bool ok = true;
+
+    memset(filter, 0, sizeof(struct s_mcip_hub_filter));
+    copy = strdup(subscription);
+    if (copy == NULL) {
+        return false;
+    }
+
+    for (item = strtok_r(copy, ", \t\r", &save); ok == true && item != NULL; item = strtok_r(NULL, ", \t\r", &save)) {
+        if (strcmp(item, "all") == 0) {
+            filter->classes |= MCIP_HUB_ALL;
+        }
+        else if (strcmp(item, "input") == 0) {
+            filter->classes |= MCIP_HUB_INPUT;
+        }
+        else if (strcmp(item, "pulse") == 0) {
+            filter->classes |= MCIP_HUB_PULSE;
+        }
+        else if (strcmp(item, "other") == 0) {
+            filter->classes |= MCIP_HUB_OTHER;
+        }
+        else if (strncmp(item, "oid=", 4) == 0 && filter->oid_count < 8) {
+            oid = strtol(item + 4, NULL, 10);
+            if (oid < 0 || oid > 65535) {
+                ok = false;
+            }
+            filter->oids[filter->oid_count++] = (uint16_t) oid;
+        }
+        else {
+            ok = false;
+        }
+    }
+    safefree((void **) &copy);
+
+    if (filter->classes == 0) {
+        filter->classes = MCIP_HUB_ALL;
+    }
+
+    return ok;
+}
+
+/* check if a telegram matches a subscription */
+bool mcip_hub_filter_match(const struct s_mcip_hub_filter *filter, const uint8_t *p, size_t len)
+{
+    uint32_t class = MCIP_HUB_OTHER;
+    uint16_t oid;
+    int i;
+
+    if (len > 11 && p[11] == 'i') {
+        class = MCIP_HUB_INPUT;
+    }
+    else if (len > 11 && p[11] == 'p') {
+        class = MCIP_HUB_PULSE;
+    }
+    if ((filter->classes & class) == 0) {
+        return false;
+    }
+
+    if (filter->oid_count == 0) {
+        return true;
+    }
+    if (len < 7) {
+        return false;
+    }
+    oid = p[5] | p[6] << 8;
+    for (i = 0; i < filter->oid_count; i++) {
+        if (filter->oids[i] == oid) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/* path of the socket of the hub */
+const char *mcip_hub_socket(void)
+{
+    const char *path = getenv(MCIP_HUB_ENV);
+
+    return (path != NULL) ? path : MCIP_HUB_SOCKET;
+}
+
+/* create the listening socket of the hub
+    the subscribers get every telegram (e.g. the text of all SMS), so the socket gets the owner, group and permissions
+    of the MCIP socket (but never for others); a socket of a hub that is still running is not taken away */
+static int hub_listen(const char *path)
+{
+    struct sockaddr_un addr;
+    struct stat st;
+    mode_t mask;
+    int fd, ret;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+
+    /* only remove a stale socket of a former hub */
+    if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) == 0) {
+        close(fd);
+        errno = EADDRINUSE;
+        return -1;
+    }
+    if (errno == ECONNREFUSED) {
+        unlink(path);
+    }
+    else if (errno != ENOENT) {
+        close(fd);
+        return -1;
+    }
+    close(fd);
+
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+
+    /* the socket is only accessible by its owner until it gets the permissions of the MCIP socket */
+    mask = umask(0177);
+    ret = bind(fd, (struct sockaddr *) &addr, sizeof(addr));
+    umask(mask);
+    if (ret != 0 || listen(fd, 64) != 0) {
+        close(fd);
+        return -1;
+    }
+    if (stat(MCIP_SOCKET, &st) == 0 && (chown(path, st.st_uid, st.st_gid) != 0 || chmod(path, st.st_mode & 0660) != 0)) {
+        close(fd);
+        unlink(path);
+        return -1;
+    }
+
+    return fd;
+}
+
+/* disconnect a subscriber */
+static void hub_drop(struct s_hub_subscriber *subscriber)
+{
+    struct s_hub *hub = subscriber->hub;
+    int i;
+
+    if (subscriber->dropped > 0) {
+        printf("Subscriber %d dropped %llu telegrams\n", subscriber->fd, (unsigned long long) subscriber->dropped);
+    }
+    event_loop_remove(hub->loop, subscriber->fd);
+    close(subscriber->fd);
+    for (i = 0; i < MCIP_HUB_SUBSCRIBERS; i++) {
+        if (hub->subscribers[i] == subscriber) {
+            hub->subscribers[i] = NULL;
+        }
+    }
+    safefree((void **) &subscriber->out);
+    safefree((void **) &subscriber);
+    return;
+}
+
+/* send as much of the output buffer as the socket takes
+    on error, false is returned */
+static bool hub_flush(struct s_hub_subscriber *subscriber)
+{
+    ssize_t x;
+
+    while (subscriber->out_len > 0) {
+        x = send(subscriber->fd, subscriber->out, subscriber->out_len, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (x == -1) {
+            if (errno == EAGAIN || errno == EINTR) {
+                break;
+            }
+            return false;
+        }
+        memmove(subscriber->out, subscriber->out + x, subscriber->out_len - x);
+        subscriber->out_len -= x;
+    }
+
+    /* wait until the socket takes more */
+    if (subscriber->writable != (subscriber->out_len > 0)) {
+        subscriber->writable = (subscriber->out_len > 0);
+        return event_loop_modify(subscriber->hub->loop, subscriber->fd, subscriber->writable ? EPOLLIN | EPOLLOUT : EPOLLIN);
+    }
+
+    return true;
+}
+
+/* append a telegram to the output buffer of a subscriber */
+static bool hub_queue(struct s_hub_subscriber *subscriber, const uint8_t *p, size_t len)
+{
+    size_t new_size;
+    uint8_t *out;
+
+    /* a subscriber that does not read loses telegrams, never parts of one */
+    if (subscriber->out_len + len > MCIP_HUB_QUEUE_MAX) {
+        subscriber->dropped++;
+        return true;
+    }
+
+    if (subscriber->out_len + len > subscriber->out_size) {
+        new_size = subscriber->out_size ? subscriber->out_size : 4096;
+        while (new_size < subscriber->out_len + len) {
+            new_size *= 2;
+        }
+        out = realloc(subscriber->out, new_size);
+        if (out == NULL) {
+            subscriber->dropped++;
+            return true;
+        }
+        subscriber->out = out;
+        subscriber->out_size = new_size;
+    }
+    memcpy(subscriber->out + subscriber->out_len, p, len);
+    subscriber->out_len += len;
+
+    return hub_flush(subscriber);
+}
+
+/* a telegram has been received from MCIP: pass it on to every matching subscriber */
+static bool hub_telegram(const uint8_t *p, size_t len, const struct s_mcip_stamps *stamps, void *ctx)
+{
+    struct s_hub *hub = ctx;
+    struct s_hub_subscriber *subscriber;
+    int i;
+
+    for (i = 0; i < MCIP_HUB_SUBSCRIBERS; i++) {
+        subscriber = hub->subscribers[i];
+        if (subscriber == NULL || subscriber->subscribed == false || mcip_hub_filter_match(&subscriber->filter, p, len) == false) {
+            continue;
+        }
+        if (hub_queue(subscriber, p, len) == false) {
+            hub_drop(subscriber);
+        }
+    }
+
+    return true;
+}
+
+/* read the subscription (or the end of the connection) of a subscriber */
+static void hub_subscriber_read(struct s_hub_subscriber *subscriber)
+{
+    char buffer[256];
+    char *nl;
+    ssize_t x;
+
+    if (subscriber->subscribed == true) {
+        /* nothing is expected after the subscription */
+        x = read(subscriber->fd, buffer, sizeof(buffer));
+        if (x == 0 || (x == -1 && errno != EAGAIN && errno != EINTR)) {
+            hub_drop(subscriber);
+        }
+        return;
+    }
+
+    x = read(subscriber->fd, subscriber->line + subscriber->line_len, sizeof(subscriber->line) - 1 - subscriber->line_len);
+    if (x == 0 || (x == -1 && errno != EAGAIN && errno != EINTR)) {
+        hub_drop(subscriber);
+        return;
+    }
+    if (x < 0) {
+        return;
+    }
+    subscriber->line_len += x;
+    subscriber->line[subscriber->line_len] = '\0';
+
+    nl = strchr(subscriber->line, '\n');
+    if (nl == NULL) {
+        /* the subscription is too long */
+        if (subscriber->line_len == sizeof(subscriber->line) - 1) {
+            hub_drop(subscriber);
+        }
+        return;
+    }
+    *nl = '\0';
+
+    if (mcip_hub_filter_parse(&subscriber->filter, subscriber->line) == false) {
+        printf("Invalid subscription: %s\n", subscriber->line);
+        hub_drop(subscriber);
+        return;
+    }
+    subscriber->subscribed = true;
+
+    return;
+}
+
+/* event of a subscriber connection */
+static void hub_subscriber_event(struct s_event_loop *loop, int fd, uint32_t events, void *ctx)
+{
+    struct s_hub_subscriber *subscriber = ctx;
+
+    if (events & EPOLLOUT) {
+        if (hub_flush(subscriber) == false) {
+            hub_drop(subscriber);
+            return;
+        }
+    }
+    if (events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+        hub_subscriber_read(subscriber);
+    }
+    return;
+}
+
+/* accept a new subscriber */
+static void hub_accept(struct s_event_loop *loop, int fd, uint32_t events, void *ctx)
+{
+    struct s_hub *hub = ctx;
+    struct s_hub_subscriber *subscriber;
+    int client, i;
+
+    client = accept4(fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (client < 0) {
+        return;
+    }
+
+    for (i = 0; i < MCIP_HUB_SUBSCRIBERS && hub->subscribers[i] != NULL; i++);
+    subscriber = (i < MCIP_HUB_SUBSCRIBERS) ? calloc(1, sizeof(struct s_hub_subscriber)) : NULL;
+    if (subscriber == NULL) {
+        close(client);
+        return;
+    }
+    subscriber->hub = hub;
+    subscriber->fd = client;
+    if (event_loop_add(loop, client, EPOLLIN, hub_subscriber_event, subscriber) == false) {
+        close(client);
+        safefree((void **) &subscriber);
+        return;
+    }
+    hub->subscribers[i] = subscriber;
+
+    return;
+}
+
+/* stop the hub on SIGINT and SIGTERM */
+static void hub_signal(struct s_event_loop *loop, int fd, uint32_t signum, void *ctx)
+{
+    event_loop_stop(loop);
+    return;
+}
+
+/* register to MCIP with the OIDs and serve the subscribers until SIGINT or SIGTERM */
+int mcip_hub_run(const char *path, const uint16_t *oids, int count)
+{
+    static const int signals[] = { SIGINT, SIGTERM, 0 };
+    struct s_mcip_listener listener;
+    struct s_hub hub;
+    int ret = 0, i;
+
+    memset(&hub, 0, sizeof(hub));
+    hub.loop = event_loop_create();
+    if (hub.loop == NULL || event_loop_signals(hub.loop, signals, hub_signal, NULL) == -1) {
+        printf("Failed to create the event loop (%d): %s\n", errno, strerror(errno));
+        event_loop_free(&hub.loop);
+        return -1;
+    }
+
+    hub.listen_fd = hub_listen(path);
+    if (hub.listen_fd < 0 || event_loop_add(hub.loop, hub.listen_fd, EPOLLIN, hub_accept, &hub) == false) {
+        printf("Failed to listen on %s (%d): %s\n", path, errno, strerror(errno));
+        if (hub.listen_fd >= 0) {
+            close(hub.listen_fd);
+        }
+        event_loop_free(&hub.loop);
+        return -1;
+    }
+
+    if (mcip_listener_open(&listener, hub.loop, oids, count, hub_telegram, &hub) == false) {
+        ret = -1;
+    }
+    else {
+        if (event_loop_run(hub.loop) == false) {
+            printf("Failed to wait for MCIP (%d): %s\n", errno, strerror(errno));
+            ret = -1;
+        }
+        if (listener.failed == true) {
+            ret = -1;
+        }
+        mcip_listener_close(&listener);
+    }
+
+    for (i = 0; i < MCIP_HUB_SUBSCRIBERS; i++) {
+        if (hub.subscribers[i] != NULL) {
+            hub_drop(hub.subscribers[i]);
+        }
+    }
+    event_loop_remove(hub.loop, hub.listen_fd);
+    close(hub.listen_fd);
+    unlink(path);
+    event_loop_free(&hub.loop);
+
+    return ret;
+}
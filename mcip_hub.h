@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+/* socket of the hub, the environment variable overrides it */
+#define MCIP_HUB_SOCKET         "/var/run/mcip-hub.socket"
+#define MCIP_HUB_ENV            "MCIP_HUB_SOCKET"
+
+#define MCIP_HUB_SUBSCRIBERS    64          /* maximum number of subscribers */
+#define MCIP_HUB_QUEUE_MAX      (1 << 20)   /* telegrams are dropped for a subscriber that has this many bytes queued */
+#define MCIP_HUB_FILTER_MAX     256         /* maximum length of a subscription */
+
+/* classes of telegrams, told apart by byte 11 */
+#define MCIP_HUB_INPUT          0x01        /* input change event ('i') */
+#define MCIP_HUB_PULSE          0x02        /* pulse event ('p') */
+#define MCIP_HUB_OTHER          0x04        /* anything else, e.g. SMS */
+#define MCIP_HUB_ALL            (MCIP_HUB_INPUT | MCIP_HUB_PULSE | MCIP_HUB_OTHER)
+
+/* the hub registers to MCIP once and passes the telegrams on to any number of local subscribers
+    a subscriber connects to the socket of the hub and sends its subscription as one line, then it receives every
+    matching telegram unchanged (including the header), so it can read them as if it was registered to MCIP
+    the subscription is a list separated by ',' of
+        input, pulse, other     classes of telegrams (all if none is given)
+        oid=<oid>               telegrams to this OID (bytes 5 and 6) only, all if none is given
+        all                     everything
+    the socket of the hub gets the owner, group and permissions of the MCIP socket, but no access for others */
+
+/* subscription of a subscriber */
+struct s_mcip_hub_filter {
+    uint32_t classes;                       /* MCIP_HUB_INPUT | ... */
+    uint16_t oids[8];                       /* OIDs, any if there is none */
+    int oid_count;
+};
+
+/* parse a subscription
+    on error, false is returned */
+bool mcip_hub_filter_parse(struct s_mcip_hub_filter *filter, const char *subscription);
+
+/* check if a telegram matches a subscription */
+bool mcip_hub_filter_match(const struct s_mcip_hub_filter *filter, const uint8_t *p, size_t len);
+
+/* path of the socket of the hub */
+const char *mcip_hub_socket(void);
+
+/* register to MCIP with the OIDs and serve the subscribers until SIGINT or SIGTERM
+    returns 0 if stopped by a signal, -1 on error (the reason has been printed, e.g. another hub is running) */
+int mcip_hub_run(const char *path, const uint16_t *oids, int count);
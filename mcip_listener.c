@@ -0,0 +1,200 @@
+#define _GNU_SOURCE
+#include "mcip_listener.h"
+#include "libmcip.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/socket.h>
+
+void safefree(void **pp);
+
+static void mcip_listener_read(struct s_event_loop *loop, int fd, uint32_t events, void *ctx);
+
+/* send the subscription to the hub */
+static bool mcip_listener_subscribe(struct s_mcip_listener *listener)
+{
+    char *line = NULL;
+    size_t len;
+    bool ok;
+
+    if (asprintf(&line, "%s\n", listener->filter) == -1) {
+        return false;
+    }
+    len = strlen(line);
+    ok = (send(listener->sock, line, len, MSG_NOSIGNAL) == (ssize_t) len);
+    safefree((void **) &line);
+
+    return ok;
+}
+
+/* register to MCIP (or subscribe at the hub) and add the socket to the loop */
+static bool mcip_listener_register(struct s_mcip_listener *listener)
+{
+    int i;
+
+    if (listener->hub != NULL) {
+        listener->sock = mcip_open_uds_socket(listener->hub);
+        if (listener->sock < 0 || mcip_listener_subscribe(listener) == false) {
+            printf("Failed to subscribe at the MCIP hub %s\n", listener->hub);
+            if (listener->sock >= 0) {
+                close(listener->sock);
+            }
+            listener->sock = -1;
+            return false;
+        }
+    }
+    else {
+        /* init my OIDs */
+        listener->my_oids = NULL;
+        for (i = 0; i < listener->oid_count; i++) {
+            mcip_oid_append(&listener->my_oids, listener->oids[i]);
+        }
+
+        /* connect to MCIP via UDS (Unix Domain Socket) */
+        listener->sock = mcip_uds_register(MCIP_SOCKET, listener->my_oids);
+        if (listener->sock == -1) {
+            printf("Failed to register to MCIP\n");
+            mcip_oids_destroy(listener->my_oids);
+            listener->my_oids = NULL;
+            return false;
+        }
+    }
+
+    if (event_loop_add(listener->loop, listener->sock, EPOLLIN, mcip_listener_read, listener) == false) {
+        printf("Failed to watch the MCIP socket\n");
+        if (listener->hub != NULL) {
+            close(listener->sock);
+        }
+        else {
+            mcip_uds_deregister(&listener->sock);
+            mcip_oids_destroy(listener->my_oids);
+            listener->my_oids = NULL;
+        }
+        listener->sock = -1;
+        return false;
+    }
+
+    return true;
+}
+
+/* remove the socket from the loop and deregister */
+static void mcip_listener_deregister(struct s_mcip_listener *listener)
+{
+    if (listener->sock != -1) {
+        event_loop_remove(listener->loop, listener->sock);
+        if (listener->hub != NULL) {
+            close(listener->sock);
+        }
+        else {
+            mcip_uds_deregister(&listener->sock);
+        }
+        listener->sock = -1;
+    }
+    if (listener->my_oids != NULL) {
+        mcip_oids_destroy(listener->my_oids);
+        listener->my_oids = NULL;
+    }
+    return;
+}
+
+/* the socket is readable: read and hand every complete telegram to the callback */
+static void mcip_listener_read(struct s_event_loop *loop, int fd, uint32_t events, void *ctx)
+{
+    struct s_mcip_listener *listener = ctx;
+    struct s_mcip_stamps stamps;
+    const uint8_t *p;
+    size_t length;
+    ssize_t x;
+
+    /* the telegrams are stamped as soon as they have been read */
+    stamps.readable = mcip_event_now_ns();
+    x = mcip_stream_read(&listener->stream, fd);
+    stamps.complete = mcip_event_now_ns();
+    clock_gettime(CLOCK_REALTIME, &stamps.realtime);
+
+    if (x <= 0) {
+        printf("Failed to read from MCIP\n");
+
+        /* reconnect to MCIP */
+        mcip_listener_deregister(listener);
+        mcip_stream_reset(&listener->stream);
+        if (mcip_listener_register(listener) == false) {
+            listener->failed = true;
+            event_loop_stop(loop);
+        }
+        return;
+    }
+
+    /* a read may have returned several telegrams */
+    while ((p = mcip_stream_next(&listener->stream, &length)) != NULL) {
+        if (listener->callback(p, length, &stamps, listener->ctx) == false) {
+            event_loop_stop(loop);
+            return;
+        }
+    }
+    return;
+}
+
+/* initialise the listener and connect */
+static bool mcip_listener_start(struct s_mcip_listener *listener)
+{
+    if (mcip_stream_init(&listener->stream) == false) {
+        printf("Failed to allocate the receive buffer\n");
+        mcip_listener_close(listener);
+        return false;
+    }
+    if (mcip_listener_register(listener) == false) {
+        mcip_listener_close(listener);
+        return false;
+    }
+
+    return true;
+}
+
+/* register to MCIP and watch the socket on the loop */
+bool mcip_listener_open(struct s_mcip_listener *listener, struct s_event_loop *loop, const uint16_t *oids, int count,
+                        mcip_listener_callback callback, void *ctx)
+{
+    memset(listener, 0, sizeof(struct s_mcip_listener));
+    listener->loop = loop;
+    listener->sock = -1;
+    listener->callback = callback;
+    listener->ctx = ctx;
+
+    if (count < 1 || count > MCIP_LISTENER_OIDS) {
+        printf("Invalid number of OIDs: %d\n", count);
+        return false;
+    }
+    memcpy(listener->oids, oids, count * sizeof(uint16_t));
+    listener->oid_count = count;
+
+    return mcip_listener_start(listener);
+}
+
+/* subscribe at the MCIP hub instead of registering to MCIP */
+bool mcip_listener_open_hub(struct s_mcip_listener *listener, struct s_event_loop *loop, const char *hub, const char *filter,
+                            mcip_listener_callback callback, void *ctx)
+{
+    memset(listener, 0, sizeof(struct s_mcip_listener));
+    listener->loop = loop;
+    listener->sock = -1;
+    listener->callback = callback;
+    listener->ctx = ctx;
+    listener->hub = strdup(hub);
+    listener->filter = strdup(filter);
+
+    return mcip_listener_start(listener);
+}
+
+/* deregister and free the listener */
+void mcip_listener_close(struct s_mcip_listener *listener)
+{
+    mcip_listener_deregister(listener);
+    mcip_stream_free(&listener->stream);
+    safefree((void **) &listener->hub);
+    safefree((void **) &listener->filter);
+    return;
+}
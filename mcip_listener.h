@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include "event_loop.h"
+#include "mcip_stream.h"
+#include "mcip_event.h"
+
+#define MCIP_SOCKET             "/devices/mcip.socket"
+#define MCIP_LISTENER_OIDS      16      /* maximum number of OIDs of a listener */
+
+/* called for every complete telegram (including the header) with the times it has been received, return false to stop
+    the loop */
+typedef bool (*mcip_listener_callback)(const uint8_t *telegram, size_t len, const struct s_mcip_stamps *stamps, void *ctx);
+
+/* registration to MCIP (or subscription at the MCIP hub) that receives telegrams on an event loop, it registers
+    (subscribes) again if reading fails */
+struct s_mcip_listener {
+    struct s_event_loop *loop;
+    uint16_t oids[MCIP_LISTENER_OIDS];  /* OIDs to register */
+    int oid_count;
+    struct oid_list *my_oids;
+    char *hub;                          /* socket of the hub, NULL if registered to MCIP directly */
+    char *filter;                       /* subscription at the hub */
+    int sock;                           /* registered socket, it can also be used for sending */
+    struct s_mcip_stream stream;
+    mcip_listener_callback callback;
+    void *ctx;
+    bool failed;                        /* the loop has been stopped because MCIP is not available any more */
+};
+
+/* register to MCIP with the OIDs and watch the socket on the loop
+    on error, false is returned (the reason has been printed) */
+bool mcip_listener_open(struct s_mcip_listener *listener, struct s_event_loop *loop, const uint16_t *oids, int count,
+                        mcip_listener_callback callback, void *ctx);
+
+/* subscribe at the MCIP hub (see mcip_hub.h) instead of registering to MCIP, the telegrams are the same
+    on error, false is returned (the reason has been printed) */
+bool mcip_listener_open_hub(struct s_mcip_listener *listener, struct s_event_loop *loop, const char *hub, const char *filter,
+                            mcip_listener_callback callback, void *ctx);
+
+/* deregister and free the listener */
+void mcip_listener_close(struct s_mcip_listener *listener);
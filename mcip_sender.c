@@ -0,0 +1,169 @@
+#include "mcip_sender.h"
+#include "libmcip.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+void safefree(void **pp);
+
+/* current time (CLOCK_MONOTONIC) in ns */
+static int64_t mcip_sender_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* initialise a sender */
+bool mcip_sender_init(struct s_mcip_sender *sender, int sock, uint16_t to_oid, uint16_t my_oid, size_t coalesce, int rate)
+{
+    memset(sender, 0, sizeof(struct s_mcip_sender));
+    sender->sock = sock;
+    sender->to_oid = to_oid;
+    sender->my_oid = my_oid;
+    sender->coalesce = (coalesce > MCIP_SENDER_MAX) ? MCIP_SENDER_MAX : coalesce;
+    sender->rate = rate;
+
+    sender->frame = malloc(MCIP_SENDER_MAX);
+    if (sender->frame == NULL) {
+        errno = ENOMEM;
+        return false;
+    }
+
+    /* the OIDs stay in front of every telegram */
+    sender->frame[0] = to_oid & 0x00FF;
+    sender->frame[1] = (to_oid & 0xFF00) >> 8;
+    sender->header = 2;
+    if (my_oid != 0) {
+        sender->frame[2] = my_oid & 0x00FF;
+        sender->frame[3] = (my_oid & 0xFF00) >> 8;
+        sender->header = 4;
+    }
+    sender->len = sender->header;
+
+    return true;
+}
+
+/* largest message that can be sent */
+size_t mcip_sender_max(const struct s_mcip_sender *sender)
+{
+    return MCIP_SENDER_MAX - sender->header;
+}
+
+/* wait until the messages of the telegram may be sent */
+static void mcip_sender_wait(struct s_mcip_sender *sender)
+{
+    struct timespec next;
+    int64_t now;
+
+    if (sender->rate == 0) {
+        return;
+    }
+
+    /* a sender that has been idle does not get to send a burst */
+    now = mcip_sender_now();
+    if (sender->next_ns > now) {
+        next.tv_sec = sender->next_ns / 1000000000;
+        next.tv_nsec = sender->next_ns % 1000000000;
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL) == EINTR);
+    }
+    else {
+        sender->next_ns = now;
+    }
+    sender->next_ns += (int64_t) sender->pending * 1000000000 / sender->rate;
+
+    return;
+}
+
+/* send the joined messages */
+bool mcip_sender_flush(struct s_mcip_sender *sender)
+{
+    bool ok = true;
+
+    if (sender->pending == 0) {
+        return true;
+    }
+
+    mcip_sender_wait(sender);
+    if (sender->start_ns == 0) {
+        sender->start_ns = mcip_sender_now();
+    }
+
+    if (mcip_send(sender->sock, MCIP_CMD_WRITE, sender->len, sender->frame) != 0) {
+        sender->failed += sender->pending;
+        errno = EIO;
+        ok = false;
+    }
+    else {
+        sender->messages += sender->pending;
+        sender->bytes += sender->len - sender->header - (sender->pending - 1);
+        sender->telegrams++;
+    }
+
+    sender->len = sender->header;
+    sender->pending = 0;
+
+    return ok;
+}
+
+/* send a message */
+bool mcip_sender_send(struct s_mcip_sender *sender, const char *message, size_t len)
+{
+    if (len > mcip_sender_max(sender)) {
+        sender->failed++;
+        errno = EMSGSIZE;
+        return false;
+    }
+
+    /* the message is joined to the telegram if both fit, otherwise the telegram goes first */
+    if (sender->pending > 0 && sender->len + 1 + len > sender->coalesce) {
+        if (mcip_sender_flush(sender) == false) {
+            /* the message is not sent either */
+            sender->failed++;
+            return false;
+        }
+    }
+    if (sender->pending > 0) {
+        sender->frame[sender->len++] = '\n';
+    }
+    memcpy(sender->frame + sender->len, message, len);
+    sender->len += len;
+    sender->pending++;
+
+    /* without coalescing (or if the telegram is full anyway) it is sent right away */
+    if (sender->coalesce == 0 || sender->len >= sender->coalesce) {
+        return mcip_sender_flush(sender);
+    }
+
+    return true;
+}
+
+/* print the number of messages, bytes and telegrams sent and the rates */
+void mcip_sender_report(const struct s_mcip_sender *sender)
+{
+    double seconds = 0;
+
+    if (sender->start_ns != 0) {
+        seconds = (mcip_sender_now() - sender->start_ns) / 1e9;
+    }
+
+    printf("Sent %llu messages (%llu bytes) in %llu telegrams within %.3f s: %.0f messages/s, %.0f bytes/s, %llu failed\n",
+           (unsigned long long) sender->messages, (unsigned long long) sender->bytes, (unsigned long long) sender->telegrams,
+           seconds, (seconds > 0) ? sender->messages / seconds : 0, (seconds > 0) ? sender->bytes / seconds : 0,
+           (unsigned long long) sender->failed);
+    return;
+}
+
+/* send the joined messages and free the buffer */
+void mcip_sender_free(struct s_mcip_sender *sender)
+{
+    if (sender->frame != NULL && mcip_sender_flush(sender) == false) {
+        printf("Failed to send string to MCIP\n");
+    }
+    safefree((void **) &sender->frame);
+    return;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#define MCIP_SENDER_MAX         65535   /* largest payload of a telegram (OIDs and message) */
+
+/* sends messages to an OID over a registered MCIP socket, the payload of every telegram is built in one buffer that
+    is allocated once: the OID to send to, this tool's OID (if not 0) and the message
+    with coalescing, messages are joined (separated by '\n') into one telegram as long as the payload does not exceed
+    <coalesce> bytes, the receiver has to split them; without, every message is sent in a telegram of its own
+    the rate limits the messages per second, a telegram of joined messages waits for all of them */
+struct s_mcip_sender {
+    int sock;
+    uint16_t to_oid;
+    uint16_t my_oid;                    /* 0 if the payload only starts with to_oid */
+    size_t header;                      /* bytes of OIDs in front of the messages */
+    char *frame;                        /* payload of the next telegram */
+    size_t len;                         /* bytes in frame, including the OIDs */
+    size_t coalesce;                    /* largest payload of joined messages, 0 for one message per telegram */
+    int pending;                        /* messages in frame */
+    int rate;                           /* messages per second, 0 for no limit */
+    int64_t next_ns;                    /* earliest point in time (CLOCK_MONOTONIC) of the next telegram */
+    int64_t start_ns;                   /* first telegram */
+    uint64_t messages;                  /* messages sent */
+    uint64_t bytes;                     /* bytes of the messages sent */
+    uint64_t telegrams;                 /* telegrams sent */
+    uint64_t failed;                    /* messages that could not be sent */
+};
+
+/* initialise a sender
+    on error, false is returned and errno set appropriately */
+bool mcip_sender_init(struct s_mcip_sender *sender, int sock, uint16_t to_oid, uint16_t my_oid, size_t coalesce, int rate);
+
+/* largest message that can be sent */
+size_t mcip_sender_max(const struct s_mcip_sender *sender);
+
+/* send a message, it is only added to the telegram when coalescing and sent by a later call
+    on error, false is returned and errno set appropriately (EMSGSIZE if the message is too large), the message is
+    counted as failed (and the joined messages before it, if they could not be sent) */
+bool mcip_sender_send(struct s_mcip_sender *sender, const char *message, size_t len);
+
+/* send the joined messages
+    on error, false is returned and errno set appropriately */
+bool mcip_sender_flush(struct s_mcip_sender *sender);
+
+/* print the number of messages, bytes and telegrams sent and the rates */
+void mcip_sender_report(const struct s_mcip_sender *sender);
+
+/* send the joined messages and free the buffer */
+void mcip_sender_free(struct s_mcip_sender *sender);
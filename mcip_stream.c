@@ -0,0 +1,113 @@
+#include "mcip_stream.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+void safefree(void **pp);
+
+/* length of a telegram including the header */
+size_t mcip_stream_frame_len(const uint8_t *p)
+{
+    return (size_t) (p[3] | p[4] << 8) + MCIP_STREAM_HEADER;
+}
+
+/* allocate the buffer */
+bool mcip_stream_init(struct s_mcip_stream *stream)
+{
+    memset(stream, 0, sizeof(struct s_mcip_stream));
+    stream->buffer = malloc(MCIP_STREAM_SIZE);
+    if (stream->buffer == NULL) {
+        errno = ENOMEM;
+        return false;
+    }
+    stream->size = MCIP_STREAM_SIZE;
+
+    return true;
+}
+
+/* make room for the next read: drop the telegrams already returned and grow the buffer if the telegram in front does
+    not fit (or the buffer is full) */
+static bool mcip_stream_reserve(struct s_mcip_stream *stream)
+{
+    uint8_t *buffer;
+    size_t size;
+
+    if (stream->start > 0) {
+        memmove(stream->buffer, stream->buffer + stream->start, stream->len - stream->start);
+        stream->len -= stream->start;
+        stream->start = 0;
+    }
+
+    size = stream->size;
+    if (stream->len >= MCIP_STREAM_HEADER && mcip_stream_frame_len(stream->buffer) > size) {
+        size = mcip_stream_frame_len(stream->buffer);
+    }
+    if (stream->len == size) {
+        size *= 2;
+    }
+    if (size == stream->size) {
+        return true;
+    }
+
+    buffer = realloc(stream->buffer, size);
+    if (buffer == NULL) {
+        errno = ENOMEM;
+        return false;
+    }
+    stream->buffer = buffer;
+    stream->size = size;
+
+    return true;
+}
+
+/* read once from the socket into the stream */
+ssize_t mcip_stream_read(struct s_mcip_stream *stream, int fd)
+{
+    ssize_t x;
+
+    if (mcip_stream_reserve(stream) == false) {
+        return -1;
+    }
+
+    x = read(fd, stream->buffer + stream->len, stream->size - stream->len);
+    if (x > 0) {
+        stream->len += x;
+    }
+
+    return x;
+}
+
+/* get the next complete telegram */
+const uint8_t *mcip_stream_next(struct s_mcip_stream *stream, size_t *len)
+{
+    const uint8_t *p = stream->buffer + stream->start;
+    size_t available = stream->len - stream->start;
+
+    if (available < MCIP_STREAM_HEADER || available < mcip_stream_frame_len(p)) {
+        return NULL;
+    }
+
+    *len = mcip_stream_frame_len(p);
+    stream->start += *len;
+
+    return p;
+}
+
+/* drop all buffered bytes */
+void mcip_stream_reset(struct s_mcip_stream *stream)
+{
+    stream->len = 0;
+    stream->start = 0;
+    return;
+}
+
+/* free the buffer */
+void mcip_stream_free(struct s_mcip_stream *stream)
+{
+    safefree((void **) &stream->buffer);
+    stream->size = 0;
+    mcip_stream_reset(stream);
+    return;
+}
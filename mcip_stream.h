@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/* an MCIP telegram starts with a header of 5 bytes, bytes 3 and 4 hold the length (little endian) of the rest */
+#define MCIP_STREAM_HEADER      5
+#define MCIP_STREAM_SIZE        1500    /* initial size of the buffer, it grows for larger telegrams */
+
+/* reassembles the telegrams of an MCIP socket: a read may return several telegrams, or only a part of one, the bytes
+    that belong to the next telegram are kept until it is complete */
+struct s_mcip_stream {
+    uint8_t *buffer;            /* received bytes */
+    size_t size;                /* allocated size of the buffer */
+    size_t len;                 /* number of bytes in the buffer */
+    size_t start;               /* start of the first telegram not returned yet, the bytes before belong to the
+                                   telegrams already returned, they are dropped by the next read */
+};
+
+/* length of a telegram including the header, p must hold at least the header */
+size_t mcip_stream_frame_len(const uint8_t *p);
+
+/* allocate the buffer
+    on error, false is returned and errno set appropriately */
+bool mcip_stream_init(struct s_mcip_stream *stream);
+
+/* read once from the socket into the stream
+    returns the number of bytes read, 0 on EOF and -1 on error (errno is set) */
+ssize_t mcip_stream_read(struct s_mcip_stream *stream, int fd);
+
+/* get the next complete telegram (including the header)
+    the telegram stays valid until the next read, NULL is returned if there is no complete telegram */
+const uint8_t *mcip_stream_next(struct s_mcip_stream *stream, size_t *len);
+
+/* drop all buffered bytes, e.g. after reconnecting */
+void mcip_stream_reset(struct s_mcip_stream *stream);
+
+/* free the buffer */
+void mcip_stream_free(struct s_mcip_stream *stream);
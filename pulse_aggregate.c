@@ -0,0 +1,236 @@
+#include "pulse_aggregate.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+/* initialise an aggregation */
+bool pulse_aggregate_init(struct s_pulse_aggregate *aggregate, const char *interval, struct s_event_sink *sink)
+{
+    struct timespec now;
+    char *end;
+    long value;
+
+    memset(aggregate, 0, sizeof(struct s_pulse_aggregate));
+    aggregate->sink = sink;
+    aggregate->timer = -1;
+    strcpy(aggregate->overflow.input, "*");
+
+    value = strtol(interval, &end, 10);
+    if (strcmp(end, "m") == 0) {
+        value *= 60;
+    }
+    else if (strcmp(end, "h") == 0) {
+        value *= 3600;
+    }
+    else if (*end != '\0' && strcmp(end, "s") != 0) {
+        value = 0;
+    }
+    if (end == interval || value < 1 || value > PULSE_AGGREGATE_MAX || sink->format == EVENT_SINK_BINARY) {
+        errno = EINVAL;
+        return false;
+    }
+    aggregate->interval = (int) value;
+
+    clock_gettime(CLOCK_REALTIME, &now);
+    aggregate->start = now;
+    aggregate->end = (now.tv_sec / aggregate->interval + 1) * aggregate->interval;
+
+    return true;
+}
+
+/* milliseconds until the end of the current window, at least 1 (0 would disarm the timer) */
+static int pulse_aggregate_remaining(struct s_pulse_aggregate *aggregate)
+{
+    struct timespec now;
+    long long ms;
+
+    clock_gettime(CLOCK_REALTIME, &now);
+    ms = (long long) (aggregate->end - now.tv_sec) * 1000 - now.tv_nsec / 1000000;
+
+    return (ms < 1) ? 1 : (int) ms;
+}
+
+/* the current window has ended */
+static void pulse_aggregate_timer(struct s_event_loop *loop, int fd, uint32_t expirations, void *ctx)
+{
+    struct s_pulse_aggregate *aggregate = ctx;
+
+    if (pulse_aggregate_flush(aggregate) == false) {
+        printf("Failed to write the pulses (%d): %s\n", errno, strerror(errno));
+    }
+    return;
+}
+
+/* start the timer of the windows */
+bool pulse_aggregate_attach(struct s_pulse_aggregate *aggregate, struct s_event_loop *loop)
+{
+    aggregate->loop = loop;
+    aggregate->timer = event_loop_timer(loop, pulse_aggregate_remaining(aggregate), 0, pulse_aggregate_timer, aggregate);
+
+    return (aggregate->timer != -1);
+}
+
+/* count a pulse event */
+void pulse_aggregate_add(struct s_pulse_aggregate *aggregate, const struct s_mcip_event *event, const struct timespec *now)
+{
+    struct s_pulse_counter *counter = NULL;
+    int i;
+
+    /* the event belongs to the next window, even if the timer has not expired yet */
+    if (now->tv_sec >= aggregate->end && pulse_aggregate_flush(aggregate) == false) {
+        printf("Failed to write the pulses (%d): %s\n", errno, strerror(errno));
+    }
+
+    if (event->input[0] != '\0') {
+        for (i = 0; i < aggregate->count; i++) {
+            if (strcmp(aggregate->counters[i].input, event->input) == 0) {
+                counter = &aggregate->counters[i];
+                break;
+            }
+        }
+        if (counter == NULL && aggregate->count < PULSE_AGGREGATE_INPUTS) {
+            counter = &aggregate->counters[aggregate->count++];
+            strcpy(counter->input, event->input);
+        }
+    }
+    if (counter == NULL) {
+        counter = &aggregate->overflow;
+    }
+
+    if (counter->events == 0) {
+        counter->first = *now;
+    }
+    counter->last = *now;
+    counter->events++;
+    if (event->pulses > 0) {
+        counter->pulses += event->pulses;
+    }
+
+    return;
+}
+
+/* format a time as ISO 8601 (UTC, milliseconds) */
+static void pulse_aggregate_time(char *buffer, size_t size, const struct timespec *time)
+{
+    struct tm tm;
+    size_t n;
+
+    gmtime_r(&time->tv_sec, &tm);
+    n = strftime(buffer, size, "%Y-%m-%dT%H:%M:%S", &tm);
+    snprintf(buffer + n, size - n, ".%03ldZ", time->tv_nsec / 1000000);
+    return;
+}
+
+/* write the summary of an input */
+static bool pulse_aggregate_write(struct s_pulse_aggregate *aggregate, struct s_pulse_counter *counter, const char *window, double seconds)
+{
+    char line[256];
+    char first[32] = "";
+    char last[32] = "";
+    double rate = (seconds > 0) ? counter->pulses / seconds : 0;
+    int n = 0;
+
+    if (counter->events > 0) {
+        pulse_aggregate_time(first, sizeof(first), &counter->first);
+        pulse_aggregate_time(last, sizeof(last), &counter->last);
+    }
+
+    switch (aggregate->sink->format) {
+        case EVENT_SINK_JSON: {
+            if (counter->events > 0) {
+                n = snprintf(line, sizeof(line), "{\"window\":\"%s\",\"input\":\"%s\",\"pulses\":%llu,\"events\":%u,\"rate\":%.3f,\"first\":\"%s\",\"last\":\"%s\"}\n",
+                    window, counter->input, (unsigned long long) counter->pulses, counter->events, rate, first, last);
+            }
+            else {
+                n = snprintf(line, sizeof(line), "{\"window\":\"%s\",\"input\":\"%s\",\"pulses\":0,\"events\":0,\"rate\":0.000,\"first\":null,\"last\":null}\n",
+                    window, counter->input);
+            }
+            break;
+        }
+
+        case EVENT_SINK_CSV: {
+            if (aggregate->sink->header == false) {
+                if (event_sink_write_text(aggregate->sink, "window,input,pulses,events,rate,first,last\n", 43) == false) {
+                    return false;
+                }
+                aggregate->sink->header = true;
+            }
+            n = snprintf(line, sizeof(line), "%s,%s,%llu,%u,%.3f,%s,%s\n",
+                window, counter->input, (unsigned long long) counter->pulses, counter->events, rate, first, last);
+            break;
+        }
+
+        default: {
+            n = snprintf(line, sizeof(line), "%s %s pulses: %llu events: %u rate: %.3f/s first: %s last: %s\n",
+                window, counter->input, (unsigned long long) counter->pulses, counter->events, rate,
+                (counter->events > 0) ? first : "-", (counter->events > 0) ? last : "-");
+            break;
+        }
+    }
+
+    return event_sink_write_text(aggregate->sink, line, n);
+}
+
+/* write the summary of the current window and start the next one */
+bool pulse_aggregate_flush(struct s_pulse_aggregate *aggregate)
+{
+    struct timespec now, end;
+    char window[32];
+    double seconds;
+    bool ok = true;
+    int i;
+
+    /* the window ends at its boundary, or now if it is cut short */
+    clock_gettime(CLOCK_REALTIME, &now);
+    end.tv_sec = aggregate->end;
+    end.tv_nsec = 0;
+    if (now.tv_sec < aggregate->end) {
+        end = now;
+    }
+    seconds = (end.tv_sec - aggregate->start.tv_sec) + (end.tv_nsec - aggregate->start.tv_nsec) / 1e9;
+    pulse_aggregate_time(window, sizeof(window), &end);
+
+    for (i = 0; ok == true && i < aggregate->count; i++) {
+        ok = pulse_aggregate_write(aggregate, &aggregate->counters[i], window, seconds);
+    }
+    if (ok == true && aggregate->overflow.events > 0) {
+        ok = pulse_aggregate_write(aggregate, &aggregate->overflow, window, seconds);
+    }
+    if (ok == true && aggregate->sink->len > 0) {
+        ok = event_sink_flush(aggregate->sink);
+    }
+
+    /* the inputs are kept, only their counters start again */
+    for (i = 0; i < aggregate->count; i++) {
+        aggregate->counters[i].pulses = 0;
+        aggregate->counters[i].events = 0;
+    }
+    aggregate->overflow.pulses = 0;
+    aggregate->overflow.events = 0;
+
+    /* the next window ends at the next boundary, windows missed (e.g. the clock has been set) are skipped */
+    aggregate->start = end;
+    if (now.tv_sec >= aggregate->end) {
+        aggregate->end = (now.tv_sec / aggregate->interval + 1) * aggregate->interval;
+    }
+    if (aggregate->timer != -1) {
+        event_loop_timer_set(aggregate->loop, aggregate->timer, pulse_aggregate_remaining(aggregate), 0);
+    }
+
+    return ok;
+}
+
+/* write the summary of the current window and stop the timer */
+void pulse_aggregate_free(struct s_pulse_aggregate *aggregate)
+{
+    if (aggregate->timer != -1) {
+        event_loop_remove(aggregate->loop, aggregate->timer);
+        aggregate->timer = -1;
+    }
+    if (pulse_aggregate_flush(aggregate) == false) {
+        printf("Failed to write the pulses (%d): %s\n", errno, strerror(errno));
+    }
+    return;
+}
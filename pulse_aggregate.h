@@ -0,0 +1,65 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "event_loop.h"
+#include "event_sink.h"
+#include "mcip_event.h"
+
+#define PULSE_AGGREGATE_INPUTS  64      /* number of inputs counted separately, further inputs are counted as "*" */
+#define PULSE_AGGREGATE_MAX     86400   /* maximum length of a window (s) */
+
+/* pulses of one input in the current window */
+struct s_pulse_counter {
+    char input[16];                     /* e.g. "2.1" */
+    uint64_t pulses;                    /* sum of the pulses of the events */
+    uint32_t events;                    /* number of pulse events */
+    struct timespec first;              /* time of the first and the last event (CLOCK_REALTIME) */
+    struct timespec last;
+};
+
+/* aggregation of pulse events: the pulses are summed per input and one summary per input is written at the end of
+    every window instead of one line per event
+    the windows are aligned to wall-clock boundaries (UTC), e.g. a window of 15m ends at :00, :15, :30 and :45, the
+    first window starts with the aggregation and the last ends when it is freed, so no pulse is lost
+    every input seen so far is written at the end of a window, with 0 pulses if there has been no event
+    summaries are written in the format of the sink (raw, json or csv) with the fields
+        window      end of the window
+        input       the input
+        pulses      sum of the pulses
+        events      number of pulse events
+        rate        pulses per second over the window
+        first/last  time of the first and the last event, empty if there has been none */
+struct s_pulse_aggregate {
+    int interval;                       /* length of a window (s) */
+    struct s_event_sink *sink;
+    struct s_event_loop *loop;
+    int timer;                          /* end of the window, -1 if there is none */
+    struct timespec start;              /* start of the current window */
+    time_t end;                         /* end of the current window */
+    struct s_pulse_counter counters[PULSE_AGGREGATE_INPUTS];
+    int count;
+    struct s_pulse_counter overflow;    /* inputs that do not fit into counters */
+};
+
+/* initialise an aggregation writing to the sink
+    interval is the length of a window as given on the command line: <n> or <n>s (seconds), <n>m (minutes) or <n>h (hours)
+    on error, false is returned and errno set appropriately (EINVAL for an invalid interval or if the sink writes binary) */
+bool pulse_aggregate_init(struct s_pulse_aggregate *aggregate, const char *interval, struct s_event_sink *sink);
+
+/* start the timer of the windows on the loop
+    on error, false is returned and errno set appropriately */
+bool pulse_aggregate_attach(struct s_pulse_aggregate *aggregate, struct s_event_loop *loop);
+
+/* count a pulse event received at now (CLOCK_REALTIME) */
+void pulse_aggregate_add(struct s_pulse_aggregate *aggregate, const struct s_mcip_event *event, const struct timespec *now);
+
+/* write the summary of the current window and start the next one
+    on error, false is returned and errno set appropriately */
+bool pulse_aggregate_flush(struct s_pulse_aggregate *aggregate);
+
+/* write the summary of the current window and stop the timer, this must be called before the sink and the loop are
+    freed */
+void pulse_aggregate_free(struct s_pulse_aggregate *aggregate);
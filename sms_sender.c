@@ -0,0 +1,290 @@
+#define _GNU_SOURCE
+#include "sms_sender.h"
+#include "m3_cli_stats.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+
+/* state of sms_send */
+struct s_sms_bulk {
+    struct s_sms_session *session;
+    struct s_sms_message *messages;
+    int count;
+    int next;                   /* next SMS whose setup has to be written */
+    int completed;              /* number of SMS reported */
+    int failed;                 /* number of SMS not sent */
+    int pending_submits;        /* submits written but not answered */
+    int *pending_setups;        /* values of the setup of every SMS not answered yet */
+    int64_t *started_us;        /* start of the setup of every SMS */
+    sms_done_callback done;
+    void *ctx;
+};
+
+/* argument of the completion of a command */
+struct s_sms_command {
+    struct s_sms_bulk *bulk;
+    int index;                  /* SMS the command belongs to */
+    bool submit;                /* the command is the submit, not a value of the setup */
+};
+
+void safefree(void **pp);
+
+static bool sms_start(struct s_sms_bulk *bulk, int index);
+static void sms_answer(struct s_m3_cli *cli, enum m3_cli_status status, const char *answer, size_t len, void *ctx);
+
+/* forget the values written to the cli */
+void sms_session_forget(struct s_sms_session *session)
+{
+    safefree((void **) &session->modem);
+    safefree((void **) &session->recipient);
+    safefree((void **) &session->text);
+    return;
+}
+
+/* free the values of the session */
+void sms_session_free(struct s_sms_session *session)
+{
+    sms_session_forget(session);
+    return;
+}
+
+/* check if the answer of the cli reports an error */
+static bool sms_answer_failed(enum m3_cli_status status, const char *answer)
+{
+    return (status != M3_CLI_PROMPT || m3_cli_answer_failed(answer));
+}
+
+/* an SMS is finished: report it */
+static void sms_finish(struct s_sms_bulk *bulk, int index, bool sent, const char *result)
+{
+    struct s_sms_message *message = &bulk->messages[index];
+
+    message->sent = sent;
+    if (message->result == NULL) {
+        message->result = strdup(result != NULL ? result : "");
+    }
+    message->duration_us = m3_cli_stats_now_us() - bulk->started_us[index];
+    if (sent == false) {
+        bulk->failed++;
+    }
+    bulk->completed++;
+    if (bulk->done != NULL) {
+        bulk->done(message, bulk->ctx);
+    }
+    return;
+}
+
+/* submit a command for an SMS, the deadline covers the submits that have to be answered before */
+static bool sms_command(struct s_sms_bulk *bulk, int index, char *command, bool submit)
+{
+    struct s_sms_command *c;
+
+    c = calloc(1, sizeof(struct s_sms_command));
+    if (c == NULL) {
+        return false;
+    }
+    c->bulk = bulk;
+    c->index = index;
+    c->submit = submit;
+
+    if (m3_cli_submit(bulk->session->cli, command, SMS_SUBMIT_WAITTIME_MS * (bulk->pending_submits + 1), sms_answer, c) == false) {
+        safefree((void **) &c);
+        return false;
+    }
+
+    return true;
+}
+
+/* submit the submit command of an SMS and start the setup of the next one */
+static void sms_submit(struct s_sms_bulk *bulk, int index)
+{
+    if (sms_command(bulk, index, "help.debug.sms.submit=1", true) == false) {
+        sms_finish(bulk, index, false, strerror(errno));
+    }
+    else {
+        bulk->pending_submits++;
+    }
+
+    /* the setup of the next SMS is written behind the submit */
+    if (bulk->next < bulk->count) {
+        sms_start(bulk, bulk->next++);
+    }
+    return;
+}
+
+/* completion of a command of an SMS */
+static void sms_answer(struct s_m3_cli *cli, enum m3_cli_status status, const char *answer, size_t len, void *ctx)
+{
+    struct s_sms_command *c = ctx;
+    struct s_sms_bulk *bulk = c->bulk;
+    int index = c->index;
+    bool submit = c->submit;
+    struct s_sms_message *message = &bulk->messages[index];
+    bool failed;
+
+    safefree((void **) &c);
+    failed = sms_answer_failed(status, answer);
+
+    if (submit == true) {
+        bulk->pending_submits--;
+        if (status != M3_CLI_PROMPT) {
+            sms_session_forget(bulk->session);
+        }
+        sms_finish(bulk, index, !failed, (status == M3_CLI_PROMPT) ? answer : m3_cli_status_string(status));
+        return;
+    }
+
+    /* a value of the setup: the values written are not known any more if it failed */
+    if (failed == true) {
+        sms_session_forget(bulk->session);
+        if (message->result == NULL) {
+            message->result = strdup((status == M3_CLI_PROMPT && answer != NULL) ? answer : m3_cli_status_string(status));
+        }
+    }
+    bulk->pending_setups[index]--;
+
+    /* the whole setup has been answered: submit the SMS only if all values have been set */
+    if (bulk->pending_setups[index] == 0) {
+        if (message->result != NULL) {
+            sms_finish(bulk, index, false, NULL);
+            if (bulk->next < bulk->count) {
+                sms_start(bulk, bulk->next++);
+            }
+        }
+        else {
+            sms_submit(bulk, index);
+        }
+    }
+
+    return;
+}
+
+/* write a value of the setup if it has changed */
+static bool sms_set(struct s_sms_bulk *bulk, int index, char **written, const char *key, const char *value)
+{
+    char *command;
+    bool ok;
+
+    if (*written != NULL && strcmp(*written, value) == 0) {
+        return true;
+    }
+
+    command = calloc(1, strlen(key) + strlen(value) + 1);
+    if (command == NULL) {
+        return false;
+    }
+    sprintf(command, "%s%s", key, value);
+    ok = sms_command(bulk, index, command, false);
+    safefree((void **) &command);
+    if (ok == false) {
+        return false;
+    }
+
+    /* the value is expected to be set, it is forgotten again if this fails */
+    safefree((void **) written);
+    *written = strdup(value);
+    bulk->pending_setups[index]++;
+
+    return true;
+}
+
+/* start an SMS: write the changed values of its setup or submit it right away */
+static bool sms_start(struct s_sms_bulk *bulk, int index)
+{
+    struct s_sms_session *session = bulk->session;
+    struct s_sms_message *message = &bulk->messages[index];
+    char *text;
+    bool ok;
+
+    bulk->started_us[index] = m3_cli_stats_now_us();
+
+    text = calloc(1, strlen(message->text) + 64);
+    if (text == NULL) {
+        sms_finish(bulk, index, false, strerror(ENOMEM));
+        return false;
+    }
+    sprintf(text, "-----BEGIN ...-----%s-----END ...-----", message->text);
+
+    ok = sms_set(bulk, index, &session->modem, "help.debug.sms.modem=", message->modem) &&
+         sms_set(bulk, index, &session->recipient, "help.debug.sms.recipient=", message->number) &&
+         sms_set(bulk, index, &session->text, "help.debug.sms.text=", text);
+    safefree((void **) &text);
+
+    if (ok == false) {
+        sms_session_forget(session);
+        if (bulk->pending_setups[index] == 0) {
+            sms_finish(bulk, index, false, strerror(errno));
+            return false;
+        }
+        /* the values already submitted are answered first */
+        message->result = strdup(strerror(errno));
+        return false;
+    }
+
+    /* nothing has changed */
+    if (bulk->pending_setups[index] == 0) {
+        sms_submit(bulk, index);
+    }
+
+    return true;
+}
+
+/* send the SMS one after another over the session */
+int sms_send(struct s_sms_session *session, struct s_sms_message *messages, int count, sms_done_callback done, void *ctx)
+{
+    struct s_sms_bulk bulk;
+    struct pollfd pfd;
+    int timeout;
+
+    if (session == NULL || session->cli == NULL || messages == NULL || count < 1) {
+        errno = EINVAL;
+        return count;
+    }
+
+    memset(&bulk, 0, sizeof(bulk));
+    bulk.session = session;
+    bulk.messages = messages;
+    bulk.count = count;
+    bulk.done = done;
+    bulk.ctx = ctx;
+    bulk.pending_setups = calloc(count, sizeof(int));
+    bulk.started_us = calloc(count, sizeof(int64_t));
+    if (bulk.pending_setups == NULL || bulk.started_us == NULL) {
+        safefree((void **) &bulk.pending_setups);
+        safefree((void **) &bulk.started_us);
+        errno = ENOMEM;
+        return count;
+    }
+
+    bulk.next = 1;
+    sms_start(&bulk, 0);
+
+    /* drive the session until every SMS has been reported */
+    while (bulk.completed < count) {
+        if (session->cli->requests == NULL) {
+            /* nothing in flight, e.g. the setup could not be submitted */
+            if (bulk.next < count) {
+                sms_start(&bulk, bulk.next++);
+                continue;
+            }
+            break;
+        }
+
+        pfd.fd = m3_cli_fd(session->cli);
+        pfd.events = m3_cli_events(session->cli);
+        pfd.revents = 0;
+        timeout = m3_cli_timeout_ms(session->cli);
+        if (pfd.fd != -1 && timeout != 0 && poll(&pfd, 1, timeout) == -1 && errno != EINTR) {
+            break;
+        }
+        m3_cli_step(session->cli);
+    }
+
+    safefree((void **) &bulk.pending_setups);
+    safefree((void **) &bulk.started_us);
+
+    return bulk.failed + (count - bulk.completed);
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "m3_cli.h"
+
+/* maximum time the cli may take to submit one SMS */
+#define SMS_SUBMIT_WAITTIME_MS  60000
+
+/* cli session used to send SMS, it remembers the values written to the cli, so unchanged values are not written again */
+struct s_sms_session {
+    struct s_m3_cli *cli;       /* the cli session */
+    char *modem;                /* modem written last (NULL if unknown) */
+    char *recipient;            /* recipient written last (NULL if unknown) */
+    char *text;                 /* text written last (NULL if unknown) */
+};
+
+/* one SMS to send */
+struct s_sms_message {
+    char *number;               /* phone number of the recipient */
+    char *text;                 /* text of the SMS */
+    char *modem;                /* modem to use */
+    bool sent;                  /* the SMS has been submitted successfully */
+    char *result;               /* answer of the submit or the reason why the SMS has not been sent (allocated) */
+    int64_t duration_us;        /* time from the start of the setup until the answer of the submit */
+};
+
+/* called whenever an SMS has been submitted or has failed */
+typedef void (*sms_done_callback)(struct s_sms_message *message, void *ctx);
+
+/* forget the values written to the cli (e.g. after the session has been reopened) */
+void sms_session_forget(struct s_sms_session *session);
+
+/* send the SMS one after another over the session:
+    only the values that differ from the ones written before are written (modem, recipient, text), the setup of the next
+    SMS is written while the submit of the SMS before is still pending, the submit itself is only written after all
+    values of its setup have been acknowledged
+    done is called for every SMS as soon as it is finished, returns the number of SMS that have not been sent */
+int sms_send(struct s_sms_session *session, struct s_sms_message *messages, int count, sms_done_callback done, void *ctx);
+
+/* free the values of the session (not the cli session) */
+void sms_session_free(struct s_sms_session *session);
@@ -0,0 +1,565 @@
+#define _GNU_SOURCE
+#include "sms_spool.h"
+#include "m3_cli_stats.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <dirent.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+
+/* retry state of an SMS that failed before */
+struct s_sms_spool_retry {
+    char *name;                 /* file name in "new" */
+    int attempts;               /* failed attempts */
+    int64_t next_us;            /* earliest point in time (CLOCK_MONOTONIC) of the next attempt */
+    bool seen;                  /* the file still exists */
+    bool sent;                  /* it has been sent, but could not be removed: it is removed again, not sent again */
+};
+
+/* rate limit of a modem */
+struct s_sms_spool_modem {
+    char *modem;
+    int64_t next_us;            /* earliest point in time (CLOCK_MONOTONIC) of the next SMS */
+};
+
+/* state of sms_spool_run */
+struct s_sms_spool_worker {
+    const char *dir;
+    struct s_sms_session *session;
+    int rate;
+    sms_done_callback done;
+    void *ctx;
+    struct s_sms_spool_retry *retries;
+    int retry_count;
+    struct s_sms_spool_modem *modems;
+    int modem_count;
+    char *names[SMS_SPOOL_BATCH];       /* file names of the SMS of the batch */
+    struct s_sms_message messages[SMS_SPOOL_BATCH];
+};
+
+void safefree(void **pp);
+
+/* build the path of a file of the spool */
+static char *spool_path(const char *dir, const char *sub, const char *name)
+{
+    char *path = NULL;
+
+    if (asprintf(&path, "%s/%s%s%s", dir, sub, (name != NULL) ? "/" : "", (name != NULL) ? name : "") == -1) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    return path;
+}
+
+/* create a directory if it does not exist */
+static bool spool_mkdir(const char *dir, const char *sub)
+{
+    char *path;
+    bool ok;
+
+    path = (sub != NULL) ? spool_path(dir, sub, NULL) : strdup(dir);
+    if (path == NULL) {
+        return false;
+    }
+    ok = (mkdir(path, 0700) == 0 || errno == EEXIST);
+    safefree((void **) &path);
+
+    return ok;
+}
+
+/* create the directories of the spool */
+bool sms_spool_create(const char *dir)
+{
+    return spool_mkdir(dir, NULL) && spool_mkdir(dir, "tmp") && spool_mkdir(dir, "new") && spool_mkdir(dir, "failed");
+}
+
+/* write everything to a file */
+static bool spool_write(int fd, const char *data, size_t len)
+{
+    ssize_t x;
+
+    while (len > 0) {
+        x = write(fd, data, len);
+        if (x == -1 && errno == EINTR) {
+            continue;
+        }
+        if (x <= 0) {
+            return false;
+        }
+        data += x;
+        len -= x;
+    }
+    return true;
+}
+
+/* append an SMS to the spool */
+bool sms_spool_enqueue(const char *dir, const char *modem, const char *number, const char *text)
+{
+    static unsigned int counter = 0;
+    struct timespec now;
+    char name[64];
+    char *tmp_path = NULL, *new_path = NULL, *dir_path = NULL;
+    int fd, saved;
+    bool ok;
+
+    /* a command of the cli is one line */
+    if (modem == NULL || number == NULL || text == NULL || strchr(modem, '\n') != NULL || strchr(number, '\n') != NULL ||
+        strchr(text, '\n') != NULL) {
+        errno = EINVAL;
+        return false;
+    }
+
+    /* the time first, so the names sort in FIFO order, pid and counter make the name unique */
+    clock_gettime(CLOCK_REALTIME, &now);
+    snprintf(name, sizeof(name), "%010lld.%09ld.%d.%u", (long long) now.tv_sec, now.tv_nsec, (int) getpid(), counter++);
+    tmp_path = spool_path(dir, "tmp", name);
+    new_path = spool_path(dir, "new", name);
+    if (tmp_path == NULL || new_path == NULL) {
+        safefree((void **) &tmp_path);
+        safefree((void **) &new_path);
+        return false;
+    }
+
+    fd = open(tmp_path, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+    if (fd == -1) {
+        safefree((void **) &tmp_path);
+        safefree((void **) &new_path);
+        return false;
+    }
+
+    /* the SMS must be on disk before it shows up in "new" */
+    ok = spool_write(fd, modem, strlen(modem)) && spool_write(fd, "\n", 1) &&
+         spool_write(fd, number, strlen(number)) && spool_write(fd, "\n", 1) &&
+         spool_write(fd, text, strlen(text)) && fsync(fd) == 0;
+    saved = errno;
+    if (close(fd) != 0 && ok == true) {
+        ok = false;
+        saved = errno;
+    }
+    if (ok == true && rename(tmp_path, new_path) != 0) {
+        ok = false;
+        saved = errno;
+    }
+    if (ok == false) {
+        unlink(tmp_path);
+    }
+
+    /* the SMS is only queued for sure, when the rename is on disk as well */
+    if (ok == true) {
+        dir_path = spool_path(dir, "new", NULL);
+        fd = (dir_path != NULL) ? open(dir_path, O_RDONLY | O_DIRECTORY | O_CLOEXEC) : -1;
+        if (fd == -1 || fsync(fd) != 0) {
+            ok = false;
+            saved = errno;
+        }
+        if (fd != -1) {
+            close(fd);
+        }
+        safefree((void **) &dir_path);
+    }
+
+    safefree((void **) &tmp_path);
+    safefree((void **) &new_path);
+    errno = saved;
+
+    return ok;
+}
+
+/* read an SMS of the spool */
+static bool spool_read(const char *dir, const char *name, struct s_sms_message *message)
+{
+    char *path, *data = NULL, *modem, *number, *text;
+    size_t size = 0;
+    FILE *f;
+    bool ok;
+
+    path = spool_path(dir, "new", name);
+    if (path == NULL) {
+        return false;
+    }
+    f = fopen(path, "r");
+    safefree((void **) &path);
+    if (f == NULL) {
+        return false;
+    }
+    ok = (getdelim(&data, &size, '\0', f) != -1);
+    fclose(f);
+    if (ok == false) {
+        safefree((void **) &data);
+        errno = EINVAL;
+        return false;
+    }
+
+    modem = data;
+    number = strchr(modem, '\n');
+    text = (number != NULL) ? strchr(number + 1, '\n') : NULL;
+    if (text == NULL) {
+        safefree((void **) &data);
+        errno = EINVAL;
+        return false;
+    }
+    *number++ = '\0';
+    *text++ = '\0';
+
+    memset(message, 0, sizeof(struct s_sms_message));
+    message->modem = strdup(modem);
+    message->number = strdup(number);
+    message->text = strdup(text);
+    safefree((void **) &data);
+
+    return true;
+}
+
+/* free the values of a message read from the spool */
+static void spool_message_free(struct s_sms_message *message)
+{
+    safefree((void **) &message->modem);
+    safefree((void **) &message->number);
+    safefree((void **) &message->text);
+    safefree((void **) &message->result);
+    return;
+}
+
+/* move an SMS that can not be sent to "failed" */
+static void spool_reject(const char *dir, const char *name)
+{
+    char *new_path, *failed_path;
+
+    new_path = spool_path(dir, "new", name);
+    failed_path = spool_path(dir, "failed", name);
+    if (new_path != NULL && failed_path != NULL && rename(new_path, failed_path) != 0) {
+        printf("Failed to move %s to %s (%d): %s\n", new_path, failed_path, errno, strerror(errno));
+    }
+    safefree((void **) &new_path);
+    safefree((void **) &failed_path);
+    return;
+}
+
+/* remove an SMS that has been sent
+    returns false if it is still in the spool */
+static bool spool_remove(const char *dir, const char *name)
+{
+    char *path;
+    bool ok = false;
+
+    path = spool_path(dir, "new", name);
+    if (path != NULL) {
+        ok = (unlink(path) == 0 || errno == ENOENT);
+        if (ok == false) {
+            printf("Failed to remove %s (%d): %s\n", path, errno, strerror(errno));
+        }
+    }
+    safefree((void **) &path);
+
+    return ok;
+}
+
+/* only regular files of the spool, the files starting with "." are ignored */
+static int spool_filter(const struct dirent *entry)
+{
+    return (entry->d_name[0] != '.');
+}
+
+/* find the retry state of an SMS, NULL if it has not failed before */
+static struct s_sms_spool_retry *spool_retry(struct s_sms_spool_worker *worker, const char *name)
+{
+    int i;
+
+    for (i = 0; i < worker->retry_count; i++) {
+        if (strcmp(worker->retries[i].name, name) == 0) {
+            return &worker->retries[i];
+        }
+    }
+    return NULL;
+}
+
+/* forget the retry state of an SMS */
+static void spool_retry_drop(struct s_sms_spool_worker *worker, struct s_sms_spool_retry *retry)
+{
+    safefree((void **) &retry->name);
+    *retry = worker->retries[--worker->retry_count];
+    return;
+}
+
+/* find (or add) the retry state of an SMS */
+static struct s_sms_spool_retry *spool_retry_add(struct s_sms_spool_worker *worker, const char *name)
+{
+    struct s_sms_spool_retry *retry, *retries;
+
+    retry = spool_retry(worker, name);
+    if (retry != NULL) {
+        return retry;
+    }
+
+    retries = realloc(worker->retries, (worker->retry_count + 1) * sizeof(struct s_sms_spool_retry));
+    if (retries == NULL) {
+        return NULL;
+    }
+    worker->retries = retries;
+    retry = &worker->retries[worker->retry_count];
+    memset(retry, 0, sizeof(struct s_sms_spool_retry));
+    retry->name = strdup(name);
+    if (retry->name == NULL) {
+        return NULL;
+    }
+    worker->retry_count++;
+
+    return retry;
+}
+
+/* find (or add) the rate limit of a modem */
+static struct s_sms_spool_modem *spool_modem(struct s_sms_spool_worker *worker, const char *modem)
+{
+    struct s_sms_spool_modem *modems;
+    int i;
+
+    for (i = 0; i < worker->modem_count; i++) {
+        if (strcmp(worker->modems[i].modem, modem) == 0) {
+            return &worker->modems[i];
+        }
+    }
+
+    modems = realloc(worker->modems, (worker->modem_count + 1) * sizeof(struct s_sms_spool_modem));
+    if (modems == NULL) {
+        return NULL;
+    }
+    worker->modems = modems;
+    worker->modems[worker->modem_count].modem = strdup(modem);
+    worker->modems[worker->modem_count].next_us = 0;
+
+    return &worker->modems[worker->modem_count++];
+}
+
+/* an SMS of the batch has failed: retry it later or give up */
+static void spool_failed(struct s_sms_spool_worker *worker, const char *name, int64_t now)
+{
+    struct s_sms_spool_retry *retry;
+    int64_t backoff_ms;
+
+    retry = spool_retry_add(worker, name);
+    if (retry == NULL) {
+        return;
+    }
+    retry->attempts++;
+    retry->seen = true;
+
+    if (retry->attempts >= SMS_SPOOL_ATTEMPTS) {
+        printf("Giving up %s after %d attempts\n", name, retry->attempts);
+        spool_reject(worker->dir, name);
+        spool_retry_drop(worker, retry);
+        return;
+    }
+
+    backoff_ms = (int64_t) SMS_SPOOL_BACKOFF_MIN_MS << (retry->attempts - 1);
+    if (backoff_ms > SMS_SPOOL_BACKOFF_MAX_MS) {
+        backoff_ms = SMS_SPOOL_BACKOFF_MAX_MS;
+    }
+    retry->next_us = now + backoff_ms * 1000;
+    return;
+}
+
+/* pick the SMS of the spool that are due and send them
+    returns the number of SMS taken from the spool, -1 on error; *wake_us is lowered to the next point in time an SMS
+    becomes due */
+static int spool_batch(struct s_sms_spool_worker *worker, int64_t *wake_us)
+{
+    struct s_sms_spool_retry *retry;
+    struct s_sms_spool_modem *modem;
+    struct dirent **entries = NULL;
+    char *path;
+    int64_t now;
+    int n, i, count = 0;
+
+    path = spool_path(worker->dir, "new", NULL);
+    if (path == NULL) {
+        return -1;
+    }
+    n = scandir(path, &entries, spool_filter, alphasort);
+    safefree((void **) &path);
+    if (n == -1) {
+        return -1;
+    }
+
+    now = m3_cli_stats_now_us();
+    for (i = 0; i < worker->retry_count; i++) {
+        worker->retries[i].seen = false;
+    }
+
+    for (i = 0; i < n; i++) {
+        retry = spool_retry(worker, entries[i]->d_name);
+        if (retry != NULL) {
+            retry->seen = true;
+        }
+        if (count == SMS_SPOOL_BATCH) {
+            continue;
+        }
+
+        /* it has been sent already, only the removal failed */
+        if (retry != NULL && retry->sent == true) {
+            if (spool_remove(worker->dir, entries[i]->d_name) == true) {
+                spool_retry_drop(worker, retry);
+            }
+            else if (now + SMS_SPOOL_BACKOFF_MIN_MS * 1000 < *wake_us) {
+                *wake_us = now + SMS_SPOOL_BACKOFF_MIN_MS * 1000;
+            }
+            continue;
+        }
+
+        /* waiting for the backoff */
+        if (retry != NULL && retry->next_us > now) {
+            if (retry->next_us < *wake_us) {
+                *wake_us = retry->next_us;
+            }
+            continue;
+        }
+
+        if (spool_read(worker->dir, entries[i]->d_name, &worker->messages[count]) == false) {
+            /* it has been removed in the meantime */
+            if (errno == ENOENT) {
+                continue;
+            }
+            printf("Failed to read %s (%d): %s\n", entries[i]->d_name, errno, strerror(errno));
+            spool_reject(worker->dir, entries[i]->d_name);
+            continue;
+        }
+
+        /* waiting for the rate limit of the modem */
+        modem = spool_modem(worker, worker->messages[count].modem);
+        if (modem != NULL && worker->rate > 0) {
+            if (modem->next_us > now) {
+                if (modem->next_us < *wake_us) {
+                    *wake_us = modem->next_us;
+                }
+                spool_message_free(&worker->messages[count]);
+                continue;
+            }
+            modem->next_us = now + 60000000 / worker->rate;
+        }
+
+        worker->names[count++] = strdup(entries[i]->d_name);
+    }
+
+    /* forget the SMS that have been removed from the spool */
+    for (i = 0; i < worker->retry_count; i++) {
+        if (worker->retries[i].seen == false) {
+            spool_retry_drop(worker, &worker->retries[i--]);
+        }
+    }
+    for (i = 0; i < n; i++) {
+        safefree((void **) &entries[i]);
+    }
+    safefree((void **) &entries);
+
+    if (count == 0) {
+        return 0;
+    }
+
+    /* other processes may have used the cli in the meantime, so the values written before are not trusted */
+    sms_session_forget(worker->session);
+    sms_send(worker->session, worker->messages, count, worker->done, worker->ctx);
+
+    now = m3_cli_stats_now_us();
+    for (i = 0; i < count; i++) {
+        if (worker->messages[i].sent == true) {
+            if (spool_remove(worker->dir, worker->names[i]) == true) {
+                retry = spool_retry(worker, worker->names[i]);
+                if (retry != NULL) {
+                    spool_retry_drop(worker, retry);
+                }
+            }
+            else {
+                /* keep it from being sent again, the removal is retried on the next scan */
+                retry = spool_retry_add(worker, worker->names[i]);
+                if (retry != NULL) {
+                    retry->sent = true;
+                    retry->seen = true;
+                    if (now + SMS_SPOOL_BACKOFF_MIN_MS * 1000 < *wake_us) {
+                        *wake_us = now + SMS_SPOOL_BACKOFF_MIN_MS * 1000;
+                    }
+                }
+            }
+        }
+        else {
+            spool_failed(worker, worker->names[i], now);
+        }
+        spool_message_free(&worker->messages[i]);
+        safefree((void **) &worker->names[i]);
+    }
+
+    return count;
+}
+
+/* send the SMS of the spool over the session until *stop is set */
+int sms_spool_run(const char *dir, struct s_sms_session *session, int rate, sms_done_callback done, void *ctx,
+                  volatile sig_atomic_t *stop)
+{
+    struct s_sms_spool_worker worker;
+    struct pollfd pfd;
+    char events[4096];
+    char *path;
+    int64_t wake_us, now;
+    int timeout, count, i, ret = 0;
+
+    memset(&worker, 0, sizeof(worker));
+    worker.dir = dir;
+    worker.session = session;
+    worker.rate = rate;
+    worker.done = done;
+    worker.ctx = ctx;
+
+    /* new SMS wake the sender up right away, without inotify the spool is polled */
+    pfd.fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    pfd.events = POLLIN;
+    path = spool_path(dir, "new", NULL);
+    if (pfd.fd != -1 && (path == NULL || inotify_add_watch(pfd.fd, path, IN_MOVED_TO | IN_CLOSE_WRITE) == -1)) {
+        close(pfd.fd);
+        pfd.fd = -1;
+    }
+    safefree((void **) &path);
+
+    while (*stop == 0) {
+        wake_us = INT64_MAX;
+        count = spool_batch(&worker, &wake_us);
+        if (count == -1) {
+            ret = -1;
+            break;
+        }
+        /* look for more right away */
+        if (count > 0) {
+            continue;
+        }
+
+        now = m3_cli_stats_now_us();
+        timeout = (wake_us == INT64_MAX) ? -1 : (int) ((wake_us - now + 999) / 1000);
+        if (pfd.fd == -1 && (timeout == -1 || timeout > SMS_SPOOL_POLL_MS)) {
+            timeout = SMS_SPOOL_POLL_MS;
+        }
+        if (pfd.fd != -1 && poll(&pfd, 1, timeout) > 0) {
+            while (read(pfd.fd, events, sizeof(events)) > 0);
+        }
+        else if (pfd.fd == -1) {
+            poll(NULL, 0, timeout);
+        }
+    }
+
+    if (pfd.fd != -1) {
+        close(pfd.fd);
+    }
+    for (i = 0; i < worker.retry_count; i++) {
+        safefree((void **) &worker.retries[i].name);
+    }
+    safefree((void **) &worker.retries);
+    for (i = 0; i < worker.modem_count; i++) {
+        safefree((void **) &worker.modems[i].modem);
+    }
+    safefree((void **) &worker.modems);
+
+    return ret;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <signal.h>
+
+#include "sms_sender.h"
+
+/* default directory of the outbound spool */
+#define SMS_SPOOL_DIR               "/var/spool/sms"
+
+#define SMS_SPOOL_BATCH             32      /* maximum number of SMS sent over the session at once */
+#define SMS_SPOOL_ATTEMPTS          10      /* an SMS is moved to "failed" after this number of attempts */
+#define SMS_SPOOL_BACKOFF_MIN_MS    5000    /* pause after the first failed attempt, it is doubled on every attempt */
+#define SMS_SPOOL_BACKOFF_MAX_MS    600000  /* maximum pause between two attempts */
+#define SMS_SPOOL_POLL_MS           1000    /* interval to look for new SMS if the directory can not be watched */
+
+/* the spool is a maildir like directory: every SMS is one file, it is written to "tmp" and moved to "new" when it is
+    complete, so the sender never sees a partial SMS, and it is moved to "failed" if it could not be sent
+    the name of a file starts with the time of enqueueing, so sorted names are in FIFO order
+    a file holds the modem and the number in the first two lines, the rest of the file is the text */
+
+/* create the directories of the spool
+    on error, false is returned and errno set appropriately */
+bool sms_spool_create(const char *dir);
+
+/* append an SMS to the spool, it does not talk to the cli
+    the values must not contain line breaks, on error, false is returned and errno set appropriately */
+bool sms_spool_enqueue(const char *dir, const char *modem, const char *number, const char *text);
+
+/* send the SMS of the spool over the session until *stop is set
+    rate is the maximum number of SMS per minute and modem (0 for no limit), failed SMS are retried with an exponential
+    backoff, the attempts are only counted in memory, done is called for every attempt
+    returns 0 if stopped, -1 with errno set if the spool can not be read */
+int sms_spool_run(const char *dir, struct s_sms_session *session, int rate, sms_done_callback done, void *ctx,
+                  volatile sig_atomic_t *stop);